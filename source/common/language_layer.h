@@ -1822,11 +1822,18 @@ internal v4 HexColorToColor(const char *HexColor)
 // cross-platform threads/atomics
 ///////////////////////////////////////////////////////////////////////////////
 
+// Size of a cache line in bytes. Data written by different threads should be
+// kept on separate cache lines to avoid false sharing.
+#define CACHE_LINE_SIZE 64
+
 #if defined(PLATFORM_LINUX) || defined(PLATFORM_MACOS)
 // Use software (not hardware) memory barriers to serialize reads/writes when
 // necessary in multi-threading applications.
 #define CompletePreviousReadsBeforeFutureReads asm volatile("" ::: "memory")
 #define CompletePreviousWritesBeforeFutureWrites asm volatile("" ::: "memory")
+// NOTE: The one reordering x86 does in hardware is loads passing earlier
+// stores, so this needs a real fence.
+#define CompletePreviousWritesBeforeFutureReads __sync_synchronize()
 
 inline u32 AtomicCompareAndExchangeU32(u32 volatile *Value, u32 New, u32 Expected)
 {
@@ -1834,6 +1841,12 @@ inline u32 AtomicCompareAndExchangeU32(u32 volatile *Value, u32 New, u32 Expecte
   return(Result);
 }
 
+inline u64 AtomicCompareAndExchangeU64(u64 volatile *Value, u64 New, u64 Expected)
+{
+  u64 Result = __sync_val_compare_and_swap(Value, Expected, New);
+  return(Result);
+}
+
 inline u32 AtomicExchangeU32(u32 volatile *Value, u32 New)
 {
   u32 Result = __sync_lock_test_and_set(Value, New);
@@ -1858,6 +1871,20 @@ inline u64 AtomicAddU64(u64 volatile *Value, u64 Addend)
   return(Result);
 }
 
+// NOTE: Acquire loads and release stores for single-producer/single-consumer
+// cursors. Writes made before a release store are visible to any thread that
+// observes the stored value with an acquire load.
+inline u32 AtomicLoadAcquireU32(u32 volatile *Value)
+{
+  u32 Result = __atomic_load_n(Value, __ATOMIC_ACQUIRE);
+  return(Result);
+}
+
+inline void AtomicStoreReleaseU32(u32 volatile *Value, u32 New)
+{
+  __atomic_store_n(Value, New, __ATOMIC_RELEASE);
+}
+
 inline u32 GetThreadID(void)
 {
   u32 ThreadID;
@@ -1877,6 +1904,7 @@ inline u32 GetThreadID(void)
 #elif defined(PLATFORM_WIN)
 #define CompletePreviousReadsBeforeFutureReads _ReadBarrier()
 #define CompletePreviousWritesBeforeFutureWrites _WriteBarrier()
+#define CompletePreviousWritesBeforeFutureReads MemoryBarrier()
 
 inline uint32 AtomicCompareExchangeU32(uint32 volatile *Value, uint32 New, uint32 Expected)
 {
@@ -1885,6 +1913,13 @@ inline uint32 AtomicCompareExchangeU32(uint32 volatile *Value, uint32 New, uint3
   return(Result);
 }
 
+inline u64 AtomicCompareAndExchangeU64(u64 volatile *Value, u64 New, u64 Expected)
+{
+  u64 Result = _InterlockedCompareExchange64((__int64 volatile *)Value, New, Expected);
+  
+  return(Result);
+}
+
 inline u64 AtomicExchangeU64(u64 volatile *Value, u64 New)
 {
   u64 Result = _InterlockedExchange64((__int64 volatile *)Value, New);
@@ -1906,6 +1941,22 @@ inline u64 AtomicAddU64(u64 volatile *Value, u64 Addend)
   return(Result);
 }
 
+// NOTE: Aligned loads and stores are atomic on x86/x64 and the hardware does
+// not reorder them in ways that break acquire/release, so only the compiler
+// needs to be fenced.
+inline u32 AtomicLoadAcquireU32(u32 volatile *Value)
+{
+  u32 Result = *Value;
+  _ReadWriteBarrier();
+  return(Result);
+}
+
+inline void AtomicStoreReleaseU32(u32 volatile *Value, u32 New)
+{
+  _ReadWriteBarrier();
+  *Value = New;
+}
+
 inline u32 GetThreadID(void)
 {
   u8 *ThreadLocalStorage = (u8 *)__readgsqword(0x30);
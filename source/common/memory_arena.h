@@ -3,10 +3,52 @@
 
 #include "language_layer.h"
 
+// Makes a range of reserved memory usable. Returns false if it could not be
+// committed.
+typedef b32 memory_commit_fn(void *Memory, umm SizeBytes);
+
+// Reserved memory is committed in steps of at least this size, to keep the
+// number of calls to commit down.
+#define ARENA_COMMIT_GRANULARITY Kilobytes(64)
+
+// What an arena does to keep the memory it hands out zeroed.
+typedef enum arena_zero_policy {
+  // Memory is zeroed as it's released, so anything past Used is always zero.
+  ARENA_ZERO_on_release,
+  // Memory is zeroed as it's allocated, but only the part of it the arena has
+  // handed out before. Releasing is free.
+  ARENA_ZERO_on_alloc,
+  // Memory is never zeroed. Allocations hold whatever was last there.
+  ARENA_ZERO_never,
+  // As on_alloc, but released memory is filled with ARENA_POISON_BYTE so that
+  // anything still reading it, or reading memory it never wrote, stands out.
+  ARENA_ZERO_poison
+} arena_zero_policy;
+
+#define ARENA_POISON_BYTE 0xCD
+
 typedef struct memory_arena {
   u8  *Base;
   umm Size;
   umm Used;
+  // Furthest into the current block the arena has handed out memory. Memory
+  // past it is still zero.
+  umm HighWater;
+  
+  // NOTE: Memory past CommitPos is only reserved, and is committed through
+  // Commit as the arena grows into it. Arenas over memory that is already
+  // usable have no Commit function and are committed up to their Size.
+  memory_commit_fn *Commit;
+  umm CommitPos;
+  // Bytes this arena has committed itself, not counting any children
+  umm Committed;
+  
+  arena_zero_policy ZeroPolicy;
+  // NOTE: An arena that runs out of room chains on a heap block of at least
+  // this many bytes, or asserts if this is zero.
+  umm MinimumBlockSize;
+  // Heap blocks chained on after the arena's own memory
+  u32 BlockCount;
   
   u32 ID;
   u32 NumChildren;
@@ -15,16 +57,30 @@ typedef struct memory_arena {
   struct memory_arena *Parent;
 } memory_arena;
 
+// Sits at the start of each chained heap block and remembers the block the
+// arena was allocating from before it.
+typedef struct memory_arena_block {
+  u8  *Base;
+  umm Size;
+  umm Used;
+  umm HighWater;
+  memory_commit_fn *Commit;
+  umm CommitPos;
+} memory_arena_block;
+
 typedef struct temporary_arena {
   memory_arena *Arena;
   umm SavedUsed;
+  u32 SavedBlockCount;
 } temporary_arena;
 
 // Useful macros
-#define ArenaPushStruct(Arena_, Type_) (Type_*)ArenaAlloc(Arena_, sizeof(Type_))
-#define ArenaPushArray(Arena_, Count_, Type_) (Type_*)ArenaAlloc(Arena_, sizeof(Type_) * Count_)
+#define ArenaPushStruct(Arena_, Type_) (Type_*)ArenaAllocAligned(Arena_, sizeof(Type_), alignof(Type_))
+#define ArenaPushArray(Arena_, Count_, Type_) (Type_*)ArenaAllocAligned(Arena_, sizeof(Type_) * (Count_), alignof(Type_))
+// For memory the caller overwrites in full before reading
+#define ArenaPushArrayNoZero(Arena_, Count_, Type_) (Type_*)ArenaAllocNoZero(Arena_, sizeof(Type_) * (Count_), alignof(Type_))
 
-// ArenaInit initializes a new memory arena from a chunk of memory.
+// ArenaInit initializes a new memory arena from a chunk of zeroed memory.
 memory_arena ArenaInit(u8 *Memory, umm SizeBytes)
 {
   memory_arena Result = {};
@@ -32,6 +88,13 @@ memory_arena ArenaInit(u8 *Memory, umm SizeBytes)
   Result.Base = (u8*)Memory;
   Result.Size = SizeBytes;
   Result.Used = 0;
+  Result.HighWater = 0;
+  Result.Commit = NULL;
+  Result.CommitPos = SizeBytes;
+  Result.Committed = SizeBytes;
+  Result.ZeroPolicy = ARENA_ZERO_on_release;
+  Result.MinimumBlockSize = 0;
+  Result.BlockCount = 0;
   Result.Parent = NULL;
   Result.ID = 0;
   Result.NumChildren = 0;
@@ -40,29 +103,176 @@ memory_arena ArenaInit(u8 *Memory, umm SizeBytes)
   return(Result);
 }
 
-// ArenaClear zeros the memory in the given arena.
+// ArenaInitReserved initializes a new memory arena over reserved memory, which
+// is committed with Commit as allocations reach it. Reserved memory must read
+// as zero once committed.
+memory_arena ArenaInitReserved(u8 *Memory, umm SizeBytes, memory_commit_fn *Commit)
+{
+  memory_arena Result = ArenaInit(Memory, SizeBytes);
+  
+  Result.Commit = Commit;
+  Result.CommitPos = 0;
+  Result.Committed = 0;
+  
+  return(Result);
+}
+
+// ArenaCommit makes sure the bytes from From up to To are committed.
+void ArenaCommit(memory_arena *Arena, umm From, umm To)
+{
+  if (To > Arena->CommitPos)
+  {
+    // NOTE: Memory between CommitPos and From belongs to child arenas, which
+    // commit it themselves.
+    umm Start = Max(Arena->CommitPos, From);
+    umm End = Min(To + ARENA_COMMIT_GRANULARITY - 1, Arena->Size);
+    End -= End % ARENA_COMMIT_GRANULARITY;
+    End = Max(End, To);
+    
+    b32 WasCommitted = Arena->Commit(Arena->Base + Start, End - Start);
+    assert(WasCommitted);
+    
+    Arena->Committed += End - Start;
+    Arena->CommitPos = End;
+  }
+}
+
+// ArenaRelease applies the arena's zero policy to bytes From up to To of the
+// current block, which are no longer in use.
+internal void ArenaRelease(memory_arena *Arena, umm From, umm To)
+{
+  if (From < To)
+  {
+    if (Arena->ZeroPolicy == ARENA_ZERO_on_release)
+    {
+      ZeroMemory(Arena->Base + From, To - From);
+    }
+    else if (Arena->ZeroPolicy == ARENA_ZERO_poison)
+    {
+      memset(Arena->Base + From, ARENA_POISON_BYTE, To - From);
+    }
+  }
+}
+
+// ArenaPushBlock chains a new heap block of at least Size bytes onto Arena.
+internal void ArenaPushBlock(memory_arena *Arena, umm Size)
+{
+  umm BlockSize = Max(Size, Arena->MinimumBlockSize);
+  
+  // NOTE: calloc hands back zeroed memory, which the zero policies rely on
+  // for memory past the high water mark.
+  memory_arena_block *Block = (memory_arena_block*)calloc(1, sizeof(memory_arena_block) + BlockSize);
+  assert(Block);
+  
+  Block->Base = Arena->Base;
+  Block->Size = Arena->Size;
+  Block->Used = Arena->Used;
+  Block->HighWater = Arena->HighWater;
+  Block->Commit = Arena->Commit;
+  Block->CommitPos = Arena->CommitPos;
+  
+  Arena->Base = (u8*)(Block + 1);
+  Arena->Size = BlockSize;
+  Arena->Used = 0;
+  Arena->HighWater = 0;
+  Arena->Commit = NULL;
+  Arena->CommitPos = BlockSize;
+  Arena->Committed += BlockSize;
+  Arena->BlockCount++;
+}
+
+// ArenaPopBlock frees the most recently chained heap block, going back to the
+// block before it.
+internal void ArenaPopBlock(memory_arena *Arena)
+{
+  assert(Arena->BlockCount > 0);
+  
+  memory_arena_block *Block = (memory_arena_block*)Arena->Base - 1;
+  Arena->Committed -= Arena->Size;
+  
+  Arena->Base = Block->Base;
+  Arena->Size = Block->Size;
+  Arena->Used = Block->Used;
+  Arena->HighWater = Block->HighWater;
+  Arena->Commit = Block->Commit;
+  Arena->CommitPos = Block->CommitPos;
+  Arena->BlockCount--;
+  
+  free(Block);
+}
+
+// ArenaClear releases everything allocated from the given arena.
 void ArenaClear(memory_arena *Arena)
 {
+  while (Arena->BlockCount > 0)
+  {
+    ArenaPopBlock(Arena);
+  }
+  
+  // NOTE: Memory past the high water mark is already zero
+  ArenaRelease(Arena, 0, Arena->HighWater);
   Arena->Used = 0;
-  ZeroMemory(Arena->Base, Arena->Size);
 }
 
-// ArenaAlloc allocates a chunk of memory of Size bytes from Arena.
-u8* ArenaAlloc(memory_arena *Arena, umm Size)
+// ArenaPush allocates Size bytes aligned to Alignment, a power of 2, from
+// Arena. Zeroes them according to the arena's policy if Zero is set.
+internal u8* ArenaPush(memory_arena *Arena, umm Size, umm Alignment, b32 Zero)
 {
-  umm TotalSize = Arena->Used + Size;
-  assert(TotalSize <= Arena->Size);
+  assert((Alignment & (Alignment - 1)) == 0);
+  
+  umm Padding = (Alignment - ((umm)(Arena->Base + Arena->Used) & (Alignment - 1))) & (Alignment - 1);
+  if (Arena->Used + Padding + Size > Arena->Size && Arena->MinimumBlockSize > 0)
+  {
+    ArenaPushBlock(Arena, Size + Alignment - 1);
+    Padding = (Alignment - ((umm)Arena->Base & (Alignment - 1))) & (Alignment - 1);
+  }
   
-  u8 *Result = Arena->Base + Arena->Used;
-  Arena->Used += Size;
+  umm Start = Arena->Used + Padding;
+  umm End = Start + Size;
+  assert(End <= Arena->Size);
+  
+  if (Arena->Commit)
+  {
+    ArenaCommit(Arena, Start, End);
+  }
+  
+  u8 *Result = Arena->Base + Start;
+  if (Zero && Start < Arena->HighWater &&
+      (Arena->ZeroPolicy == ARENA_ZERO_on_alloc || Arena->ZeroPolicy == ARENA_ZERO_poison))
+  {
+    ZeroMemory(Result, Min(End, Arena->HighWater) - Start);
+  }
+  
+  Arena->Used = End;
+  Arena->HighWater = Max(Arena->HighWater, End);
   
   return(Result);
 }
 
+// ArenaAlloc allocates a chunk of memory of Size bytes from Arena.
+u8* ArenaAlloc(memory_arena *Arena, umm Size)
+{
+  return(ArenaPush(Arena, Size, 1, true));
+}
+
+// ArenaAllocAligned allocates Size bytes from Arena aligned to Alignment,
+// which must be a power of 2.
+u8* ArenaAllocAligned(memory_arena *Arena, umm Size, umm Alignment)
+{
+  return(ArenaPush(Arena, Size, Alignment, true));
+}
+
+// ArenaAllocNoZero is ArenaAllocAligned for memory the caller overwrites in
+// full before reading, so it is never zeroed no matter the arena's policy.
+u8* ArenaAllocNoZero(memory_arena *Arena, umm Size, umm Alignment)
+{
+  return(ArenaPush(Arena, Size, Alignment, false));
+}
+
 // ArenaCopy allocates space and copies the given data into the arena
 void ArenaCopy(memory_arena *Arena, u8 *Data, umm Size)
 {
-  u8 *DataPointer = ArenaAlloc(Arena, Size);
+  u8 *DataPointer = ArenaAllocNoZero(Arena, Size, 1);
   MemoryCopy(DataPointer, Data, Size);
 }
 
@@ -70,20 +280,38 @@ void ArenaCopy(memory_arena *Arena, u8 *Data, umm Size)
 void ArenaFree(memory_arena *Arena, umm Size)
 {
   Assert(Arena->Used >= Size);
+  ArenaRelease(Arena, Arena->Used - Size, Arena->Used);
   Arena->Used -= Size;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // child arenas
 
-// ArenaPushChild pushes a child memory arena of Size bytes onto the Parent arena.
+// ArenaPushChild pushes a child memory arena of Size bytes onto the Parent
+// arena. The child starts out zeroed and takes on the parent's zero policy.
 memory_arena ArenaPushChild(memory_arena *Parent, umm Size)
 {
   memory_arena Result = {};
   
-  Result.Base = ArenaAlloc(Parent, Size);
-  Result.Size = Size;
-  Result.Used = 0;
+  if (Parent->Commit && Parent->Used + Size <= Parent->Size)
+  {
+    // NOTE: The child commits its own memory as it grows, so that a large
+    // child doesn't commit all of itself up front. Only memory the parent
+    // has handed out before needs zeroing, and that is committed already.
+    umm Start = Parent->Used;
+    if (Start < Parent->HighWater && Parent->ZeroPolicy != ARENA_ZERO_on_release)
+    {
+      ZeroMemory(Parent->Base + Start, Min(Start + Size, Parent->HighWater) - Start);
+    }
+    Result = ArenaInitReserved(Parent->Base + Start, Size, Parent->Commit);
+    Parent->Used += Size;
+  }
+  else
+  {
+    Result = ArenaInit(ArenaAlloc(Parent, Size), Size);
+  }
+  
+  Result.ZeroPolicy = Parent->ZeroPolicy;
   Result.Parent = Parent;
   Result.ID = Parent->NumChildren;
   Result.NumChildren = 0;
@@ -101,10 +329,40 @@ void ArenaPopChild(memory_arena *Child)
   assert(Parent);
   assert((Parent->NumChildren - 1) == Child->ID);
   
+  while (Child->BlockCount > 0)
+  {
+    ArenaPopBlock(Child);
+  }
+  assert(Child->Base + Child->Size == Parent->Base + Parent->Used);
+  
   Parent->Used -= Child->Size;
+  umm Start = Parent->Used;
   
-  // Zero out all used memory for later allocations
-  ZeroMemory(Parent->Base + Parent->Used, Child->Used);
+  if (Child->Commit)
+  {
+    // NOTE: The child only committed the start of its memory. The parent
+    // expects everything below its CommitPos to be committed, so if it has
+    // committed past the child the rest of the child's memory is committed
+    // now. Otherwise the parent picks up committing from where the child
+    // left off.
+    umm ChildCommitEnd = Start + Child->CommitPos;
+    Parent->Committed += Child->Committed;
+    if (Parent->CommitPos > ChildCommitEnd)
+    {
+      umm GapEnd = Min(Start + Child->Size, Parent->CommitPos);
+      b32 WasCommitted = Parent->Commit(Parent->Base + ChildCommitEnd, GapEnd - ChildCommitEnd);
+      assert(WasCommitted);
+      Parent->Committed += GapEnd - ChildCommitEnd;
+    }
+    else
+    {
+      Parent->CommitPos = ChildCommitEnd;
+    }
+  }
+  
+  // Release the memory the child used for later allocations
+  ArenaRelease(Parent, Start, Start + Child->HighWater);
+  Parent->HighWater = Max(Parent->HighWater, Start + Child->HighWater);
   
   Child->Parent = NULL;
   Child->ID = 0;
@@ -122,6 +380,7 @@ temporary_arena BeginTemporaryArena(memory_arena *Arena) {
   
   Result.Arena = Arena;
   Result.SavedUsed = Arena->Used;
+  Result.SavedBlockCount = Arena->BlockCount;
   
   Arena->TempCount++;
   
@@ -132,8 +391,13 @@ temporary_arena BeginTemporaryArena(memory_arena *Arena) {
 void EndTemporaryArena(temporary_arena TempArena) {
   memory_arena* Arena = TempArena.Arena;
   
-  // Zero the memory used by the temporary arena
-  ZeroMemory(Arena->Base + TempArena.SavedUsed, Arena->Used - TempArena.SavedUsed);
+  // Heap blocks chained on since the temporary arena began go back entirely
+  while (Arena->BlockCount > TempArena.SavedBlockCount)
+  {
+    ArenaPopBlock(Arena);
+  }
+  
+  ArenaRelease(Arena, TempArena.SavedUsed, Arena->Used);
   
   Arena->Used = TempArena.SavedUsed;
   
@@ -157,11 +421,13 @@ typedef struct scoped_arena {
 } scoped_arena;
 
 #define ScopedArenaPushArray(ScopedArena, Count, Type) ArenaPushArray((ScopedArena)->TempArena.Arena, Count, Type)
+#define ScopedArenaPushArrayNoZero(ScopedArena, Count, Type) ArenaPushArrayNoZero((ScopedArena)->TempArena.Arena, Count, Type)
 
 internal char* ScopedArenaStrdup(scoped_arena *ScopedArena, const char *Value)
 {
-  char* Data = ScopedArenaPushArray(ScopedArena, strlen(Value), char);
-  strncpy(Data, Value, strlen(Value));
+  umm Length = strlen(Value);
+  char* Data = ScopedArenaPushArrayNoZero(ScopedArena, Length + 1, char);
+  MemoryCopy(Data, Value, Length + 1);
   
   return(Data);
 }
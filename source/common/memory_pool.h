@@ -0,0 +1,123 @@
+/*
+ A fixed-size block pool that any number of threads can allocate from and free
+ to without taking a lock. Blocks are carved out of an arena up front and kept
+ on a free list (a Treiber stack).
+
+   memory_pool Pool;
+   MemoryPoolInit(&Pool, &PermanentArena, sizeof(my_work), 64);
+   my_work *Work = (my_work*)MemoryPoolAlloc(&Pool);
+   ...
+   MemoryPoolFree(&Pool, Work);
+
+The head of the free list packs the index of the first free block together
+with a tag that changes on every update, so a block that is taken and put back
+between another thread's read of the head and its exchange can't be mistaken
+for the head it read (the ABA problem).
+*/
+#ifndef COMMON_MEMORY_POOL_H
+#define COMMON_MEMORY_POOL_H
+
+#include "language_layer.h"
+#include "memory_arena.h"
+
+// Marks the end of the free list
+#define MEMORY_POOL_NIL 0xFFFFFFFF
+
+typedef struct memory_pool {
+  u8  *Base;
+  umm BlockSize;
+  u32 BlockCount;
+
+  // NOTE: Low 32 bits are the index of the first free block, high 32 bits
+  // are the tag.
+  u64 volatile Head;
+  u32 volatile Used;
+} memory_pool;
+
+// Index of the next free block, stored in the first bytes of each free block
+inline u32 volatile* MemoryPoolNext(memory_pool *Pool, u32 Index)
+{
+  return((u32 volatile*)(Pool->Base + Index * Pool->BlockSize));
+}
+
+// MemoryPoolInit carves BlockCount blocks of BlockSize bytes out of Arena.
+void MemoryPoolInit(memory_pool *Pool, memory_arena *Arena, umm BlockSize, u32 BlockCount)
+{
+  // NOTE: Round up so every block stays pointer aligned
+  BlockSize = Max(BlockSize, sizeof(u32));
+  BlockSize = (BlockSize + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+  Pool->Base = ArenaAllocAligned(Arena, BlockSize * BlockCount, sizeof(void*));
+  Pool->BlockSize = BlockSize;
+  Pool->BlockCount = BlockCount;
+  Pool->Used = 0;
+
+  foreach(I, BlockCount)
+  {
+    *MemoryPoolNext(Pool, I) = (I + 1 < BlockCount) ? I + 1 : MEMORY_POOL_NIL;
+  }
+  Pool->Head = (BlockCount > 0) ? 0 : MEMORY_POOL_NIL;
+}
+
+// MemoryPoolAlloc takes a zeroed block from the pool, or returns NULL if all
+// of them are in use.
+u8* MemoryPoolAlloc(memory_pool *Pool)
+{
+  u8 *Result = NULL;
+
+  for (;;)
+  {
+    u64 Head = Pool->Head;
+    CompletePreviousReadsBeforeFutureReads;
+
+    u32 Index = (u32)Head;
+    if (Index == MEMORY_POOL_NIL)
+    {
+      break;
+    }
+
+    // NOTE: Another thread may take this block first, in which case Next is
+    // garbage, but the tag will have moved on and the exchange fails.
+    u32 Next = *MemoryPoolNext(Pool, Index);
+    u64 NewHead = (((Head >> 32) + 1) << 32) | Next;
+    if (AtomicCompareAndExchangeU64(&Pool->Head, NewHead, Head) == Head)
+    {
+      Result = Pool->Base + Index * Pool->BlockSize;
+      break;
+    }
+  }
+
+  if (Result)
+  {
+    AtomicAddU32(&Pool->Used, 1);
+    ZeroMemory(Result, Pool->BlockSize);
+  }
+
+  return(Result);
+}
+
+// MemoryPoolFree returns a block taken with MemoryPoolAlloc to the pool.
+void MemoryPoolFree(memory_pool *Pool, void *Block)
+{
+  umm Offset = (u8*)Block - Pool->Base;
+  Assert(Offset % Pool->BlockSize == 0);
+  u32 Index = (u32)(Offset / Pool->BlockSize);
+  Assert(Index < Pool->BlockCount);
+
+  for (;;)
+  {
+    u64 Head = Pool->Head;
+    *MemoryPoolNext(Pool, Index) = (u32)Head;
+    CompletePreviousWritesBeforeFutureWrites;
+
+    u64 NewHead = (((Head >> 32) + 1) << 32) | Index;
+    if (AtomicCompareAndExchangeU64(&Pool->Head, NewHead, Head) == Head)
+    {
+      break;
+    }
+  }
+
+  AtomicAddU32(&Pool->Used, (u32)-1);
+}
+
+#endif // COMMON_MEMORY_POOL_H
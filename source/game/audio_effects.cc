@@ -0,0 +1,367 @@
+#include "audio_effects.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// audio_effect_params
+
+internal audio_effect_params AudioLowPass(f32 CutoffHz)
+{
+  audio_effect_params Result = {};
+  Result.Type = AUDIO_EFFECT_lowpass;
+  Result.CutoffHz = CutoffHz;
+  return(Result);
+}
+
+internal audio_effect_params AudioHighPass(f32 CutoffHz)
+{
+  audio_effect_params Result = {};
+  Result.Type = AUDIO_EFFECT_highpass;
+  Result.CutoffHz = CutoffHz;
+  return(Result);
+}
+
+internal audio_effect_params AudioCompressor(f32 Threshold, f32 Ratio, f32 AttackSeconds, f32 ReleaseSeconds)
+{
+  audio_effect_params Result = {};
+  Result.Type = AUDIO_EFFECT_compressor;
+  Result.Threshold = Threshold;
+  Result.Ratio = Ratio;
+  Result.AttackSeconds = AttackSeconds;
+  Result.ReleaseSeconds = ReleaseSeconds;
+  Result.MakeupGain = 1.0f;
+  return(Result);
+}
+
+// A compressor with an infinite ratio and instant attack. Thanks to the
+// look-ahead nothing it outputs is ever above the ceiling.
+internal audio_effect_params AudioLimiter(f32 Ceiling, f32 ReleaseSeconds)
+{
+  audio_effect_params Result = AudioCompressor(Ceiling, 0.0f, 0.0f, ReleaseSeconds);
+  return(Result);
+}
+
+internal audio_effect_params AudioReverb(f32 RoomSize, f32 Damping, f32 Wet)
+{
+  audio_effect_params Result = {};
+  Result.Type = AUDIO_EFFECT_reverb;
+  Result.RoomSize = RoomSize;
+  Result.Damping = Damping;
+  Result.Wet = Wet;
+  return(Result);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// kernels
+
+// Multiplies FrameCount interleaved stereo frames by a gain that ramps
+// linearly by dGain per frame.
+internal void AudioApplyGain(f32 *Samples, u32 FrameCount, f32 Gain, f32 dGain)
+{
+  u32 Frame = 0;
+
+#if defined(__SSE2__)
+  {
+    // NOTE: 2 interleaved stereo frames per vector
+    __m128 G = _mm_setr_ps(Gain, Gain, Gain + dGain, Gain + dGain);
+    __m128 Step = _mm_set1_ps(2*dGain);
+    for (; Frame + 2 <= FrameCount; Frame += 2)
+    {
+      _mm_storeu_ps(Samples + 2*Frame, _mm_mul_ps(_mm_loadu_ps(Samples + 2*Frame), G));
+      G = _mm_add_ps(G, Step);
+    }
+  }
+#endif
+
+  for (; Frame < FrameCount; ++Frame)
+  {
+    f32 G = Gain + Frame*dGain;
+    Samples[2*Frame + 0] *= G;
+    Samples[2*Frame + 1] *= G;
+  }
+}
+
+// Returns the largest absolute value of SampleCount samples.
+internal f32 AudioPeak(f32 *Samples, u32 SampleCount)
+{
+  u32 Sample = 0;
+  f32 Result = 0.0f;
+
+#if defined(__SSE2__)
+  {
+    __m128 AbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 Peak = _mm_setzero_ps();
+    for (; Sample + 4 <= SampleCount; Sample += 4)
+    {
+      Peak = _mm_max_ps(Peak, _mm_and_ps(_mm_loadu_ps(Samples + Sample), AbsMask));
+    }
+    Peak = _mm_max_ps(Peak, _mm_movehl_ps(Peak, Peak));
+    Peak = _mm_max_ps(Peak, _mm_shuffle_ps(Peak, Peak, _MM_SHUFFLE(1, 1, 1, 1)));
+    Result = _mm_cvtss_f32(Peak);
+  }
+#endif
+
+  for (; Sample < SampleCount; ++Sample)
+  {
+    Result = Max(Result, fabsf(Samples[Sample]));
+  }
+
+  return(Result);
+}
+
+// One-pole low-pass, or high-pass by subtracting the low-pass from the input.
+//
+// NOTE: The filter is recursive, so the vector path unrolls the recurrence to
+// work out two frames at once:
+//   y1 = k*y0 + a*x1
+//   y2 = k*k*y0 + k*a*x1 + a*x2
+// where k = 1 - a.
+internal void AudioOnePoleProcess(audio_effect *Effect, f32 *Samples, u32 FrameCount, b32 HighPass)
+{
+  f32 A = Effect->FilterCoefficient;
+  f32 K = 1.0f - A;
+  f32 StateL = Effect->FilterState[0];
+  f32 StateR = Effect->FilterState[1];
+  u32 Frame = 0;
+
+#if defined(__SSE2__)
+  {
+    __m128 VA = _mm_set1_ps(A);
+    __m128 VK = _mm_set1_ps(K);
+    __m128 Decay = _mm_setr_ps(K, K, K*K, K*K);
+    __m128 Y0 = _mm_setr_ps(StateL, StateR, StateL, StateR);
+    for (; Frame + 2 <= FrameCount; Frame += 2)
+    {
+      __m128 X = _mm_loadu_ps(Samples + 2*Frame);
+      __m128 AX = _mm_mul_ps(VA, X);
+      __m128 Carry = _mm_mul_ps(VK, _mm_movelh_ps(_mm_setzero_ps(), AX));
+      __m128 Y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Decay, Y0), AX), Carry);
+      _mm_storeu_ps(Samples + 2*Frame, HighPass ? _mm_sub_ps(X, Y) : Y);
+      Y0 = _mm_movehl_ps(Y, Y);
+    }
+
+    f32 State[4];
+    _mm_storeu_ps(State, Y0);
+    StateL = State[0];
+    StateR = State[1];
+  }
+#endif
+
+  for (; Frame < FrameCount; ++Frame)
+  {
+    f32 *X = Samples + 2*Frame;
+    StateL = K*StateL + A*X[0];
+    StateR = K*StateR + A*X[1];
+    X[0] = HighPass ? X[0] - StateL : StateL;
+    X[1] = HighPass ? X[1] - StateR : StateR;
+  }
+
+  Effect->FilterState[0] = StateL;
+  Effect->FilterState[1] = StateR;
+}
+
+// Gain that brings a peak down onto the compressor's curve.
+internal f32 AudioCompressorGain(audio_effect *Effect, f32 Peak)
+{
+  f32 Result = 1.0f;
+  f32 Threshold = Effect->Params.Threshold;
+  if (Peak > Threshold)
+  {
+    Result = (Effect->CompressorSlope == 1.0f) ? Threshold / Peak : powf(Peak / Threshold, -Effect->CompressorSlope);
+  }
+  return(Result);
+}
+
+// Works through the block a look-ahead chunk at a time. Each chunk leaves
+// the effect delayed by the look-ahead, and its gain ramps from the previous
+// chunk's to one low enough for every frame in the delay and the chunk.
+// Both ends of the ramp then cover the frames being output, so with an
+// instant attack no frame ever exceeds the threshold.
+internal void AudioCompressorProcess(audio_effect *Effect, f32 *Samples, u32 FrameCount)
+{
+  u32 Lookahead = AUDIO_COMPRESSOR_LOOKAHEAD_FRAMES;
+  f32 Window[AUDIO_COMPRESSOR_LOOKAHEAD_FRAMES * 2 * 2];
+  f32 Makeup = Effect->Params.MakeupGain;
+
+  for (u32 Frame = 0; Frame < FrameCount; Frame += Lookahead)
+  {
+    u32 ChunkFrames = Min(Lookahead, FrameCount - Frame);
+    f32 *Chunk = Samples + 2*Frame;
+
+    MemoryCopy(Window, Effect->CompressorDelay, Lookahead * 2 * sizeof(f32));
+    MemoryCopy(Window + 2*Lookahead, Chunk, ChunkFrames * 2 * sizeof(f32));
+
+    f32 Needed = AudioCompressorGain(Effect, AudioPeak(Window, 2*(Lookahead + ChunkFrames)));
+    f32 Gain = Effect->CompressorGain;
+    f32 Coefficient = (Needed < Gain) ? Effect->CompressorAttack : Effect->CompressorRelease;
+    f32 NextGain = Gain + Coefficient * (Needed - Gain);
+
+    AudioApplyGain(Window, ChunkFrames, Makeup * Gain, Makeup * (NextGain - Gain) / (f32)ChunkFrames);
+    MemoryCopy(Chunk, Window, ChunkFrames * 2 * sizeof(f32));
+    MemoryCopy(Effect->CompressorDelay, Window + 2*ChunkFrames, Lookahead * 2 * sizeof(f32));
+
+    Effect->CompressorGain = NextGain;
+  }
+}
+
+// Feeds the mono sum of the input through 4 damped delay lines, mixed back
+// into each other through a Hadamard matrix, and adds the lines' outputs to
+// the left and right channels.
+internal void AudioReverbProcess(audio_effect *Effect, f32 *Samples, u32 FrameCount)
+{
+  f32 *Lines = Effect->ReverbLines;
+  f32 RoomSize = Effect->Params.RoomSize;
+  f32 InputGain = 1.0f - RoomSize;
+  f32 Lowpass = 1.0f - Effect->Params.Damping;
+  f32 Wet = 0.5f * Effect->Params.Wet;
+  u32 *Cursor = Effect->ReverbCursor;
+  u32 *Length = Effect->ReverbLength;
+
+#if defined(__SSE2__)
+  // NOTE: One delay line per lane
+  __m128 Damped = _mm_loadu_ps(Effect->ReverbDamping);
+  __m128 VLowpass = _mm_set1_ps(Lowpass);
+  __m128 Feedback = _mm_set1_ps(0.5f * RoomSize);
+  __m128 SignsA = _mm_setr_ps(1.0f, -1.0f, 1.0f, -1.0f);
+  __m128 SignsB = _mm_setr_ps(1.0f, 1.0f, -1.0f, -1.0f);
+#endif
+
+  foreach (Frame, FrameCount)
+  {
+    f32 *X = Samples + 2*Frame;
+    f32 In = InputGain * 0.5f * (X[0] + X[1]);
+    f32 Out[AUDIO_REVERB_LINES];
+    f32 Next[AUDIO_REVERB_LINES];
+
+    foreach (Line, AUDIO_REVERB_LINES)
+    {
+      Out[Line] = Lines[Line*AUDIO_REVERB_MAX_DELAY_FRAMES + Cursor[Line]];
+    }
+
+#if defined(__SSE2__)
+    {
+      __m128 O = _mm_loadu_ps(Out);
+      Damped = _mm_add_ps(Damped, _mm_mul_ps(VLowpass, _mm_sub_ps(O, Damped)));
+
+      // Hadamard butterflies, scaled by 1/2 to keep the matrix orthonormal
+      __m128 P = _mm_add_ps(_mm_shuffle_ps(Damped, Damped, _MM_SHUFFLE(2, 2, 0, 0)),
+                            _mm_mul_ps(SignsA, _mm_shuffle_ps(Damped, Damped, _MM_SHUFFLE(3, 3, 1, 1))));
+      __m128 Q = _mm_add_ps(_mm_shuffle_ps(P, P, _MM_SHUFFLE(1, 0, 1, 0)),
+                            _mm_mul_ps(SignsB, _mm_shuffle_ps(P, P, _MM_SHUFFLE(3, 2, 3, 2))));
+      _mm_storeu_ps(Next, _mm_add_ps(_mm_mul_ps(Feedback, Q), _mm_set1_ps(In)));
+    }
+#else
+    {
+      f32 *Damped = Effect->ReverbDamping;
+      foreach (Line, AUDIO_REVERB_LINES)
+      {
+        Damped[Line] += Lowpass * (Out[Line] - Damped[Line]);
+      }
+
+      f32 P[4] = { Damped[0] + Damped[1], Damped[0] - Damped[1], Damped[2] + Damped[3], Damped[2] - Damped[3] };
+      f32 Q[4] = { P[0] + P[2], P[1] + P[3], P[0] - P[2], P[1] - P[3] };
+      foreach (Line, AUDIO_REVERB_LINES)
+      {
+        Next[Line] = 0.5f * RoomSize * Q[Line] + In;
+      }
+    }
+#endif
+
+    foreach (Line, AUDIO_REVERB_LINES)
+    {
+      Lines[Line*AUDIO_REVERB_MAX_DELAY_FRAMES + Cursor[Line]] = Next[Line];
+      if (++Cursor[Line] == Length[Line])
+      {
+        Cursor[Line] = 0;
+      }
+    }
+
+    X[0] += Wet * (Out[0] + Out[2]);
+    X[1] += Wet * (Out[1] + Out[3]);
+  }
+
+#if defined(__SSE2__)
+  _mm_storeu_ps(Effect->ReverbDamping, Damped);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// audio_effect
+
+// NOTE: ReverbLines must hold AUDIO_REVERB_LINES * AUDIO_REVERB_MAX_DELAY_FRAMES
+// samples for reverbs and is ignored by everything else.
+internal void AudioEffectInit(audio_effect *Effect, audio_effect_params *Params, f32 *ReverbLines)
+{
+  Assert(Params->Type < AUDIO_EFFECT_MAX);
+  Assert(Params->Type != AUDIO_EFFECT_reverb || ReverbLines != NULL);
+
+  ZeroMemory((u8*)Effect, sizeof(audio_effect));
+  Effect->Params = *Params;
+  Effect->ReverbLines = ReverbLines;
+}
+
+// Works out the effect's coefficients for the device's sample rate and clears
+// its state.
+internal void AudioEffectPrepare(audio_effect *Effect, u32 SamplesPerSecond)
+{
+  audio_effect_params *Params = &Effect->Params;
+  f32 Rate = (f32)SamplesPerSecond;
+  Effect->SamplesPerSecond = SamplesPerSecond;
+
+  switch (Params->Type)
+  {
+  case AUDIO_EFFECT_lowpass:
+  case AUDIO_EFFECT_highpass:
+  {
+    Effect->FilterCoefficient = 1.0f - expf(-TAU * Params->CutoffHz / Rate);
+    Effect->FilterState[0] = Effect->FilterState[1] = 0.0f;
+  }
+  break;
+  case AUDIO_EFFECT_compressor:
+  {
+    // NOTE: Attack and release are applied once per look-ahead chunk
+    f32 ChunkSeconds = (f32)AUDIO_COMPRESSOR_LOOKAHEAD_FRAMES / Rate;
+    Effect->CompressorSlope = (Params->Ratio > 0.0f) ? 1.0f - 1.0f / Params->Ratio : 1.0f;
+    Effect->CompressorAttack = (Params->AttackSeconds > 0.0f) ? 1.0f - expf(-ChunkSeconds / Params->AttackSeconds) : 1.0f;
+    Effect->CompressorRelease = (Params->ReleaseSeconds > 0.0f) ? 1.0f - expf(-ChunkSeconds / Params->ReleaseSeconds) : 1.0f;
+    Effect->CompressorGain = 1.0f;
+    ZeroMemory((u8*)Effect->CompressorDelay, sizeof(Effect->CompressorDelay));
+  }
+  break;
+  case AUDIO_EFFECT_reverb:
+  {
+    // NOTE: Mutually prime line lengths tuned at 44.1kHz keep the echoes
+    // from lining up.
+    u32 BaseLength[AUDIO_REVERB_LINES] = { 1116, 1188, 1277, 1356 };
+    foreach (Line, AUDIO_REVERB_LINES)
+    {
+      u32 Length = (u32)(BaseLength[Line] * Rate / 44100.0f);
+      Effect->ReverbLength[Line] = Max(Min(Length, AUDIO_REVERB_MAX_DELAY_FRAMES), 1);
+      Effect->ReverbCursor[Line] = 0;
+      Effect->ReverbDamping[Line] = 0.0f;
+    }
+    ZeroMemory((u8*)Effect->ReverbLines, AUDIO_REVERB_LINES * AUDIO_REVERB_MAX_DELAY_FRAMES * sizeof(f32));
+  }
+  break;
+  default: break;
+  }
+}
+
+internal void AudioEffectProcess(audio_effect *Effect, f32 *Samples, u32 FrameCount, u32 SamplesPerSecond)
+{
+  if (Effect->SamplesPerSecond != SamplesPerSecond)
+  {
+    AudioEffectPrepare(Effect, SamplesPerSecond);
+  }
+
+  switch (Effect->Params.Type)
+  {
+  case AUDIO_EFFECT_lowpass: AudioOnePoleProcess(Effect, Samples, FrameCount, false); break;
+  case AUDIO_EFFECT_highpass: AudioOnePoleProcess(Effect, Samples, FrameCount, true); break;
+  case AUDIO_EFFECT_compressor: AudioCompressorProcess(Effect, Samples, FrameCount); break;
+  case AUDIO_EFFECT_reverb: AudioReverbProcess(Effect, Samples, FrameCount); break;
+  default: break;
+  }
+}
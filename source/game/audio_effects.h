@@ -0,0 +1,81 @@
+#ifndef GAME_AUDIO_EFFECTS_H
+#define GAME_AUDIO_EFFECTS_H
+
+// Compressors delay their input by this many frames so that gain reduction
+// is already in place when a peak arrives. Peaks are also detected over
+// chunks of this many frames.
+#define AUDIO_COMPRESSOR_LOOKAHEAD_FRAMES 16
+
+// Number of delay lines in the reverb's feedback network and the longest any
+// of them can be. Lines are allocated by the game thread from the audio
+// player's arena.
+#define AUDIO_REVERB_LINES 4
+#define AUDIO_REVERB_MAX_DELAY_FRAMES 4096
+
+typedef enum audio_effect_type {
+  AUDIO_EFFECT_none,
+  AUDIO_EFFECT_lowpass,    // one-pole low-pass filter
+  AUDIO_EFFECT_highpass,   // one-pole high-pass filter
+  AUDIO_EFFECT_compressor, // look-ahead peak compressor/limiter
+  AUDIO_EFFECT_reverb,     // 4 line feedback delay network
+  AUDIO_EFFECT_MAX
+} audio_effect_type;
+
+typedef struct audio_effect_params {
+  audio_effect_type Type;
+
+  // Filters
+  f32 CutoffHz;
+
+  // Compressor. Threshold is a linear amplitude, a ratio of 0 limits peaks
+  // to the threshold outright.
+  f32 Threshold;
+  f32 Ratio;
+  f32 AttackSeconds;
+  f32 ReleaseSeconds;
+  f32 MakeupGain;
+
+  // Reverb. Room size is the feedback gain and should be < 1, damping is how
+  // much of the high end is lost on each trip through the network.
+  f32 RoomSize;
+  f32 Damping;
+  f32 Wet;
+} audio_effect_params;
+
+// An effect in a bus's insert chain, processing interleaved stereo f32 frames
+// in place.
+//
+// NOTE: Owned by the audio thread. Coefficients depend on the device's sample
+// rate, so they are worked out on the first block the effect processes.
+typedef struct audio_effect {
+  audio_effect_params Params;
+  u32 SamplesPerSecond;
+
+  // Filters. The state is the last output frame.
+  f32 FilterCoefficient;
+  f32 FilterState[2];
+
+  // Compressor
+  f32 CompressorGain;
+  f32 CompressorSlope;
+  f32 CompressorAttack;
+  f32 CompressorRelease;
+  f32 CompressorDelay[AUDIO_COMPRESSOR_LOOKAHEAD_FRAMES * 2];
+
+  // Reverb
+  f32 *ReverbLines;
+  u32 ReverbLength[AUDIO_REVERB_LINES];
+  u32 ReverbCursor[AUDIO_REVERB_LINES];
+  f32 ReverbDamping[AUDIO_REVERB_LINES];
+} audio_effect;
+
+internal audio_effect_params AudioLowPass(f32 CutoffHz);
+internal audio_effect_params AudioHighPass(f32 CutoffHz);
+internal audio_effect_params AudioCompressor(f32 Threshold, f32 Ratio, f32 AttackSeconds, f32 ReleaseSeconds);
+internal audio_effect_params AudioLimiter(f32 Ceiling, f32 ReleaseSeconds);
+internal audio_effect_params AudioReverb(f32 RoomSize, f32 Damping, f32 Wet);
+
+internal void AudioEffectInit(audio_effect *Effect, audio_effect_params *Params, f32 *ReverbLines);
+internal void AudioEffectProcess(audio_effect *Effect, f32 *Samples, u32 FrameCount, u32 SamplesPerSecond);
+
+#endif // GAME_AUDIO_EFFECTS_H
@@ -1,6 +1,6 @@
 #include "fonts.h"
 
-internal b32 FontManagerInit(font_manager *FontManager, const char *FontDirectory)
+internal b32 FontManagerInit(font_manager *FontManager, const char *FontDirectory, memory_arena *TransientArena)
 {
   b32 Result = true;
   
@@ -11,138 +11,653 @@ internal b32 FontManagerInit(font_manager *FontManager, const char *FontDirector
   }
   
   FontManager->FontDirectory = FontDirectory;
+  FontManager->NumFonts = 0;
+  foreach (I, ArrayCount(FontManager->Rasterizers))
+  {
+    FontManager->Rasterizers[I] = {};
+  }
+
+  // Create the shared glyph atlas
+  {
+    FontManager->AtlasDim = V2(FONT_ATLAS_DIM, FONT_ATLAS_DIM);
+    stbrp_init_target(&FontManager->AtlasPacker, FONT_ATLAS_DIM, FONT_ATLAS_DIM, FontManager->AtlasNodes, ArrayCount(FontManager->AtlasNodes));
+
+    // NOTE: Upload zeroed data so that the padding around each glyph is
+    // empty, texture contents are undefined when created with NULL data.
+    scoped_arena ScopedArena(TransientArena);
+    u8 *EmptyData = ScopedArenaPushArray(&ScopedArena, FONT_ATLAS_DIM * FONT_ATLAS_DIM, u8);
+    
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glGenTextures(1, &FontManager->AtlasTexture);
+    glBindTexture(GL_TEXTURE_2D, FontManager->AtlasTexture);
+    glTexImage2D(
+      GL_TEXTURE_2D,
+      0,
+      GL_RED,
+      FONT_ATLAS_DIM,
+      FONT_ATLAS_DIM,
+      0,
+      GL_RED,
+      GL_UNSIGNED_BYTE,
+      EmptyData
+    );
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
   
   return(Result);
 }
 
 internal void FontManagerDestroy(font_manager *FontManager)
 {
+  foreach (I, ArrayCount(FontManager->Rasterizers))
+  {
+    font_rasterizer *Rasterizer = FontManager->Rasterizers + I;
+    if (Rasterizer->Face)
+    {
+      FT_Done_Face(Rasterizer->Face);
+    }
+    if (Rasterizer->FreeType)
+    {
+      FT_Done_FreeType(Rasterizer->FreeType);
+    }
+    *Rasterizer = {};
+  }
+  
   FT_Done_FreeType(FontManager->FreeType);
+  glDeleteTextures(1, &FontManager->AtlasTexture);
+  FontManager->NumFonts = 0;
 }
 
-internal b32 FontManagerLoadFont(
+///////////////////////////////////////////////////////////////////////////////
+// text_layout_cache
+
+internal void TextLayoutCacheInit(text_layout_cache *Cache, memory_arena *Arena)
+{
+  Cache->CurrentFrame = 0;
+  Cache->Generation = 0;
+  Cache->CompactedEarly = false;
+  Cache->Arena[0] = ArenaPushChild(Arena, TEXT_LAYOUT_CACHE_ARENA_SIZE / 2);
+  Cache->Arena[1] = ArenaPushChild(Arena, TEXT_LAYOUT_CACHE_ARENA_SIZE / 2);
+  Cache->NumLayouts = 0;
+  Cache->Table = ArenaPushArray(&Cache->Arena[0], TEXT_LAYOUT_CACHE_TABLE_SIZE, text_layout);
+  Cache->Hits = 0;
+  Cache->Misses = 0;
+  Cache->LastFrameHits = 0;
+  Cache->LastFrameMisses = 0;
+}
+
+internal u32 TextLayoutHash(font *Font, const char *Text, u32 TextLength)
+{
+  u32 Result = FNV1A_HASH_INITIAL;
+  Hash(&Result, (u8*)Text, TextLength);
+  Hash(&Result, (u8*)&Font->FontSizePixels, sizeof(Font->FontSizePixels));
+
+  // NOTE: Zero is reserved for empty slots
+  if (Result == 0)
+  {
+    Result = 1;
+  }
+
+  return(Result);
+}
+
+// Returns the slot for the given key, either the one holding it or the empty
+// slot it should be inserted into.
+internal text_layout* TextLayoutCacheFindSlot(text_layout *Table, u32 LayoutHash, const char *Text, u32 TextLength)
+{
+  u32 Index = LayoutHash & (TEXT_LAYOUT_CACHE_TABLE_SIZE - 1);
+  text_layout *Result = Table + Index;
+  while (Result->Hash != 0)
+  {
+    if (Result->Hash == LayoutHash &&
+        Result->TextLength == TextLength &&
+        memcmp(Result->Text, Text, TextLength) == 0)
+    {
+      break;
+    }
+    
+    Index = (Index + 1) & (TEXT_LAYOUT_CACHE_TABLE_SIZE - 1);
+    Result = Table + Index;
+  }
+
+  return(Result);
+}
+
+internal b32 TextLayoutCacheCanFit(memory_arena *Arena, u32 TextLength, u32 NumGlyphs)
+{
+  // NOTE: Leave room for padding to align the glyphs after the text
+  umm SizeBytes = TextLength + alignof(text_layout_glyph) - 1 + NumGlyphs * sizeof(text_layout_glyph);
+  return(Arena->Used + SizeBytes <= Arena->Size);
+}
+
+// Copies the layouts that were used within the expiry window into the other
+// generation arena and clears the current one.
+internal void TextLayoutCacheCompact(text_layout_cache *Cache)
+{
+  memory_arena *From = Cache->Arena + Cache->Generation;
+  memory_arena *To = Cache->Arena + (Cache->Generation ^ 1);
+  
+  text_layout *Table = ArenaPushArray(To, TEXT_LAYOUT_CACHE_TABLE_SIZE, text_layout);
+  u32 NumLayouts = 0;
+  
+  foreach (I, TEXT_LAYOUT_CACHE_TABLE_SIZE)
+  {
+    text_layout *Layout = Cache->Table + I;
+    if (Layout->Hash == 0 ||
+        Layout->LastUsedFrame + TEXT_LAYOUT_CACHE_EXPIRY_FRAMES < Cache->CurrentFrame)
+    {
+      continue;
+    }
+
+    text_layout *Slot = TextLayoutCacheFindSlot(Table, Layout->Hash, Layout->Text, Layout->TextLength);
+    *Slot = *Layout;
+    Slot->Text = ArenaPushArray(To, Layout->TextLength, char);
+    MemoryCopy(Slot->Text, Layout->Text, Layout->TextLength);
+    Slot->Glyphs = ArenaPushArray(To, Layout->NumGlyphs, text_layout_glyph);
+    MemoryCopy(Slot->Glyphs, Layout->Glyphs, Layout->NumGlyphs * sizeof(text_layout_glyph));
+    ++NumLayouts;
+  }
+
+  ArenaClear(From);
+  
+  Cache->Table = Table;
+  Cache->NumLayouts = NumLayouts;
+  Cache->Generation ^= 1;
+}
+
+internal void TextLayoutCacheBeginFrame(text_layout_cache *Cache)
+{
+  ++Cache->CurrentFrame;
+  
+  // NOTE: Also compact early if the current generation is mostly full, as
+  // misses past that point would otherwise fall back to uncached layout until
+  // the next scheduled compaction. Only do this once per expiry window: when
+  // everything in the arena is still in use, compacting frees nothing and
+  // would otherwise copy the whole cache every frame.
+  memory_arena *Arena = Cache->Arena + Cache->Generation;
+  b32 Scheduled = (Cache->CurrentFrame % TEXT_LAYOUT_CACHE_EXPIRY_FRAMES) == 0;
+  b32 MostlyFull = Arena->Used > (Arena->Size / 4) * 3;
+  if (Scheduled || (MostlyFull && !Cache->CompactedEarly))
+  {
+    TextLayoutCacheCompact(Cache);
+    Cache->CompactedEarly = !Scheduled;
+  }
+
+  Cache->LastFrameHits = Cache->Hits;
+  Cache->LastFrameMisses = Cache->Misses;
+  Cache->Hits = 0;
+  Cache->Misses = 0;
+}
+
+// Lays out the given text relative to the origin. Matches the placement done
+// by RendererPushText glyph for glyph, including kerning and tab expansion.
+internal void FontLayoutText(font *Font, const char *Text, text_layout *Layout)
+{
+  f32 PenX = 0.0f;
+  f32 Width = 0.0f;
+  v2 BoundsMin = V2(0);
+  v2 BoundsMax = V2(0);
+  u32 PreviousGlyph = 0;
+
+  foreach (I, Layout->NumGlyphs)
+  {
+    u8 Ch = (u8)Text[I];
+    font_glyph_cache *Cached = Font->GlyphCache + Ch;
+    
+    f32 XPos = PenX + Cached->Bearing.X;
+    f32 YPos = -(Cached->Dim.Y - Cached->Bearing.Y);
+    f32 GlyphWidth = Cached->Dim.Width;
+    f32 GlyphHeight = Cached->Dim.Height;
+    f32 Advance = (Cached->Advance >> 6);
+    Width += (Ch == '\t') ? Advance * 4 : Advance;
+    
+    if (Ch == '\t') {
+      Cached = Font->GlyphCache + (u32)' ';
+      GlyphWidth = Cached->Dim.Width * 4.0f;
+      GlyphHeight = Cached->Dim.Height;
+    }
+
+    u32 GlyphIndex = FT_Get_Char_Index(Font->Face, Ch);
+    if (PreviousGlyph)
+    {
+      FT_Vector Delta;
+      FT_Get_Kerning(Font->Face, PreviousGlyph, GlyphIndex, FT_KERNING_DEFAULT, &Delta);
+      XPos += (Delta.x >> 6);
+    }
+    
+    text_layout_glyph *Glyph = Layout->Glyphs + I;
+    Glyph->Dest = V4(XPos, YPos, GlyphWidth, GlyphHeight);
+    Glyph->Source = V4(Cached->Source.X, Cached->Source.Y, Cached->Dim.Width, Cached->Dim.Height);
+    
+    if (I == 0)
+    {
+      BoundsMin = V2(XPos, YPos);
+      BoundsMax = BoundsMin;
+    }
+    BoundsMin.X = Min(BoundsMin.X, XPos);
+    BoundsMin.Y = Min(BoundsMin.Y, YPos);
+    BoundsMax.X = Max(BoundsMax.X, XPos + GlyphWidth);
+    BoundsMax.Y = Max(BoundsMax.Y, YPos + GlyphHeight);
+    
+    if (Ch == '\t') {
+      PenX += (Cached->Advance >> 6) * 4;
+    } else {
+      PenX += (Cached->Advance >> 6);
+    }
+
+    PreviousGlyph = GlyphIndex;
+  }
+
+  Layout->Width = Width;
+  Layout->Bounds = V4(BoundsMin, BoundsMax - BoundsMin);
+}
+
+internal text_layout* FontTextLayout(font *Font, const char *Text)
+{
+  text_layout_cache *Cache = &Font->LayoutCache;
+  if (Cache->Table == NULL)
+  {
+    return(NULL);
+  }
+  
+  u32 TextLength = strlen(Text);
+  u32 LayoutHash = TextLayoutHash(Font, Text, TextLength);
+  text_layout *Result = TextLayoutCacheFindSlot(Cache->Table, LayoutHash, Text, TextLength);
+
+  if (Result->Hash != 0)
+  {
+    ++Cache->Hits;
+    Result->LastUsedFrame = Cache->CurrentFrame;
+    return(Result);
+  }
+
+  ++Cache->Misses;
+  
+  // NOTE: Keep the table at most 3/4 full so that probe sequences stay short.
+  memory_arena *Arena = Cache->Arena + Cache->Generation;
+  if (Cache->NumLayouts >= (TEXT_LAYOUT_CACHE_TABLE_SIZE / 4) * 3 ||
+      !TextLayoutCacheCanFit(Arena, TextLength, TextLength))
+  {
+    return(NULL);
+  }
+
+  Result->Hash = LayoutHash;
+  Result->LastUsedFrame = Cache->CurrentFrame;
+  Result->TextLength = TextLength;
+  Result->Text = ArenaPushArray(Arena, TextLength, char);
+  MemoryCopy(Result->Text, Text, TextLength);
+  Result->NumGlyphs = TextLength;
+  Result->Glyphs = ArenaPushArray(Arena, TextLength, text_layout_glyph);
+  FontLayoutText(Font, Text, Result);
+  ++Cache->NumLayouts;
+
+  return(Result);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// font_manager
+
+typedef struct font_raster_glyph {
+  u8 *Bitmap; // NOTE: Tightly packed rows, pitch == Width
+  u32 Width;
+  u32 Rows;
+  v2 Bearing;
+  u32 Advance;
+  b32 Loaded;
+} font_raster_glyph;
+
+// Rasterizes a range of glyphs from one font.
+typedef struct font_raster_work {
+  font_manager *FontManager;
+  char FontPath[256];
+  u32 FontSizePixels;
+  u32 FirstGlyph;
+  u32 OnePastLastGlyph;
+  memory_arena Arena;
+  font_raster_glyph *Glyphs;
+  // Set when the font couldn't be opened, leaving the range unrasterized
+  b32 Failed;
+} font_raster_work;
+
+#define FONT_RASTER_GLYPHS_PER_WORK 32
+
+// Claims a rasterizer no other job is using. NULL if all of them are taken.
+internal font_rasterizer* FontRasterizerAcquire(font_manager *FontManager)
+{
+  font_rasterizer *Result = NULL;
+  foreach (I, ArrayCount(FontManager->Rasterizers))
+  {
+    font_rasterizer *Rasterizer = FontManager->Rasterizers + I;
+    if (AtomicCompareAndExchangeU32(&Rasterizer->InUse, 1, 0) == 0)
+    {
+      Result = Rasterizer;
+      break;
+    }
+  }
+  return(Result);
+}
+
+// Opens the face for the given font on the rasterizer, reusing the one already
+// open if it is the same font. Returns false on failure.
+internal b32 FontRasterizerOpenFace(font_rasterizer *Rasterizer, const char *FontPath)
+{
+  b32 Result = true;
+  
+  if (Rasterizer->FreeType == NULL && FT_Init_FreeType(&Rasterizer->FreeType))
+  {
+    fprintf(stderr, "error: unable to initialize freetype.\n");
+    Rasterizer->FreeType = NULL;
+    Result = false;
+  }
+  else if (Rasterizer->Face == NULL || strncmp(Rasterizer->FacePath, FontPath, ArrayCount(Rasterizer->FacePath)) != 0)
+  {
+    if (Rasterizer->Face)
+    {
+      FT_Done_Face(Rasterizer->Face);
+      Rasterizer->Face = NULL;
+    }
+    
+    if (FT_New_Face(Rasterizer->FreeType, FontPath, 0, &Rasterizer->Face))
+    {
+      fprintf(stderr, "error: unable to load font face '%s'\n", FontPath);
+      Rasterizer->Face = NULL;
+      Result = false;
+    }
+    else
+    {
+      strncpy(Rasterizer->FacePath, FontPath, ArrayCount(Rasterizer->FacePath));
+    }
+  }
+
+  return(Result);
+}
+
+void FontRasterCallback(work_queue *Queue, void *Data)
+{
+  font_raster_work *Work = (font_raster_work*)Data;
+
+  // NOTE: Only as many jobs run at once as there are threads taking work, so
+  // running out of rasterizers means the platform has more of those than
+  // FONT_MANAGER_MAX_RASTERIZERS allows for.
+  font_rasterizer *Rasterizer = FontRasterizerAcquire(Work->FontManager);
+  if (Rasterizer == NULL)
+  {
+    fprintf(stderr, "error: no free font rasterizer for '%s'\n", Work->FontPath);
+    Work->Failed = true;
+    return;
+  }
+  
+  if (!FontRasterizerOpenFace(Rasterizer, Work->FontPath))
+  {
+    AtomicStoreReleaseU32(&Rasterizer->InUse, 0);
+    Work->Failed = true;
+    return;
+  }
+  
+  FT_Face Face = Rasterizer->Face;
+  FT_Set_Pixel_Sizes(Face, 0, Work->FontSizePixels);
+
+  for (u32 I = Work->FirstGlyph; I < Work->OnePastLastGlyph; ++I)
+  {
+    if (FT_Load_Char(Face, (u8)I, FT_LOAD_RENDER))
+    {
+      fprintf(stderr, "error: failed to load glyph %d\n", I);
+      continue;
+    }
+
+    FT_Bitmap *Bitmap = &Face->glyph->bitmap;
+    umm SizeBytes = Bitmap->width * Bitmap->rows;
+    if (Work->Arena.Used + SizeBytes > Work->Arena.Size)
+    {
+      fprintf(stderr, "error: out of space for glyph %d (%dx%d)\n", I, Bitmap->width, Bitmap->rows);
+      continue;
+    }
+    
+    font_raster_glyph *Glyph = Work->Glyphs + I;
+    Glyph->Width = Bitmap->width;
+    Glyph->Rows = Bitmap->rows;
+    Glyph->Bearing = V2(Face->glyph->bitmap_left, Face->glyph->bitmap_top);
+    Glyph->Advance = Face->glyph->advance.x;
+    Glyph->Bitmap = ArenaAlloc(&Work->Arena, SizeBytes);
+    foreach (Y, Bitmap->rows)
+    {
+      MemoryCopy(Glyph->Bitmap + Y * Bitmap->width, Bitmap->buffer + Y * Bitmap->pitch, Bitmap->width);
+    }
+    Glyph->Loaded = true;
+  }
+
+  AtomicStoreReleaseU32(&Rasterizer->InUse, 0);
+}
+
+internal b32 FontManagerLoadFonts(
   font_manager *FontManager,
-  packed_font *Font,
-  const char *FontFile,
-  u32 FontSizePixels,
+  font_load_request *Requests,
+  u32 NumRequests,
+  platform_state *Platform,
   memory_arena *TransientArena
 )
 {
-  local_persist char FontFullPath[256];
-  snprintf(FontFullPath, 256, "%s/%s", FontManager->FontDirectory, FontFile);
+  b32 Result = true;
+  
+  // NOTE: The layout caches live for the lifetime of the fonts so they must be
+  // pushed before the scoped arena used for rasterization below.
+  foreach (I, NumRequests)
+  {
+    font *Font = Requests[I].Font;
+    if (Font->LayoutCache.Table == NULL)
+    {
+      TextLayoutCacheInit(&Font->LayoutCache, TransientArena);
+    }
+  }
 
-  scoped_arena TextureArena(TransientArena);
-  Font->TextureDim = V2(500, 500);
-  u8 *TextureData = ScopedArenaPushArray(&TextureArena, (u32)Font->TextureDim.Width * (u32)Font->TextureDim.Height, u8);
+  scoped_arena ScratchArena(TransientArena);
 
-  b32 Result = true;
-  if (FT_New_Face(FontManager->FreeType, FontFullPath, 0, &Font->Face))
+  // Fan glyph rasterization for all fonts out over the work queue
+  work_counter RasterCounter = {};
+  u32 NumGlyphs = ArrayCount(Requests[0].Font->GlyphCache);
+  u32 NumWorksPerFont = (NumGlyphs + FONT_RASTER_GLYPHS_PER_WORK - 1) / FONT_RASTER_GLYPHS_PER_WORK;
+  font_raster_glyph **Glyphs = ScopedArenaPushArray(&ScratchArena, NumRequests, font_raster_glyph*);
+  font_raster_work **Works = ScopedArenaPushArray(&ScratchArena, NumRequests, font_raster_work*);
+  foreach (RequestIndex, NumRequests)
   {
-    fprintf(stderr, "error: unable to load font face '%s'\n", FontFullPath);
-    Result = false;
+    font_load_request *Request = Requests + RequestIndex;
+    Glyphs[RequestIndex] = ScopedArenaPushArray(&ScratchArena, NumGlyphs, font_raster_glyph);
+    Works[RequestIndex] = ScopedArenaPushArray(&ScratchArena, NumWorksPerFont, font_raster_work);
+    
+    // NOTE: Glyph bitmaps fit comfortably within a square twice the pixel
+    // size, anything larger is reported as an error by the worker.
+    umm BytesPerGlyph = 4 * Request->FontSizePixels * Request->FontSizePixels;
+    foreach (WorkIndex, NumWorksPerFont)
+    {
+      u32 FirstGlyph = WorkIndex * FONT_RASTER_GLYPHS_PER_WORK;
+      font_raster_work *Work = Works[RequestIndex] + WorkIndex;
+      Work->FontManager = FontManager;
+      snprintf(Work->FontPath, ArrayCount(Work->FontPath), "%s/%s", FontManager->FontDirectory, Request->FontFile);
+      Work->FontSizePixels = Request->FontSizePixels;
+      Work->FirstGlyph = FirstGlyph;
+      Work->OnePastLastGlyph = Min(FirstGlyph + FONT_RASTER_GLYPHS_PER_WORK, NumGlyphs);
+      Work->Glyphs = Glyphs[RequestIndex];
+
+      // NOTE: Glyph bitmaps are copied over in full, so there's no need to
+      // zero the megabytes they're copied into.
+      umm ArenaSize = BytesPerGlyph * (Work->OnePastLastGlyph - Work->FirstGlyph);
+      Work->Arena = ArenaInit(ScopedArenaPushArrayNoZero(&ScratchArena, ArenaSize, u8), ArenaSize);
+      Work->Arena.ZeroPolicy = ARENA_ZERO_never;
+      
+      void *Data = (void*)Work;
+      Platform->Interface.WorkQueueAddEntries(Platform->Input.WorkQueue, WORK_QUEUE_PRIORITY_high, FontRasterCallback, &Data, 1, &RasterCounter);
+    }
   }
-  else
+
+  // NOTE: Only wait on the glyphs, not on any texture or sound loads that
+  // happen to be in flight.
+  Platform->Interface.WorkQueueWaitForCounter(Platform->Input.WorkQueue, &RasterCounter);
+
+  // Pack and upload each font into the shared atlas
+  foreach (RequestIndex, NumRequests)
   {
-    Font->FontSizePixels = FontSizePixels;
-    FT_Set_Pixel_Sizes(Font->Face, 0, FontSizePixels);
+    font_load_request *Request = Requests + RequestIndex;
+    font *Font = Request->Font;
+    font_raster_glyph *FontGlyphs = Glyphs[RequestIndex];
 
-    // Attempt to pack all rects into our texture
-    stbrp_context Packer;
-    u32 NodeCount = ArrayCount(Font->GlyphCache);
-    stbrp_node *Nodes = ScopedArenaPushArray(&TextureArena, sizeof(stbrp_node) * NodeCount, stbrp_node);
-    stbrp_init_target(&Packer, 500, 500, Nodes, NodeCount);
+    b32 RasterFailed = false;
+    foreach (WorkIndex, NumWorksPerFont)
+    {
+      RasterFailed |= Works[RequestIndex][WorkIndex].Failed;
+    }
+    if (RasterFailed)
+    {
+      Result = false;
+      continue;
+    }
 
-    stbrp_rect *Rects = ScopedArenaPushArray(&TextureArena, sizeof(stbrp_rect) * NodeCount, stbrp_rect);
+    char FontFullPath[256];
+    snprintf(FontFullPath, ArrayCount(FontFullPath), "%s/%s", FontManager->FontDirectory, Request->FontFile);
+
+    // NOTE: The font keeps a face of its own for metrics and kerning, this
+    // doesn't rasterize anything.
+    if (FT_New_Face(FontManager->FreeType, FontFullPath, 0, &Font->Face))
+    {
+      fprintf(stderr, "error: unable to load font face '%s'\n", FontFullPath);
+      Result = false;
+      continue;
+    }
+    
+    Font->FontFile = Request->FontFile;
+    Font->FontSizePixels = Request->FontSizePixels;
+    Font->Texture = FontManager->AtlasTexture;
+    Font->TextureDim = FontManager->AtlasDim;
+    FT_Set_Pixel_Sizes(Font->Face, 0, Request->FontSizePixels);
+
+    stbrp_rect *Rects = ScopedArenaPushArray(&ScratchArena, NumGlyphs, stbrp_rect);
 
     // NOTE: We add some padding around each rectangle so that bilinear
     // sampling from the final texture doesn't produce artifacts at the edges
     // of the characters.
     i32 PaddingPixels = 1;
-    foreach(I, NodeCount)
+    foreach(I, NumGlyphs)
     {
-      if (FT_Load_Char(Font->Face, (u8)I, FT_LOAD_RENDER))
-      {
-        fprintf(stderr, "error: failed to load glyph %d\n", I);
-        continue;
-      }
-
       stbrp_rect *Rect = Rects + I;
       Rect->id = I;
-      Rect->w = Font->Face->glyph->bitmap.width + PaddingPixels;
-      Rect->h = Font->Face->glyph->bitmap.rows + PaddingPixels;
+      Rect->w = FontGlyphs[I].Width + PaddingPixels;
+      Rect->h = FontGlyphs[I].Rows + PaddingPixels;
     }
 
-    stbrp_pack_rects(&Packer, Rects, NodeCount);
+    // NOTE: Packing continues from wherever the previously loaded fonts left
+    // off in the shared atlas.
+    stbrp_pack_rects(&FontManager->AtlasPacker, Rects, NumGlyphs);
 
     // Iterate over packed rects and verify that all of them were packed
-    foreach (I, NodeCount)
+    b32 AllPacked = true;
+    foreach (I, NumGlyphs)
     {
       if (!Rects[I].was_packed)
       {
         fprintf(stderr, "error: failed to pack rect %d (%dx%d)\n", Rects[I].id, Rects[I].w, Rects[I].h);
-        Result = false;
+        AllPacked = false;
       }
     }
 
-    // If all glyphs were successfully packed, then render them into the texture data
-    if (Result)
+    // If all glyphs were successfully packed, then upload them into the atlas
+    if (!AllPacked)
     {
-      foreach (I, NodeCount)
+      Result = false;
+      continue;
+    }
+    
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, FontManager->AtlasTexture);
+      
+    foreach (I, NumGlyphs)
+    {
+      stbrp_rect *Rect = Rects + I;
+      font_raster_glyph *Raster = FontGlyphs + Rect->id;
+
+      font_glyph_cache *Glyph = Font->GlyphCache + Rect->id;
+      Glyph->Char = (u8)Rect->id;
+      Glyph->Dim = V2(Raster->Width, Raster->Rows);
+      Glyph->Source = V2(Rect->x + PaddingPixels, Rect->y + PaddingPixels);
+      Glyph->Bearing = Raster->Bearing;
+      Glyph->Advance = Raster->Advance;
+      Glyph->Loaded = Raster->Loaded;
+
+      if (Raster->Loaded && Raster->Width > 0 && Raster->Rows > 0)
       {
-        stbrp_rect *Rect = Rects + I;
-        FT_Load_Char(Font->Face, (u8)Rect->id, FT_LOAD_RENDER);
-
-        font_glyph_cache *Glyph = Font->GlyphCache + Rect->id;
-        Glyph->Char = (u8)Rect->id;
-        Glyph->Dim = V2(Font->Face->glyph->bitmap.width, Font->Face->glyph->bitmap.rows);
-        Glyph->Source = V2(Rect->x + PaddingPixels, Rect->y + PaddingPixels);
-        Glyph->Bearing = V2(Font->Face->glyph->bitmap_left, Font->Face->glyph->bitmap_top);
-        Glyph->Advance = Font->Face->glyph->advance.x;
-        Glyph->Loaded = true;
-
-        for (u32 Y = 0; Y < Glyph->Dim.Height; ++Y)
-        {
-          u8* Row = TextureData + (Rect->x + PaddingPixels + 500 * (Y + PaddingPixels + Rect->y));
-          for (u32 X = 0; X < Glyph->Dim.Width; ++X)
-          {
-            *Row++ = Font->Face->glyph->bitmap.buffer[X + ((u32)Font->Face->glyph->bitmap.pitch * Y)];
-          }
-        }
+        glTexSubImage2D(
+          GL_TEXTURE_2D,
+          0,
+          Glyph->Source.X,
+          Glyph->Source.Y,
+          Raster->Width,
+          Raster->Rows,
+          GL_RED,
+          GL_UNSIGNED_BYTE,
+          Raster->Bitmap
+        );
       }
-
-      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-      glGenTextures(1, &Font->Texture);
-      glBindTexture(GL_TEXTURE_2D, Font->Texture);
-      glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        GL_RED,
-        500,
-        500,
-        0,
-        GL_RED,
-        GL_UNSIGNED_BYTE,
-        TextureData
-      );
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      glBindTexture(GL_TEXTURE_2D, 0);
     }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    Assert(FontManager->NumFonts < FONT_MANAGER_MAX_FONTS);
+    FontManager->Fonts[FontManager->NumFonts++] = Font;
   }
 
   return(Result);
 }
 
+internal b32 FontManagerLoadFont(
+  font_manager *FontManager,
+  font *Font,
+  const char *FontFile,
+  u32 FontSizePixels,
+  platform_state *Platform,
+  memory_arena *TransientArena
+)
+{
+  font_load_request Request = {};
+  Request.Font = Font;
+  Request.FontFile = FontFile;
+  Request.FontSizePixels = FontSizePixels;
+  return FontManagerLoadFonts(FontManager, &Request, 1, Platform, TransientArena);
+}
+
 internal void FontManagerDestroyFont(font_manager *FontManager, font *Font)
 {
+  // NOTE: The font's space in the shared atlas is not reclaimed, the atlas is
+  // only released with the font manager.
   FT_Done_Face(Font->Face);
-  glDeleteTextures(1, &Font->Texture);
+
+  foreach (I, FontManager->NumFonts)
+  {
+    if (FontManager->Fonts[I] == Font)
+    {
+      FontManager->Fonts[I] = FontManager->Fonts[--FontManager->NumFonts];
+      break;
+    }
+  }
+}
+
+internal void FontManagerBeginFrame(font_manager *FontManager)
+{
+  foreach (I, FontManager->NumFonts)
+  {
+    TextLayoutCacheBeginFrame(&FontManager->Fonts[I]->LayoutCache);
+  }
 }
 
 internal f32 FontTextWidthPixels(font *Font, const char *Text)
 {
+  text_layout *Layout = FontTextLayout(Font, Text);
+  if (Layout)
+  {
+    return(Layout->Width);
+  }
+  
   char *NextCh = (char*)Text;
   f32 TotalWidth = 0;
   while (*NextCh)
@@ -1,6 +1,8 @@
 #ifndef GAME_FONTS_H
 #define GAME_FONTS_H
 
+typedef struct platform_state platform_state;
+
 typedef struct font_glyph_cache {
   u8 Char;
   v2 Dim;
@@ -10,30 +12,141 @@ typedef struct font_glyph_cache {
   b32 Loaded;
 } font_glyph_cache;
 
+///////////////////////////////////////////////////////////////////////////////
+// text_layout_cache
+
+#define TEXT_LAYOUT_CACHE_TABLE_SIZE 1024 // NOTE: Must be a power of 2
+#define TEXT_LAYOUT_CACHE_ARENA_SIZE Megabytes(2)
+// Number of frames a layout may go unused before it is evicted. Eviction only
+// happens when the cache compacts, which is also done every this many frames.
+#define TEXT_LAYOUT_CACHE_EXPIRY_FRAMES 60
+
+// Glyph placement relative to the text origin. Positioned and colored by the
+// renderer when the layout is pushed.
+typedef struct text_layout_glyph {
+  v4 Dest;
+  v4 Source;
+} text_layout_glyph;
+
+typedef struct text_layout {
+  // NOTE: A Hash of 0 marks an empty slot in the cache table.
+  u32 Hash;
+  u64 LastUsedFrame;
+  
+  char *Text;
+  u32 TextLength;
+
+  // Width as reported by FontTextWidthPixels, and the union of all glyph
+  // destination rectangles relative to the text origin.
+  f32 Width;
+  v4 Bounds;
+  
+  u32 NumGlyphs;
+  text_layout_glyph *Glyphs;
+} text_layout;
+
+// Caches the laid out glyph runs of recently drawn strings so that identical
+// text drawn every frame (console, UI labels) isn't re-laid out character by
+// character. Layouts live in one of two generation arenas. Compaction copies
+// the layouts used within the expiry window into the other generation and
+// clears the old one.
+typedef struct text_layout_cache {
+  u64 CurrentFrame;
+  u32 Generation;
+  memory_arena Arena[2];
+  // Set once the cache has compacted early in the current expiry window
+  b32 CompactedEarly;
+  
+  u32 NumLayouts;
+  text_layout *Table;
+
+  // Lookups so far this frame, and over the whole of the previous frame
+  u32 Hits;
+  u32 Misses;
+  u32 LastFrameHits;
+  u32 LastFrameMisses;
+} text_layout_cache;
+
+///////////////////////////////////////////////////////////////////////////////
+// font
+
+#define FONT_MANAGER_MAX_FONTS 16
+
 typedef struct font {
   const char *FontFile;
   u32 FontSizePixels;
   FT_Face Face;
+  // NOTE: Texture is the font manager's shared atlas, not owned by the font.
   GLuint Texture;
   v2 TextureDim;
   font_glyph_cache GlyphCache[128];
+  text_layout_cache LayoutCache;
 } packed_font;
 
+typedef struct font_load_request {
+  font *Font;
+  const char *FontFile;
+  u32 FontSizePixels;
+} font_load_request;
+
+// NOTE: All fonts pack their glyphs into a single atlas texture owned by the
+// font manager. This lets text from any font batch into the same draw call.
+#define FONT_ATLAS_DIM 1024
+
+// NOTE: Enough for the main thread plus the most workers the platform runs.
+#define FONT_MANAGER_MAX_RASTERIZERS 17
+
+// FreeType state used by the glyph raster jobs. Libraries and faces can't be
+// shared between threads, so a job claims a rasterizer for as long as it runs.
+// The face of the last font rasterized is kept open for the next job.
+typedef struct font_rasterizer {
+  u32 volatile InUse;
+  FT_Library FreeType;
+  FT_Face Face;
+  char FacePath[256];
+} font_rasterizer;
+
 typedef struct font_manager {
   FT_Library FreeType;
   const char *FontDirectory;
+  font_rasterizer Rasterizers[FONT_MANAGER_MAX_RASTERIZERS];
+
+  u32 NumFonts;
+  font *Fonts[FONT_MANAGER_MAX_FONTS];
+
+  GLuint AtlasTexture;
+  v2 AtlasDim;
+  stbrp_context AtlasPacker;
+  stbrp_node AtlasNodes[FONT_ATLAS_DIM];
 } font_manager;
 
-internal b32 FontManagerInit(font_manager *FontManager, const char *FontDirectory);
+internal b32 FontManagerInit(font_manager *FontManager, const char *FontDirectory, memory_arena *TransientArena);
 internal void FontManagerDestroy(font_manager *FontManager);
 internal b32 FontManagerLoadFont(
   font_manager *FontManager,
   font *Font,
   const char *FontFile,
   u32 FontSizePixels,
+  platform_state *Platform,
+  memory_arena *TransientArena
+);
+// Loads several fonts at once, rasterizing their glyphs concurrently on the
+// platform work queue. Returns false if any of the fonts failed to load.
+internal b32 FontManagerLoadFonts(
+  font_manager *FontManager,
+  font_load_request *Requests,
+  u32 NumRequests,
+  platform_state *Platform,
   memory_arena *TransientArena
 );
 internal void FontManagerDestroyFont(font_manager *FontManager, font *Font);
+// Advances the frame counter for all loaded fonts, expiring stale text layouts.
+internal void FontManagerBeginFrame(font_manager *FontManager);
+
+// Returns the cached layout for the given text, laying it out on a miss.
+// Returns NULL if the layout doesn't fit in the cache, in which case the
+// caller should lay out the text itself.
+internal text_layout* FontTextLayout(font *Font, const char *Text);
 
 internal f32 FontTextWidthPixels(font *Font, const char *Text);
 internal f32 FontTextRangeWidthPixels(font *Font, const char *Text, u32 Start, u32 Stop);
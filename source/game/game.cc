@@ -10,6 +10,7 @@
 #include "fonts.cc"
 #include "textures.cc"
 #include "sounds.cc"
+#include "audio_effects.cc"
 #include "mixer.cc"
 #include "map.cc"
 #include "ui/ui.cc"
@@ -168,17 +169,57 @@ internal void CameraDrawDebug(camera *Camera, renderer *Renderer, v2 PlayerP)
   );
 }
 
+// Draws the platform's audio histograms as two bar graphs in the top right
+// corner of the screen. Each graph is scaled to its tallest bucket.
+internal void AudioDrawDebug(platform_audio_stats *Stats, renderer *Renderer, font *Font, v2u RenderDim)
+{
+  f32 TextHeight = FontTextHeightPixels(Font);
+  f32 BarWidth = 24.0f;
+  f32 GraphHeight = 96.0f;
+  f32 GraphWidth = BarWidth * PLATFORM_AUDIO_HISTOGRAM_BUCKETS;
+  v2 Origin = V2(RenderDim.Width - GraphWidth - 16, RenderDim.Height - 2*TextHeight - GraphHeight);
+
+  char *Titles[2] = { "Device fill (buffer)", "Mix time (period)" };
+  u32 *Histograms[2] = { Stats->FillHistogram, Stats->MixTimeHistogram };
+  v4 Colors[2] = { V4(0.2, 0.8, 0.2, 0.8), V4(0.9, 0.6, 0.1, 0.8) };
+
+  foreach(Graph, 2)
+  {
+    u32 *Histogram = Histograms[Graph];
+    u32 Tallest = 1;
+    foreach(I, PLATFORM_AUDIO_HISTOGRAM_BUCKETS)
+    {
+      Tallest = Max(Tallest, Histogram[I]);
+    }
+
+    RendererPushFilledRect(Renderer, 0, V4(Origin.X, Origin.Y, GraphWidth, GraphHeight), V4(0, 0, 0, 0.6));
+    foreach(I, PLATFORM_AUDIO_HISTOGRAM_BUCKETS)
+    {
+      f32 BarHeight = GraphHeight * (Histogram[I] / (f32)Tallest);
+      RendererPushFilledRect(Renderer, 0, V4(Origin.X + I*BarWidth + 1, Origin.Y, BarWidth - 2, BarHeight), Colors[Graph]);
+    }
+    RendererPushText(Renderer, 0, Font, Titles[Graph], V2(Origin.X, Origin.Y + GraphHeight + 4), V4(1, 1, 1, 1));
+
+    Origin.Y -= GraphHeight + 2*TextHeight;
+  }
+
+  RendererPushSprintf(
+    Renderer, 0, Font, V2(Origin.X, Origin.Y + GraphHeight + 4), V4(1, 1, 1, 1),
+    "%0.01f ms out, %d xrun, %d silenced", Stats->OutputLatencyMS, Stats->DeviceXRuns, Stats->SilencedPeriods
+  );
+}
+
 #if 0
 // NOTE: This method is left over from testing the platform layer audio. It is
 // a good, continuous sound test for new platform audio layers that can help
 // detect pops and other audio issues.
-void TestUpdateAudio(game_state *GameState, platform_state *Platform, f32 DeltaTimeSecs)
+void TestUpdateAudio(game_state *GameState, platform_state *Platform, audio_buffer *AudioBuffer)
 {
   i16 ToneVolume = 3000;
   i32 ToneHz = (250 + (Platform->Input.Mouse.Pos01.X - 0.25) * 150);
-  i32 WavePeriod = Platform->Shared.AudioBuffer.SamplesPerSecond / ToneHz;
-  i16* SampleOut = Platform->Shared.AudioBuffer.Samples;
-  for (u32 I = 0; I < Platform->Shared.AudioBuffer.FrameCount; ++I)
+  i32 WavePeriod = AudioBuffer->SamplesPerSecond / ToneHz;
+  i16* SampleOut = AudioBuffer->Samples;
+  for (u32 I = 0; I < AudioBuffer->FrameCount; ++I)
   {
     f32 SineValue = sinf(GameState->AudioTime);
     i16 Value = (i32)(SineValue * ToneVolume);
@@ -228,13 +269,11 @@ internal void PositionUpdate(position *Position, v2 Delta)
 
 static u64 TorchTimer = 0; // TODO: Remove this variable
 
-void SimulateGame(app_context Ctx, u64 DeltaTimeMicros)
+// Advances the game by one fixed step. Everything that should behave the same
+// at any frame rate belongs here.
+internal void SimulateGameStep(app_context Ctx, u64 StepMicros)
 {
-  renderer *Renderer = &Ctx.Game->Renderer;
-  ui_context *UI = &Ctx.Game->UI;
-  audio_player *AudioPlayer = &Ctx.Game->AudioPlayer;
-
-  TorchTimer += DeltaTimeMicros;
+  TorchTimer += StepMicros;
   if (TorchTimer > Microsecs(0.15)) {
     u16 NewValue = MapGetTile(&Ctx.Game->Map, 1, 4, 1);
     NewValue += 1;
@@ -244,49 +283,13 @@ void SimulateGame(app_context Ctx, u64 DeltaTimeMicros)
     TorchTimer = 0;
   }
 
-  // Update console
-  ConsoleUpdate(&Ctx.Game->Console, Ctx, DeltaTimeMicros);
-  Ctx.Game->KeyboardInputConsumed |= Ctx.Game->Console.KeyboardInputConsumed;
-  Ctx.Game->MouseInputConsumed |= Ctx.Game->Console.MouseInputConsumed;
-  Ctx.Game->TextInputConsumed |= Ctx.Game->Console.TextInputConsumed;
-
-  // UI Definition: Will not be rendered until command list is processed
-  // 
-  // UI components should be rendered first so that information about
-  // whether mouse or keyboard input is captured can be sent to the rest of
-  // the application.
-  if (!Ctx.Game->KeyboardInputConsumed)
-  {
-    // TODO: Update UI with new keyboard input
-  }
-
-  if (!Ctx.Game->MouseInputConsumed)
-  {
-    // TODO: Update UI with new mouse input
-  }
-
-  if (!Ctx.Game->TextInputConsumed)
-  {
-    // TODO: Update UI with new text input
-  }
+  Ctx.Game->PrevPlayerP = Ctx.Game->PlayerP;
 
   // Update the game state
   if (!Ctx.Game->KeyboardInputConsumed)
   {
     v2 ddPlayerP = V2(0);
-    if (KeyDown(Ctx.Platform, KEY_shift)) {
-      if (KeyPressed(Ctx.Platform, KEY_up)) {
-        Ctx.Game->Camera.ScreenOffset.Y += 5;
-      } else if (KeyPressed(Ctx.Platform, KEY_down)) {
-        Ctx.Game->Camera.ScreenOffset.Y -= 5;
-      }
-
-      if (KeyPressed(Ctx.Platform, KEY_right)) {
-        Ctx.Game->Camera.ScreenOffset.X += 5;
-      } else if (KeyPressed(Ctx.Platform, KEY_left)) {
-        Ctx.Game->Camera.ScreenOffset.X -= 5;
-      }
-    } else {
+    if (!KeyDown(Ctx.Platform, KEY_shift)) {
       if (KeyDown(Ctx.Platform, KEY_right)) {
         ddPlayerP.X = 1;
         if (Ctx.Game->dPlayerP.X < 0) {
@@ -314,7 +317,7 @@ void SimulateGame(app_context Ctx, u64 DeltaTimeMicros)
 
     f32 Acceleration = 100.0f;
     f32 FrictionCoeff = 0.01f;
-    f32 dTime = DeltaTimeMicros / 1E6;
+    f32 dTime = StepMicros / 1E6;
 
     // Only apply friction once we stop moving in a given direction.
     if (ddPlayerP.X == 0) {
@@ -339,6 +342,90 @@ void SimulateGame(app_context Ctx, u64 DeltaTimeMicros)
       Ctx.Game->dPlayerP.Y = 0;
     }
   }
+}
+
+// Runs as many fixed steps as the frame's time covers and leaves the rest in
+// the accumulator for next frame.
+internal void SimulateGameSteps(app_context Ctx, u64 DeltaTimeMicros)
+{
+  game_state *Game = Ctx.Game;
+  Game->SimulationAccumulatorMicros += DeltaTimeMicros;
+
+  u32 Steps = 0;
+  while (Game->SimulationAccumulatorMicros >= SIMULATION_STEP_MICROS && Steps < SIMULATION_MAX_STEPS)
+  {
+    SimulateGameStep(Ctx, SIMULATION_STEP_MICROS);
+    Game->SimulationAccumulatorMicros -= SIMULATION_STEP_MICROS;
+    ++Steps;
+  }
+
+  // NOTE: After a hitch (a breakpoint, a slow load) don't try to simulate the
+  // whole gap. Steps that take longer than they cover would only make every
+  // following frame later still.
+  if (Game->SimulationAccumulatorMicros >= SIMULATION_STEP_MICROS)
+  {
+    Game->SimulationAccumulatorMicros %= SIMULATION_STEP_MICROS;
+    ++Game->SimulationOverloads;
+  }
+
+  Game->SimulationSteps = Steps;
+  Game->SimulationAlpha = (f32)Game->SimulationAccumulatorMicros / (f32)SIMULATION_STEP_MICROS;
+}
+
+void SimulateGame(app_context Ctx, u64 DeltaTimeMicros)
+{
+  renderer *Renderer = &Ctx.Game->Renderer;
+  ui_context *UI = &Ctx.Game->UI;
+  audio_player *AudioPlayer = &Ctx.Game->AudioPlayer;
+
+  // Update console
+  ConsoleUpdate(&Ctx.Game->Console, Ctx, DeltaTimeMicros);
+  Ctx.Game->KeyboardInputConsumed |= Ctx.Game->Console.KeyboardInputConsumed;
+  Ctx.Game->MouseInputConsumed |= Ctx.Game->Console.MouseInputConsumed;
+  Ctx.Game->TextInputConsumed |= Ctx.Game->Console.TextInputConsumed;
+
+  // UI Definition: Will not be rendered until command list is processed
+  // 
+  // UI components should be rendered first so that information about
+  // whether mouse or keyboard input is captured can be sent to the rest of
+  // the application.
+  if (!Ctx.Game->KeyboardInputConsumed)
+  {
+    // TODO: Update UI with new keyboard input
+  }
+
+  if (!Ctx.Game->MouseInputConsumed)
+  {
+    // TODO: Update UI with new mouse input
+  }
+
+  if (!Ctx.Game->TextInputConsumed)
+  {
+    // TODO: Update UI with new text input
+  }
+
+  // NOTE: Key presses only last a frame, so they are handled here rather than
+  // in the steps, which may run any number of times.
+  if (!Ctx.Game->KeyboardInputConsumed && KeyDown(Ctx.Platform, KEY_shift))
+  {
+    if (KeyPressed(Ctx.Platform, KEY_up)) {
+      Ctx.Game->Camera.ScreenOffset.Y += 5;
+    } else if (KeyPressed(Ctx.Platform, KEY_down)) {
+      Ctx.Game->Camera.ScreenOffset.Y -= 5;
+    }
+
+    if (KeyPressed(Ctx.Platform, KEY_right)) {
+      Ctx.Game->Camera.ScreenOffset.X += 5;
+    } else if (KeyPressed(Ctx.Platform, KEY_left)) {
+      Ctx.Game->Camera.ScreenOffset.X -= 5;
+    }
+  }
+
+  SimulateGameSteps(Ctx, DeltaTimeMicros);
+
+  // NOTE: Draw the player between its last two steps, snapped to the pixel
+  // grid like the simulated position itself.
+  v2 PlayerRenderP = Round(Lerp(Ctx.Game->PrevPlayerP.Pos, Ctx.Game->PlayerP.Pos, Ctx.Game->SimulationAlpha));
 
   // Process input
   if (KeyPressed(Ctx.Platform, KEY_esc))
@@ -353,12 +440,17 @@ void SimulateGame(app_context Ctx, u64 DeltaTimeMicros)
   
   if (KeyPressed(Ctx.Platform, KEY_f3))
   {
-    AudioPlayerPlaySound(AudioPlayer, Ctx.Game->SlideSound, V2(1.0f), false);
+    AudioPlayerPlaySoundAt(AudioPlayer, Ctx.Platform, &Ctx.Game->SlideSound, Ctx.Game->PlayerP.Pos, 1.0f, false, AUDIO_PRIORITY_DEFAULT, AUDIO_BUS_sfx);
   }
 
-  CameraUpdate(&Ctx.Game->Camera, Ctx.Game->PlayerP.Pos, Ctx.Game->dPlayerP, DeltaTimeMicros);
+  CameraUpdate(&Ctx.Game->Camera, PlayerRenderP, Ctx.Game->dPlayerP, DeltaTimeMicros);
+
+  // NOTE: The listener sits at the center of the camera's dead zone, which is
+  // the point in the world the camera is framing.
+  AudioPlayerSetListener(AudioPlayer, Ctx.Game->Camera.StartOffset);
 
   // Render (Simple Test Render Pipeline)
+  FontManagerBeginFrame(&Ctx.Game->FontManager);
   RendererBeginFrame(Renderer, Ctx.Platform, Ctx.Platform->Input.RenderDim);
   {
     RendererSetTarget(Renderer, &Ctx.Game->HDRTarget);
@@ -377,19 +469,19 @@ void SimulateGame(app_context Ctx, u64 DeltaTimeMicros)
       RendererPushFilledRect(
         Renderer,
         RENDER_FLAG_centered,
-        V4(Ctx.Game->PlayerP.Pos, V2(64)),
+        V4(PlayerRenderP, V2(64)),
         V4(1, 0, 0, 1)
       );
       RendererPushFilledCircle(
         Renderer,
         0,
-        Ctx.Game->PlayerP.Pos,
+        PlayerRenderP,
         32,
         V4(0, 1, 1, 0.8)
       );
 
       if (Ctx.Game->ShowCameraDebug) {
-        CameraDrawDebug(&Ctx.Game->Camera, Renderer, Ctx.Game->PlayerP.Pos);
+        CameraDrawDebug(&Ctx.Game->Camera, Renderer, PlayerRenderP);
       }
     }
     RendererPopMVPMatrix(Renderer);
@@ -454,7 +546,7 @@ void SimulateGame(app_context Ctx, u64 DeltaTimeMicros)
       ConsoleRender(&Ctx.Game->Console, Renderer);
 
       static char FPSText[256];
-      snprintf(FPSText, 256, "FPS: %0.00f, MCPF: %03d, MSPF: %0.04f, Draws: %d", Ctx.Game->FPS, Ctx.Game->MCPF, Ctx.Game->MSPF, Ctx.Game->Renderer.LastFrameDrawCalls);
+      snprintf(FPSText, 256, "FPS: %0.00f, MCPF: %03d, MSPF: %0.04f, Draws: %d, Steps: %d (%d over)", Ctx.Game->FPS, Ctx.Game->MCPF, Ctx.Game->MSPF, Ctx.Game->Renderer.LastFrameDrawCalls, Ctx.Game->SimulationSteps, Ctx.Game->SimulationOverloads);
 
       f32 TextWidth = FontTextWidthPixels(&Ctx.Game->MonoFont, FPSText);
 
@@ -483,6 +575,10 @@ void SimulateGame(app_context Ctx, u64 DeltaTimeMicros)
         RendererPushText(
           Renderer, 0, &Ctx.Game->MonoFont, FPSText, V2(0, FontTextHeightPixels(&Ctx.Game->MonoFont)), V4(1, 1, 1, 1)
         );
+
+        if (Ctx.Game->ShowAudioDebug) {
+          AudioDrawDebug(&Ctx.Platform->Input.Audio, Renderer, &Ctx.Game->MonoFont, Ctx.Game->RenderDim);
+        }
       }
       RendererPopMVPMatrix(Renderer);
 
@@ -559,8 +655,9 @@ void Update(platform_state *Platform, u64 DeltaTimeMicros)
   default: break;
   }
 
-  // Get those audio updates in
-  UpdateAndMixAudio(&GameState->AudioPlayer, &Platform->Shared.AudioBuffer, (f32)DeltaTimeMicros / 1E6);
+  // Reclaim voices the audio thread has finished with and keep the files of
+  // streamed sounds paged in just ahead of playback
+  AudioPlayerUpdate(&GameState->AudioPlayer, Platform);
   
   // Hot reload catalogs if needed
   ShaderCatalogUpdate(&GameState->ShaderCatalog, Platform);
@@ -584,12 +681,26 @@ void Shutdown(platform_state *Platform)
   FontManagerDestroyFont(&GameState->FontManager, &GameState->UIFont);
   FontManagerDestroy(&GameState->FontManager);
 
-  AudioPlayerDestroy(&GameState->AudioPlayer);
+  AudioPlayerDestroy(&GameState->AudioPlayer, Platform);
   SoundManagerDestroySound(&GameState->SoundManager, &GameState->SlideSound, Platform);
   SoundManagerDestroySound(&GameState->SoundManager, &GameState->WallMarketTheme, Platform);
   SoundManagerDestroy(&GameState->SoundManager);
 }
 
+void GetSoundSamples(platform_state *Platform, audio_buffer *AudioBuffer)
+{
+  // NOTE: This runs on the audio thread, so it must never initialize the game
+  // state. Emit silence until the game thread has done so.
+  game_state *GameState = (game_state*)Platform->Input.PermanentStorage;
+  if (!AtomicLoadAcquireU32((u32 volatile*)&GameState->IsInitialized))
+  {
+    ZeroMemory((u8*)AudioBuffer->Samples, AudioBuffer->FrameCount * 2 * sizeof(i16));
+    return;
+  }
+
+  AudioPlayerMix(&GameState->AudioPlayer, AudioBuffer);
+}
+
 void OnFrameStart(platform_state *Platform)
 {
   game_state *GameState = FetchGameState(Platform);
@@ -661,16 +772,21 @@ internal game_state* FetchGameState(platform_state *Platform)
     SeedRandomNumberGenerator();
 
     {
-      GameState->PermanentArena = ArenaInit(Platform->Input.PermanentStorage + sizeof(game_state),
-                                            Platform->Input.PermanentStorageSize - sizeof(game_state));
-      GameState->TransientArena = ArenaInit(Platform->Input.TransientStorage,
-                                            Platform->Input.TransientStorageSize);
+      GameState->PermanentArena = ArenaInitReserved(Platform->Input.PermanentStorage + sizeof(game_state),
+                                                    Platform->Input.PermanentStorageSize - sizeof(game_state),
+                                                    Platform->Interface.CommitMemory);
+      GameState->TransientArena = ArenaInitReserved(Platform->Input.TransientStorage,
+                                                    Platform->Input.TransientStorageSize,
+                                                    Platform->Interface.CommitMemory);
+      GameState->TransientArena.ZeroPolicy = TRANSIENT_ZERO_POLICY;
+      GameState->TransientArena.MinimumBlockSize = TRANSIENT_BLOCK_SIZE;
+      MemoryPoolInit(&GameState->WorkPool, &GameState->PermanentArena, WORK_POOL_BLOCK_SIZE, WORK_POOL_BLOCK_COUNT);
     }
     
     
     {
       ShaderCatalogInit(&GameState->ShaderCatalog, &GameState->TransientArena);
-      TextureCatalogInit(&GameState->TextureCatalog);
+      TextureCatalogInit(&GameState->TextureCatalog, &GameState->WorkPool);
       RendererCreate(Platform, &GameState->Renderer, &GameState->ShaderCatalog);
       
       // TODO: Replace with configurable rendering resolution
@@ -709,17 +825,22 @@ internal game_state* FetchGameState(platform_state *Platform)
     const char *FontFace = "CenturySchoolbookRegular.pfb";
 #endif
 
-    FontManagerInit(&GameState->FontManager, "../assets/fonts");
-    FontManagerLoadFont(&GameState->FontManager, &GameState->MonoFont, FontFace, 24, &GameState->TransientArena);
-    FontManagerLoadFont(&GameState->FontManager, &GameState->UIFont, FontFace, 16, &GameState->TransientArena);
+    FontManagerInit(&GameState->FontManager, "../assets/fonts", &GameState->TransientArena);
+    {
+      font_load_request Requests[] = {
+        { .Font = &GameState->MonoFont, .FontFile = FontFace, .FontSizePixels = 24 },
+        { .Font = &GameState->UIFont, .FontFile = FontFace, .FontSizePixels = 16 },
+      };
+      FontManagerLoadFonts(&GameState->FontManager, Requests, ArrayCount(Requests), Platform, &GameState->TransientArena);
+    }
 
     // Sound manager
-    SoundManagerInit(&GameState->SoundManager, "../assets/sounds");
-    SoundManagerLoadSound(&GameState->SoundManager, &GameState->SlideSound, Platform, "boxslide.ogg");
-    SoundManagerLoadSound(&GameState->SoundManager, &GameState->WallMarketTheme, Platform, "wall_market_theme.ogg");
+    SoundManagerInit(&GameState->SoundManager, "../assets/sounds", &GameState->PermanentArena, &GameState->WorkPool);
+    SoundManagerLoadSoundAsync(&GameState->SoundManager, &GameState->SlideSound, Platform, "boxslide.ogg");
+    SoundManagerLoadSoundAsync(&GameState->SoundManager, &GameState->WallMarketTheme, Platform, "wall_market_theme.ogg");
 
     AudioPlayerInit(&GameState->AudioPlayer, &GameState->PermanentArena);
-    AudioPlayerPlaySound(&GameState->AudioPlayer, GameState->WallMarketTheme, V2(1.0f), false);
+    AudioPlayerPlaySound(&GameState->AudioPlayer, Platform, &GameState->WallMarketTheme, V2(1.0f), false, AUDIO_PRIORITY_HIGH, AUDIO_BUS_music);
    
     {
       // NOTE: The renderer depends on the presence of certain shaders in the 
@@ -774,6 +895,7 @@ internal game_state* FetchGameState(platform_state *Platform)
     }
 
     GameState->PlayerP.Pos = V2(GameState->RenderDim.Width/2, GameState->RenderDim.Height/2);
+    GameState->PrevPlayerP = GameState->PlayerP;
     GameState->UIState = {};
     UIStateInit(&GameState->UIState, &GameState->UIFont, &GameState->TextureCatalog, &GameState->Renderer);
     foreach(I, ArrayCount(GameState->Window)) {
@@ -797,7 +919,9 @@ internal game_state* FetchGameState(platform_state *Platform)
 
     CameraInit(&GameState->Camera, V2(0), V2(400, 200), GameState->PlayerP.Pos);
 
-    GameState->IsInitialized = true;
+    // NOTE: Publish with a release store as the audio thread starts mixing
+    // as soon as it sees this.
+    AtomicStoreReleaseU32((u32 volatile*)&GameState->IsInitialized, true);
   }
 
   // Update (per-frame)
@@ -11,6 +11,16 @@
 #include <GL/glext.h>
 #endif
 
+// NOTE: stb_image allocates from the scratch arena of the worker decoding
+// the image, see textures.h.
+static void* TextureScratchAlloc(size_t Size);
+static void* TextureScratchRealloc(void *Pointer, size_t OldSize, size_t NewSize);
+static void* TextureScratchReallocUnsized(void *Pointer, size_t NewSize);
+static void  TextureScratchFree(void *Pointer);
+#define STBI_MALLOC(Size) TextureScratchAlloc(Size)
+#define STBI_REALLOC(Pointer, NewSize) TextureScratchReallocUnsized(Pointer, NewSize)
+#define STBI_REALLOC_SIZED(Pointer, OldSize, NewSize) TextureScratchRealloc(Pointer, OldSize, NewSize)
+#define STBI_FREE(Pointer) TextureScratchFree(Pointer)
 #define STB_IMAGE_IMPLEMENTATION
 #include "ext/stb_image.h"
 
@@ -28,6 +38,7 @@
 // name of several variables in other libraries.
 #include "common/language_layer.h"
 #include "common/memory_arena.h"
+#include "common/memory_pool.h"
 #include "common/watched_file.h"
 #define WATCHED_FILE_SET_IMPLEMENTATION
 #include "common/watched_file_set.h"
@@ -36,8 +47,28 @@
 // Game configuration provided to platform
 #define APP_TITLE              "Plague 2.0"
 #define DEFAULT_TARGET_FPS     60.0f
+// The simulation always advances in steps of this length, however long frames
+// take. Frames more than SIMULATION_MAX_STEPS behind drop the rest rather than
+// falling further behind trying to catch up.
+#define SIMULATION_HZ          120
+#define SIMULATION_STEP_MICROS (1000000 / SIMULATION_HZ)
+#define SIMULATION_MAX_STEPS   8
 #define PERMANENT_STORAGE_SIZE Megabytes(512)
 #define TRANSIENT_STORAGE_SIZE Megabytes(256)
+// NOTE: Transient memory is released wholesale all the time, so it's zeroed
+// as it's allocated rather than as it's released. Debug builds poison it on
+// release instead to catch reads of stale memory.
+#if BUILD_DEBUG
+#define TRANSIENT_ZERO_POLICY  ARENA_ZERO_poison
+#else
+#define TRANSIENT_ZERO_POLICY  ARENA_ZERO_on_alloc
+#endif
+// Transient memory grows by heap blocks of at least this size once full
+#define TRANSIENT_BLOCK_SIZE   Megabytes(16)
+// Blocks in the pool that background work payloads are allocated from. Blocks
+// must fit the largest payload.
+#define WORK_POOL_BLOCK_SIZE   512
+#define WORK_POOL_BLOCK_COUNT  256
 #define DEFAULT_WINDOW_WIDTH   1280 // 1920
 #define DEFAULT_WINDOW_HEIGHT  720 // 1080
 
@@ -98,6 +129,57 @@ typedef struct audio_buffer {
   u32 SamplesPerSecond;
 } audio_buffer;
 
+// Buckets in each of the audio telemetry histograms. Bucket I counts samples
+// that fell in [I/N, (I+1)/N) of the histogram's range, and the last bucket
+// also counts everything past the end of it.
+#define PLATFORM_AUDIO_HISTOGRAM_BUCKETS 10
+
+// Running totals reported by the platform audio path
+typedef struct platform_audio_stats {
+  // Frames queued in the device waiting to be played
+  u32 BufferedFrames;
+  // Times the device itself ran dry or was suspended and had to be recovered
+  u32 DeviceXRuns;
+  // Frames the device asks for at a time
+  u32 PeriodFrames;
+  // Whether the audio thread got real-time scheduling
+  b32 RealTime;
+  // Name of the latency mode the device was set up with
+  char *LatencyMode;
+  // Latency the device buffer was sized for
+  f32 TargetLatencyMS;
+  // Measured time until audio mixed now is heard
+  f32 OutputLatencyMS;
+
+  // Device buffer fill each time the audio thread woke up, as a fraction of
+  // the buffer. Wakeups in the first bucket were close to an underrun.
+  u32 FillHistogram[PLATFORM_AUDIO_HISTOGRAM_BUCKETS];
+  // Time the game took to mix each period, as a fraction of the period's
+  // length. Anything in the last bucket risked an underrun.
+  u32 MixTimeHistogram[PLATFORM_AUDIO_HISTOGRAM_BUCKETS];
+  f32 MixTimeLastMS;
+  f32 MixTimeMaxMS;
+  // Periods sent out silent because the game library was being reloaded
+  u32 SilencedPeriods;
+} platform_audio_stats;
+
+///////////////////////////////////////////////////////////////////////////////
+// frame pacing
+
+typedef struct platform_frame_stats {
+  // Time between frame deadlines, either the target frame rate or the
+  // measured display refresh
+  f32 FramePeriodMS;
+  // Estimate of the time from sampling input to the frame being presented
+  f32 RenderEstimateMS;
+  // How long before a deadline the pacer stops sleeping and spins instead
+  f32 SpinMS;
+  // Time spent waiting for the deadline in the last frame
+  f32 WaitMS;
+  // Frames that started after their deadline had already passed
+  u32 MissedDeadlines;
+} platform_frame_stats;
+
 ///////////////////////////////////////////////////////////////////////////////
 // file system
 
@@ -106,6 +188,18 @@ typedef struct platform_entire_file {
   u32 SizeBytes;
 } platform_entire_file;
 
+// A read-only view of a file mapped into memory. Pages are read in as they are
+// touched rather than all at once.
+typedef struct platform_mapped_file {
+  u8  *Data;
+  u32 SizeBytes;
+} platform_mapped_file;
+
+typedef enum platform_file_advice {
+  PLATFORM_FILE_ADVICE_will_need, // Start reading the range in ahead of use
+  PLATFORM_FILE_ADVICE_dont_need  // Drop the range from memory until next used
+} platform_file_advice;
+
 ///////////////////////////////////////////////////////////////////////////////
 // platform provided state and functions
 
@@ -114,18 +208,66 @@ typedef u64 get_time_ms_fn(void);
 typedef void* get_opengl_proc_address_fn(const char*);
 typedef b32 load_entire_file_fn(const char*, platform_entire_file*);
 typedef void free_entire_file_fn(platform_entire_file*);
+typedef b32 map_file_fn(const char*, platform_mapped_file*);
+typedef void unmap_file_fn(platform_mapped_file*);
+typedef void advise_file_range_fn(platform_mapped_file*, u32 Offset, u32 SizeBytes, platform_file_advice Advice);
 typedef void log_fn(const char*, ...);
 typedef b32 set_clipboard_text_fn(const char*);
 typedef char* get_clipboard_text_fn(scoped_arena*);
 
 typedef struct work_queue work_queue;
 typedef void platform_work_queue_callback_fn(work_queue *Queue, void *Data);
+
+// NOTE: Work is taken from the highest priority lane that has any, so lower
+// lanes only run when nothing above them is waiting.
+typedef enum work_queue_priority {
+  WORK_QUEUE_PRIORITY_high,       // Work the current frame is waiting on
+  WORK_QUEUE_PRIORITY_normal,     // Asset loads and the like
+  WORK_QUEUE_PRIORITY_background, // Hot reloads and anything else that can wait
+  WORK_QUEUE_PRIORITY_COUNT
+} work_queue_priority;
+
+typedef struct platform_work_lane_stats {
+  // Entries waiting to be run
+  u32 Depth;
+  // Entries run so far
+  u32 Taken;
+  // Time entries spent waiting in the lane before being run
+  f32 WaitAverageMS;
+  f32 WaitMaxMS;
+} platform_work_lane_stats;
+
+typedef struct platform_work_queue_stats {
+  u32 WorkerCount;
+  platform_work_lane_stats Lanes[WORK_QUEUE_PRIORITY_COUNT];
+} platform_work_queue_stats;
+
+// Counts the jobs added against it that have yet to finish. Waiting on a
+// counter, or chaining a continuation onto it, is how one batch of jobs
+// depends on another.
+//
+// NOTE: Must be zero initialized, and must not go out of scope until it has
+// been waited on.
+typedef struct work_counter {
+  u32 volatile Value;
+  struct work_continuation *Continuations;
+} work_counter;
+
 typedef void work_queue_add_entry_fn(work_queue *Queue, platform_work_queue_callback_fn *Callback, void *Data);
+typedef void work_queue_add_entries_fn(work_queue *Queue, work_queue_priority Priority, platform_work_queue_callback_fn *Callback, void **Data, u32 Count, work_counter *Counter);
+typedef void work_queue_add_continuation_fn(work_queue *Queue, work_counter *Dependency, work_queue_priority Priority, platform_work_queue_callback_fn *Callback, void *Data, work_counter *Counter);
+typedef void work_queue_wait_for_counter_fn(work_queue *Queue, work_counter *Counter);
 typedef void work_queue_complete_all_work_fn(work_queue *Queue);
+typedef memory_arena* work_queue_get_scratch_arena_fn(work_queue *Queue);
+typedef void work_queue_get_stats_fn(work_queue *Queue, platform_work_queue_stats *Stats);
 
 typedef struct platform_state {
   struct {
     // NOTE(eric): These are expected to be initialized to all zeros
+    //
+    // NOTE: Storage is reserved rather than committed, past the game_state at
+    // the start of permanent storage. Commit it through CommitMemory before
+    // touching it, which arenas from ArenaInitReserved do as they grow.
     u8  *PermanentStorage;
     u32 PermanentStorageSize;
     u8  *TransientStorage;
@@ -143,15 +285,22 @@ typedef struct platform_state {
     char     Text[32];
     
     work_queue *WorkQueue;
+    // Number of worker threads taking work from the queue
+    u32 WorkerCount;
+    platform_audio_stats Audio;
+    platform_frame_stats Frame;
   } Input;
   
   struct {
     b32 IsRunning;
+    // Frame rate paced to with VSync off. Zero or less runs unlimited.
     i32 TargetFPS;
     b32 VSync;
     b32 FullScreen;
-    
-    audio_buffer AudioBuffer;
+    // Sample input and simulate as late as possible before each frame's
+    // deadline, and don't let the GPU queue frames up. Costs some throughput
+    // for less input-to-photon latency.
+    b32 LowLatency;
   } Shared;
   
   struct {
@@ -159,11 +308,20 @@ typedef struct platform_state {
     get_opengl_proc_address_fn      *GetOpenGLProcAddress;
     load_entire_file_fn             *LoadEntireFile;
     free_entire_file_fn             *FreeEntireFile;
+    map_file_fn                     *MapFile;
+    unmap_file_fn                   *UnmapFile;
+    advise_file_range_fn            *AdviseFileRange;
+    memory_commit_fn                *CommitMemory;
     log_fn                          *Log;
     set_clipboard_text_fn           *SetClipboardText;
     get_clipboard_text_fn           *GetClipboardText;
     work_queue_add_entry_fn         *WorkQueueAddEntry;
+    work_queue_add_entries_fn       *WorkQueueAddEntries;
+    work_queue_add_continuation_fn  *WorkQueueAddContinuation;
+    work_queue_wait_for_counter_fn  *WorkQueueWaitForCounter;
     work_queue_complete_all_work_fn *WorkQueueCompleteAllWork;
+    work_queue_get_scratch_arena_fn *WorkQueueGetScratchArena;
+    work_queue_get_stats_fn         *WorkQueueGetStats;
   } Interface;
 } platform_state;
 
@@ -187,11 +345,15 @@ typedef void shutdown_fn(platform_state*);
 typedef void on_frame_start_fn(platform_state*);
 typedef void on_frame_end_fn(platform_state*);
 
+// Called from the platform audio thread
+typedef void get_sound_samples_fn(platform_state*, audio_buffer*);
+
 extern "C" {
   void Update(platform_state *Platform, u64 DeltaTimeMicros);
   void Shutdown(platform_state *Platform);
   void OnFrameStart(platform_state *Platform);
   void OnFrameEnd(platform_state *Platform);
+  void GetSoundSamples(platform_state *Platform, audio_buffer *AudioBuffer);
 }
 
 typedef enum program_mode {
@@ -247,6 +409,7 @@ typedef struct game_state {
   
   memory_arena PermanentArena;
   memory_arena TransientArena;
+  memory_pool  WorkPool;
 
   program_mode Mode;
 
@@ -285,6 +448,17 @@ typedef struct game_state {
 
   position PlayerP;  // Displacement
   v2 dPlayerP; // Velocity
+  // Displacement as of the previous simulation step. Rendering blends from
+  // here to PlayerP.
+  position PrevPlayerP;
+
+  // Frame time not yet simulated, always less than a step after a frame
+  u64 SimulationAccumulatorMicros;
+  // How far the accumulator is into the next step, for interpolation
+  f32 SimulationAlpha;
+  // Steps run in the last frame, and frames that hit SIMULATION_MAX_STEPS
+  u32 SimulationSteps;
+  u32 SimulationOverloads;
 
   f32 FPS;
   i32 MCPF;
@@ -319,6 +493,8 @@ typedef struct game_state {
 
   camera Camera;
   b32 ShowCameraDebug;
+
+  b32 ShowAudioDebug;
 } game_state;
 
 typedef struct app_context {
@@ -1,317 +1,1681 @@
 #include "mixer.h"
 
-#define ADJUST_VOLUME(Sample, Volume) (((Sample)*(Volume))/AUDIO_MAX_VOLUME)
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// audio_command_queue / audio_release_queue
+
+// Called only from the game thread
+internal b32 AudioCommandQueuePush(audio_command_queue *Queue, audio_command *Command)
+{
+  u32 WriteIndex = Queue->WriteIndex;
+  if (WriteIndex - AtomicLoadAcquireU32(&Queue->ReadIndex) >= AUDIO_COMMAND_QUEUE_SIZE)
+  {
+    return(false);
+  }
+
+  Queue->Commands[WriteIndex & (AUDIO_COMMAND_QUEUE_SIZE - 1)] = *Command;
+  AtomicStoreReleaseU32(&Queue->WriteIndex, WriteIndex + 1);
+  return(true);
+}
+
+// Called only from the audio thread
+internal b32 AudioCommandQueuePop(audio_command_queue *Queue, audio_command *Command)
+{
+  u32 ReadIndex = Queue->ReadIndex;
+  if (ReadIndex == AtomicLoadAcquireU32(&Queue->WriteIndex))
+  {
+    return(false);
+  }
+
+  *Command = Queue->Commands[ReadIndex & (AUDIO_COMMAND_QUEUE_SIZE - 1)];
+  AtomicStoreReleaseU32(&Queue->ReadIndex, ReadIndex + 1);
+  return(true);
+}
+
+// Called only from the audio thread
+internal void AudioReleaseQueuePush(audio_release_queue *Queue, u32 Slot, stb_vorbis *Decoder)
+{
+  u32 WriteIndex = Queue->WriteIndex;
+  Assert(WriteIndex - AtomicLoadAcquireU32(&Queue->ReadIndex) < AUDIO_MAX_VOICES);
+
+  audio_voice_release *Release = Queue->Releases + (WriteIndex & (AUDIO_MAX_VOICES - 1));
+  Release->Slot = Slot;
+  Release->Decoder = Decoder;
+  AtomicStoreReleaseU32(&Queue->WriteIndex, WriteIndex + 1);
+}
+
+// Called only from the game thread
+internal b32 AudioReleaseQueuePop(audio_release_queue *Queue, audio_voice_release *Release)
+{
+  u32 ReadIndex = Queue->ReadIndex;
+  if (ReadIndex == AtomicLoadAcquireU32(&Queue->WriteIndex))
+  {
+    return(false);
+  }
+
+  *Release = Queue->Releases[ReadIndex & (AUDIO_MAX_VOICES - 1)];
+  AtomicStoreReleaseU32(&Queue->ReadIndex, ReadIndex + 1);
+  return(true);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// audio_voice_pool
+
+// Returns the voice index of the given handle, or -1 if the handle is stale.
+internal i32 AudioVoicePoolLookup(audio_voice_pool *Pool, playing_sound Sound)
+{
+  i32 Result = -1;
+
+  if (Sound.Slot < AUDIO_MAX_VOICES &&
+      (Sound.Generation & 1) &&
+      Pool->SlotGeneration[Sound.Slot] == Sound.Generation)
+  {
+    Result = Pool->SlotToVoice[Sound.Slot];
+  }
+
+  return(Result);
+}
+
+internal void AudioVoicePoolSetVolume(audio_voice_pool *Pool, u32 Voice, v2 Volume)
+{
+  foreach (Channel, 2)
+  {
+    Pool->Volume[Channel][Voice] = Volume.E[Channel];
+    Pool->TargetVolume[Channel][Voice] = Volume.E[Channel];
+    Pool->dVolume[Channel][Voice] = 0.0f;
+  }
+}
+
+internal void AudioVoicePoolFadeVolume(audio_voice_pool *Pool, u32 Voice, v2 TargetVolume, f32 FadeDurationSeconds)
+{
+  if (FadeDurationSeconds <= 0.0f)
+  {
+    // Instantly change the volume of the sound
+    AudioVoicePoolSetVolume(Pool, Voice, TargetVolume);
+  }
+  else
+  {
+    f32 OneOverFade = 1.0f / FadeDurationSeconds;
+    foreach (Channel, 2)
+    {
+      Pool->TargetVolume[Channel][Voice] = TargetVolume.E[Channel];
+      Pool->dVolume[Channel][Voice] = OneOverFade * (TargetVolume.E[Channel] - Pool->Volume[Channel][Voice]);
+    }
+  }
+}
+
+// Moves the last voice into the slot of the removed voice so that voices stay
+// densely packed. Returns the removed voice's decoder, which the caller is
+// responsible for closing.
+internal stb_vorbis* AudioVoicePoolRemove(audio_voice_pool *Pool, u32 Voice)
+{
+  Assert(Voice < Pool->NumVoices);
+
+  stb_vorbis *Result = Pool->Decoder[Voice];
+
+  u32 Slot = Pool->VoiceToSlot[Voice];
+  Pool->SlotGeneration[Slot] = 0;
+
+  u32 Last = --Pool->NumVoices;
+  if (Voice != Last)
+  {
+    Pool->VoiceToSlot[Voice] = Pool->VoiceToSlot[Last];
+    Pool->SlotToVoice[Pool->VoiceToSlot[Voice]] = Voice;
+    Pool->Sound[Voice] = Pool->Sound[Last];
+    Pool->Decoder[Voice] = Pool->Decoder[Last];
+    Pool->PCMFrame[Voice] = Pool->PCMFrame[Last];
+    Pool->Loop[Voice] = Pool->Loop[Last];
+    Pool->Priority[Voice] = Pool->Priority[Last];
+    Pool->Bus[Voice] = Pool->Bus[Last];
+    Pool->Virtual[Voice] = Pool->Virtual[Last];
+    Pool->StreamFrame[Voice] = Pool->StreamFrame[Last];
+    Pool->Stopping[Voice] = Pool->Stopping[Last];
+    Pool->Finished[Voice] = Pool->Finished[Last];
+    Pool->Pending[Voice] = Pool->Pending[Last];
+    Pool->SeekState[Voice] = Pool->SeekState[Last];
+    Pool->Pitch[Voice] = Pool->Pitch[Last];
+    Pool->ResampleFraction[Voice] = Pool->ResampleFraction[Last];
+    foreach (Channel, 2)
+    {
+      Pool->Volume[Channel][Voice] = Pool->Volume[Channel][Last];
+      Pool->TargetVolume[Channel][Voice] = Pool->TargetVolume[Channel][Last];
+      Pool->dVolume[Channel][Voice] = Pool->dVolume[Channel][Last];
+      Pool->SavedVolume[Channel][Voice] = Pool->SavedVolume[Channel][Last];
+      Pool->SpatialGain[Channel][Voice] = Pool->SpatialGain[Channel][Last];
+      Pool->SpatialTarget[Channel][Voice] = Pool->SpatialTarget[Channel][Last];
+    }
+    Pool->Positional[Voice] = Pool->Positional[Last];
+    Pool->PositionX[Voice] = Pool->PositionX[Last];
+    Pool->PositionY[Voice] = Pool->PositionY[Last];
+  }
+
+  Pool->Decoder[Last] = NULL;
+  return(Result);
+}
+
+// Empties the slot's ring, leaving silent history behind the read position so
+// the first frames can be filtered.
+internal void AudioVoiceResetRing(audio_voice_pool *Pool, u32 Voice)
+{
+  u32 Slot = Pool->VoiceToSlot[Voice];
+  f32 *Ring = Pool->Ring[Slot];
+  ZeroMemory((u8*)Ring, AUDIO_RESAMPLE_HISTORY_FRAMES * 2 * sizeof(f32));
+  ZeroMemory((u8*)(Ring + 2*AUDIO_VOICE_RING_FRAMES), AUDIO_RESAMPLE_HISTORY_FRAMES * 2 * sizeof(f32));
+  Pool->RingReadFrame[Slot] = AUDIO_RESAMPLE_HISTORY_FRAMES;
+  Pool->RingWriteFrame[Slot] = AUDIO_RESAMPLE_HISTORY_FRAMES;
+  Pool->EndOfStream[Slot] = false;
+  Pool->ResampleFraction[Voice] = 0.0f;
+}
+
+// Decodes into the contiguous free space of the slot's ring until the ring is
+// full or the stream ends. Looping sounds are rewound here, so the loop point
+// is spliced into the ring and the mixer never sees the end of the stream.
+//
+// NOTE: The history frames behind the read position are never overwritten, and
+// frames decoded into the start of the ring are mirrored past its end.
+internal void AudioVoiceDecode(audio_voice_pool *Pool, u32 Voice)
+{
+  u32 Slot = Pool->VoiceToSlot[Voice];
+  u32 Channels = Pool->Sound[Voice].Channels;
+  f32 *Ring = Pool->Ring[Slot];
+  b32 Rewound = false;
+
+  while (!Pool->EndOfStream[Slot])
+  {
+    u32 UsedFrames = (Pool->RingWriteFrame[Slot] - Pool->RingReadFrame[Slot]) + AUDIO_RESAMPLE_HISTORY_FRAMES;
+    u32 FreeFrames = AUDIO_VOICE_RING_FRAMES - Min(UsedFrames, AUDIO_VOICE_RING_FRAMES);
+    if (FreeFrames == 0)
+    {
+      break;
+    }
+
+    u32 WriteIndex = Pool->RingWriteFrame[Slot] & (AUDIO_VOICE_RING_FRAMES - 1);
+    u32 SpanFrames = Min(FreeFrames, AUDIO_VOICE_RING_FRAMES - WriteIndex);
+    f32 *Span = Ring + 2*WriteIndex;
+
+    u32 DecodedFrames = 0;
+    sound *Sound = Pool->Sound + Voice;
+    if (Sound->PCM)
+    {
+      // NOTE: Cached sounds are already decoded to stereo, so just copy
+      DecodedFrames = Min(SpanFrames, Sound->PCMFrames - Pool->PCMFrame[Voice]);
+      MemoryCopy(Span, Sound->PCM + 2*Pool->PCMFrame[Voice], DecodedFrames * 2 * sizeof(f32));
+      Pool->PCMFrame[Voice] += DecodedFrames;
+    }
+    else if (Channels >= 2)
+    {
+      DecodedFrames = stb_vorbis_get_samples_float_interleaved(Pool->Decoder[Voice], 2, Span, 2*SpanFrames);
+    }
+    else
+    {
+      // NOTE: Mono sounds are played on both channels. Decode into the front
+      // of the span then spread out backwards so nothing is overwritten
+      // before it is read.
+      DecodedFrames = stb_vorbis_get_samples_float_interleaved(Pool->Decoder[Voice], 1, Span, SpanFrames);
+      for (i32 Frame = (i32)DecodedFrames - 1; Frame >= 0; --Frame)
+      {
+        Span[2*Frame + 1] = Span[2*Frame + 0] = Span[Frame];
+      }
+    }
+
+    if (WriteIndex < AUDIO_RESAMPLE_MAX_TAPS)
+    {
+      u32 MirrorFrames = Min(DecodedFrames, AUDIO_RESAMPLE_MAX_TAPS - WriteIndex);
+      MemoryCopy(Ring + 2*(AUDIO_VOICE_RING_FRAMES + WriteIndex), Span, MirrorFrames * 2 * sizeof(f32));
+    }
+
+    Pool->RingWriteFrame[Slot] += DecodedFrames;
+
+    if (DecodedFrames > 0)
+    {
+      Rewound = false;
+    }
+    else
+    {
+      // NOTE: Only rewind once until more data is decoded so that an empty
+      // looping sound can't spin here forever.
+      if (Pool->Loop[Voice] && !Rewound)
+      {
+        if (Sound->PCM)
+        {
+          Pool->PCMFrame[Voice] = 0;
+        }
+        else
+        {
+          stb_vorbis_seek_start(Pool->Decoder[Voice]);
+        }
+        Rewound = true;
+      }
+      else
+      {
+        Pool->EndOfStream[Slot] = true;
+      }
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// audio_player (game thread)
+
+internal void AudioPlayerSendCommand(audio_player *Player, audio_command *Command)
+{
+  if (!AudioCommandQueuePush(&Player->Commands, Command))
+  {
+    fprintf(stderr, "error: audio: command queue full, dropping command\n");
+  }
+}
 
 internal void AudioPlayerStopAll(audio_player* Player, f32 FadeOutDurationSeconds)
 {
-  if (Player->FirstPlayingSound == NULL)
+  audio_command Command = {};
+  Command.Type = AUDIO_COMMAND_stop_all;
+  Command.FadeDurationSeconds = FadeOutDurationSeconds;
+  AudioPlayerSendCommand(Player, &Command);
+}
+
+internal void AudioPlayerStartAll(audio_player* Player, f32 FadeInDurationSeconds)
+{
+  audio_command Command = {};
+  Command.Type = AUDIO_COMMAND_start_all;
+  Command.FadeDurationSeconds = FadeInDurationSeconds;
+  AudioPlayerSendCommand(Player, &Command);
+}
+
+// NOTE: A handle stays valid until the game thread learns that the audio thread
+// has finished with it, so a sound may have just finished playing even though
+// its handle is still valid.
+internal b32 PlayingSoundIsValid(audio_player *Player, playing_sound Sound)
+{
+  b32 Result = (Sound.Slot < AUDIO_MAX_VOICES &&
+                (Sound.Generation & 1) &&
+                Player->SlotGeneration[Sound.Slot] == Sound.Generation);
+  return(Result);
+}
+
+internal void PlayingSoundStop(audio_player *Player, playing_sound Sound, f32 FadeOutDurationSeconds)
+{
+  if (!PlayingSoundIsValid(Player, Sound))
+  {
+    return;
+  }
+
+  audio_command Command = {};
+  Command.Type = AUDIO_COMMAND_stop;
+  Command.Handle = Sound;
+  Command.FadeDurationSeconds = FadeOutDurationSeconds;
+  AudioPlayerSendCommand(Player, &Command);
+}
+
+internal void PlayingSoundChangeVolume(audio_player *Player, playing_sound Sound, v2 TargetVolume, f32 FadeDurationSeconds)
+{
+  if (!PlayingSoundIsValid(Player, Sound))
+  {
+    return;
+  }
+
+  audio_command Command = {};
+  Command.Type = AUDIO_COMMAND_change_volume;
+  Command.Handle = Sound;
+  Command.Volume = TargetVolume;
+  Command.FadeDurationSeconds = FadeDurationSeconds;
+  AudioPlayerSendCommand(Player, &Command);
+}
+
+internal void PlayingSoundChangeLooping(audio_player *Player, playing_sound Sound, b32 Loop)
+{
+  if (!PlayingSoundIsValid(Player, Sound))
+  {
+    return;
+  }
+
+  audio_command Command = {};
+  Command.Type = AUDIO_COMMAND_change_looping;
+  Command.Handle = Sound;
+  Command.Loop = Loop;
+  AudioPlayerSendCommand(Player, &Command);
+}
+
+// Pitch is a playback rate multiplier, so 2.0 plays an octave up at double
+// speed.
+internal void PlayingSoundChangePitch(audio_player *Player, playing_sound Sound, f32 Pitch)
+{
+  if (!PlayingSoundIsValid(Player, Sound) || Pitch <= 0.0f)
+  {
+    return;
+  }
+
+  audio_command Command = {};
+  Command.Type = AUDIO_COMMAND_change_pitch;
+  Command.Handle = Sound;
+  Command.Pitch = Pitch;
+  AudioPlayerSendCommand(Player, &Command);
+}
+
+// Moves a sound played with AudioPlayerPlaySoundAt. Does nothing to sounds
+// that were not started at a position.
+internal void PlayingSoundChangePosition(audio_player *Player, playing_sound Sound, v2 Position)
+{
+  if (!PlayingSoundIsValid(Player, Sound))
+  {
+    return;
+  }
+
+  audio_command Command = {};
+  Command.Type = AUDIO_COMMAND_set_position;
+  Command.Handle = Sound;
+  Command.Position = Position;
+  AudioPlayerSendCommand(Player, &Command);
+}
+
+// Positional sounds are attenuated and panned relative to the listener, which
+// should be moved along with the camera every frame.
+internal void AudioPlayerSetListener(audio_player *Player, v2 Position)
+{
+  audio_command Command = {};
+  Command.Type = AUDIO_COMMAND_set_listener;
+  Command.Position = Position;
+  AudioPlayerSendCommand(Player, &Command);
+}
+
+internal void AudioPlayerSetBusGain(audio_player *Player, audio_bus_id Bus, f32 Gain)
+{
+  Assert(Bus < AUDIO_BUS_COUNT);
+
+  audio_command Command = {};
+  Command.Type = AUDIO_COMMAND_set_bus_gain;
+  Command.Bus = Bus;
+  Command.Gain = Gain;
+  AudioPlayerSendCommand(Player, &Command);
+}
+
+// Replaces the effect in one slot of the bus's insert chain. Effects run in
+// slot order, and an effect of type AUDIO_EFFECT_none leaves the slot empty.
+internal void AudioPlayerSetBusEffect(audio_player *Player, audio_bus_id Bus, u32 EffectIndex, audio_effect_params Effect)
+{
+  Assert(Bus < AUDIO_BUS_COUNT);
+  Assert(EffectIndex < AUDIO_BUS_MAX_EFFECTS);
+
+  audio_command Command = {};
+  Command.Type = AUDIO_COMMAND_set_bus_effect;
+  Command.Bus = Bus;
+  Command.EffectIndex = EffectIndex;
+  Command.Effect = Effect;
+
+  if (Effect.Type == AUDIO_EFFECT_reverb)
+  {
+    // NOTE: Each slot keeps its delay lines once allocated. Only the audio
+    // thread ever touches them, so a new reverb can reuse them straight away.
+    f32 **Lines = &Player->ReverbLines[Bus][EffectIndex];
+    if (!*Lines)
+    {
+      *Lines = ArenaPushArray(&Player->AudioArena, AUDIO_REVERB_LINES * AUDIO_REVERB_MAX_DELAY_FRAMES, f32);
+    }
+    Command.ReverbLines = *Lines;
+  }
+
+  AudioPlayerSendCommand(Player, &Command);
+}
+
+internal void AudioPlayerSetResampleQuality(audio_player *Player, audio_resample_quality Quality)
+{
+  Assert(Quality < AUDIO_RESAMPLE_QUALITY_MAX);
+
+  audio_command Command = {};
+  Command.Type = AUDIO_COMMAND_set_resample_quality;
+  Command.Quality = Quality;
+  AudioPlayerSendCommand(Player, &Command);
+}
+
+internal void AudioPlayerSetVoiceBudget(audio_player *Player, u32 RealVoiceBudget)
+{
+  audio_command Command = {};
+  Command.Type = AUDIO_COMMAND_set_voice_budget;
+  Command.RealVoiceBudget = Min(RealVoiceBudget, AUDIO_MAX_VOICES);
+  AudioPlayerSendCommand(Player, &Command);
+}
+
+// Opens a streamed sound's decoder for a pending voice.
+//
+// NOTE: Runs on a worker. Opening the decoder parses the sound's headers and
+// decodes its first frame, and the pages just after that are read in so the
+// audio thread's first decode doesn't fault either.
+void AudioPrepareDecoderCallback(work_queue *Queue, void *Data)
+{
+  audio_prepare_job *Job = (audio_prepare_job*)Data;
+  sound *Sound = Job->Sound;
+
+  int Error;
+  stb_vorbis *Decoder = stb_vorbis_open_memory(Sound->Data, Sound->DataLength, &Error, NULL);
+  if (Decoder)
+  {
+    u32 Offset = stb_vorbis_get_file_offset(Decoder);
+    Job->Platform->Interface.AdviseFileRange(&Sound->SoundFile, Offset, AUDIO_STREAM_READ_AHEAD_BYTES, PLATFORM_FILE_ADVICE_will_need);
+  }
+  else
+  {
+    fprintf(stderr, "error: audio: unable to open decoder: stb_vorbis error code %d\n", Error);
+  }
+
+  Job->Decoder = Decoder;
+  AtomicStoreReleaseU32((u32 volatile*)&Job->Done, true);
+}
+
+// Seeks a streamed voice's decoder to where the voice is being promoted from.
+//
+// NOTE: Runs on a worker. Seeking bisects the file for the right page and
+// decodes up to the frame, and the pages after it are read in so the audio
+// thread's first decode doesn't fault.
+void AudioSeekDecoderCallback(work_queue *Queue, void *Data)
+{
+  audio_seek_job *Job = (audio_seek_job*)Data;
+
+  stb_vorbis_seek(Job->Decoder, Job->Frame);
+  u32 Offset = stb_vorbis_get_file_offset(Job->Decoder);
+  Job->Platform->Interface.AdviseFileRange(Job->File, Offset, AUDIO_STREAM_READ_AHEAD_BYTES, PLATFORM_FILE_ADVICE_will_need);
+
+  AtomicStoreReleaseU32((u32 volatile*)&Job->Done, true);
+}
+
+// Moves a pending voice along: once its sound has loaded its decoder is asked
+// for, and once that is ready the voice is sent its start command. Sounds that
+// failed to load are sent one too, which retires the voice.
+internal void AudioPlayerPrepareVoice(audio_player *Player, u32 Slot)
+{
+  audio_prepare_job *Job = Player->Prepare + Slot;
+  sound *Sound = Job->Sound;
+  b32 Ready = false;
+
+  if (!Job->Queued)
+  {
+    if (SoundIsLoaded(Sound))
+    {
+      if (Sound->PCM)
+      {
+        Ready = true;
+      }
+      else
+      {
+        // NOTE: The voice is silent until its decoder is open, so jump ahead
+        // of any asset loads.
+        Job->Queued = true;
+        void *Data = (void*)Job;
+        Job->Platform->Interface.WorkQueueAddEntries(Job->Platform->Input.WorkQueue, WORK_QUEUE_PRIORITY_high, AudioPrepareDecoderCallback, &Data, 1, NULL);
+      }
+    }
+    else if (!SoundIsLoading(Sound))
+    {
+      Ready = true;
+    }
+  }
+  else
+  {
+    Ready = AtomicLoadAcquireU32((u32 volatile*)&Job->Done);
+  }
+
+  if (Ready)
+  {
+    audio_command Command = {};
+    Command.Type = AUDIO_COMMAND_start;
+    Command.Handle.Slot = Slot;
+    Command.Handle.Generation = Player->SlotGeneration[Slot];
+    Command.Sound = SoundIsLoaded(Sound) ? *Sound : sound{};
+    Command.Decoder = Job->Decoder;
+
+    // NOTE: If the queue is full this is tried again on the next update
+    if (AudioCommandQueuePush(&Player->Commands, &Command))
+    {
+      Job->Waiting = false;
+      if (Job->Decoder)
+      {
+        Player->SlotFile[Slot] = Sound->SoundFile;
+      }
+    }
+  }
+}
+
+// Hands out a slot for the sound and sends the play command, which the caller
+// has filled in with everything but that. Sounds in the PCM cache start on
+// the next mix. Anything else starts pending and is started from
+// AudioPlayerUpdate once its sound has loaded and a worker has opened its
+// decoder, so this never blocks.
+internal playing_sound AudioPlayerStartSound(audio_player *Player, platform_state *Platform, sound *Sound, audio_command *Command)
+{
+  playing_sound Result = {};
+
+  b32 Loaded = SoundIsLoaded(Sound);
+  if (!Loaded && !SoundIsLoading(Sound))
+  {
+    fprintf(stderr, "error: audio: sound is not loaded, dropping sound\n");
+    return(Result);
+  }
+
+  if (Player->NumFreeSlots == 0)
+  {
+    fprintf(stderr, "error: audio: out of voices, dropping sound\n");
+    return(Result);
+  }
+
+  u32 Slot = Player->FreeSlots[Player->NumFreeSlots - 1];
+
+  Command->Type = AUDIO_COMMAND_play;
+  Command->Handle.Slot = Slot;
+  Command->Handle.Generation = Player->SlotGeneration[Slot] + 1;
+  if (Loaded && Sound->PCM)
+  {
+    Command->Sound = *Sound;
+  }
+  else
+  {
+    Command->Pending = true;
+  }
+
+  if (!AudioCommandQueuePush(&Player->Commands, Command))
+  {
+    fprintf(stderr, "error: audio: command queue full, dropping sound\n");
+    return(Result);
+  }
+
+  --Player->NumFreeSlots;
+  ++Player->SlotGeneration[Slot];
+
+  // NOTE: The audio thread is done with the slot, so its stream offset can be
+  // reset from here.
+  Player->SlotFile[Slot] = {};
+  Player->SlotEvictedBytes[Slot] = 0;
+  AtomicStoreReleaseU32(&Player->StreamOffset[Slot], 0);
+
+  if (Command->Pending)
+  {
+    audio_prepare_job *Job = Player->Prepare + Slot;
+    *Job = {};
+    Job->Platform = Platform;
+    Job->Sound = Sound;
+    Job->Waiting = true;
+    AudioPlayerPrepareVoice(Player, Slot);
+  }
+
+  Result = Command->Handle;
+  return(Result);
+}
+
+// NOTE: Sounds that are still loading are played once they have loaded.
+// Callers that would rather not wait can check SoundIsLoaded first.
+internal playing_sound AudioPlayerPlaySound(audio_player* Player, platform_state *Platform, sound *Sound, v2 StartVolume, b32 Loop, u32 Priority, audio_bus_id Bus)
+{
+  Assert(Bus < AUDIO_BUS_COUNT);
+
+  audio_command Command = {};
+  Command.Volume = StartVolume;
+  Command.Loop = Loop;
+  Command.Priority = Priority;
+  Command.Bus = Bus;
+  return(AudioPlayerStartSound(Player, Platform, Sound, &Command));
+}
+
+// Plays a sound from a point in the world. Its stereo volume is worked out
+// from where it is relative to the listener, so Volume is just a loudness.
+internal playing_sound AudioPlayerPlaySoundAt(audio_player *Player, platform_state *Platform, sound *Sound, v2 Position, f32 Volume, b32 Loop, u32 Priority, audio_bus_id Bus)
+{
+  Assert(Bus < AUDIO_BUS_COUNT);
+
+  audio_command Command = {};
+  Command.Volume = V2(Volume, Volume);
+  Command.Loop = Loop;
+  Command.Priority = Priority;
+  Command.Bus = Bus;
+  Command.Positional = true;
+  Command.Position = Position;
+  return(AudioPlayerStartSound(Player, Platform, Sound, &Command));
+}
+
+// Takes back the slots of voices the audio thread has finished with.
+internal void AudioPlayerCollectReleases(audio_player *Player)
+{
+  audio_voice_release Release;
+  while (AudioReleaseQueuePop(&Player->Releases, &Release))
+  {
+    stb_vorbis_close(Release.Decoder);
+    ++Player->SlotGeneration[Release.Slot];
+    Player->SlotFile[Release.Slot] = {};
+    Player->FreeSlots[Player->NumFreeSlots++] = Release.Slot;
+  }
+}
+
+// Asks the platform to read in the part of each streamed file just ahead of
+// the voices playing it and to drop the part behind them, so a long track
+// only ever holds a few hundred KB of its file in memory.
+//
+// NOTE: Several voices may stream the same file, so pages are only dropped
+// behind the voice furthest back in it. Looping voices that rewind can still
+// fault pages in on the audio thread.
+internal void AudioPlayerUpdateStreams(audio_player *Player, platform_state *Platform)
+{
+  foreach (Slot, AUDIO_MAX_VOICES)
+  {
+    platform_mapped_file *File = Player->SlotFile + Slot;
+    // NOTE: Slots that are playing have odd generations
+    if (!File->Data || !(Player->SlotGeneration[Slot] & 1))
+    {
+      continue;
+    }
+
+    u32 Offset = AtomicLoadAcquireU32(&Player->StreamOffset[Slot]);
+    Platform->Interface.AdviseFileRange(File, Offset, AUDIO_STREAM_READ_AHEAD_BYTES, PLATFORM_FILE_ADVICE_will_need);
+    if (Offset + AUDIO_STREAM_READ_AHEAD_BYTES > File->SizeBytes)
+    {
+      // Looping sounds carry on from the start
+      Platform->Interface.AdviseFileRange(File, 0, AUDIO_STREAM_READ_AHEAD_BYTES, PLATFORM_FILE_ADVICE_will_need);
+    }
+
+    u32 Earliest = Offset;
+    foreach (Other, AUDIO_MAX_VOICES)
+    {
+      if (Player->SlotFile[Other].Data == File->Data && (Player->SlotGeneration[Other] & 1))
+      {
+        Earliest = Min(Earliest, AtomicLoadAcquireU32(&Player->StreamOffset[Other]));
+      }
+    }
+
+    if (Offset < Player->SlotEvictedBytes[Slot])
+    {
+      // The voice has gone back to an earlier part of the file
+      Player->SlotEvictedBytes[Slot] = 0;
+    }
+
+    if (Earliest > AUDIO_STREAM_KEEP_BEHIND_BYTES)
+    {
+      u32 EvictTo = Earliest - AUDIO_STREAM_KEEP_BEHIND_BYTES;
+      u32 EvictFrom = Player->SlotEvictedBytes[Slot];
+      if (EvictTo > EvictFrom)
+      {
+        Platform->Interface.AdviseFileRange(File, EvictFrom, EvictTo - EvictFrom, PLATFORM_FILE_ADVICE_dont_need);
+        Player->SlotEvictedBytes[Slot] = EvictTo;
+      }
+    }
+  }
+}
+
+internal void AudioPlayerUpdate(audio_player *Player, platform_state *Platform)
+{
+  AudioPlayerCollectReleases(Player);
+
+  foreach (Slot, AUDIO_MAX_VOICES)
+  {
+    if (Player->Prepare[Slot].Waiting)
+    {
+      AudioPlayerPrepareVoice(Player, Slot);
+    }
+
+    // NOTE: The voice is silent until its decoder is seeked, so jump ahead of
+    // any asset loads.
+    audio_seek_job *Job = Player->Seeks + Slot;
+    if (AtomicLoadAcquireU32((u32 volatile*)&Job->Requested))
+    {
+      Job->Requested = false;
+      Job->Platform = Platform;
+      Job->File = Player->SlotFile + Slot;
+      void *Data = (void*)Job;
+      Platform->Interface.WorkQueueAddEntries(Platform->Input.WorkQueue, WORK_QUEUE_PRIORITY_high, AudioSeekDecoderCallback, &Data, 1, NULL);
+    }
+  }
+
+  AudioPlayerUpdateStreams(Player, Platform);
+}
+
+internal audio_mix_stats AudioPlayerGetStats(audio_player *Player)
+{
+  audio_mix_snapshot *Snapshot = &Player->Snapshot;
+  audio_mix_stats Result;
+  u32 Sequence;
+
+  do
+  {
+    Sequence = AtomicLoadAcquireU32(&Snapshot->Sequence);
+    Result = Snapshot->Stats;
+    CompletePreviousReadsBeforeFutureReads;
+  } while ((Sequence & 1) || Sequence != AtomicLoadAcquireU32(&Snapshot->Sequence));
+
+  return(Result);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mix kernels
+
+// Accumulates Src * Gain into Bus for FrameCount interleaved stereo frames.
+// The gain ramps linearly by dGain per frame and is clamped so that it never
+// passes Target. Returns the gain after the last frame.
+internal v2 MixVoiceBlock(f32 *Bus, f32 *Src, u32 FrameCount, v2 Gain, v2 dGain, v2 Target)
+{
+  v2 Lo = V2(Min(Gain.X, Target.X), Min(Gain.Y, Target.Y));
+  v2 Hi = V2(Max(Gain.X, Target.X), Max(Gain.Y, Target.Y));
+  u32 Frame = 0;
+
+#if defined(__AVX2__)
   {
-    return;
+    // NOTE: 4 interleaved stereo frames per vector
+    __m256 G = _mm256_setr_ps(Gain.X, Gain.Y,
+                              Gain.X + dGain.X, Gain.Y + dGain.Y,
+                              Gain.X + 2*dGain.X, Gain.Y + 2*dGain.Y,
+                              Gain.X + 3*dGain.X, Gain.Y + 3*dGain.Y);
+    __m256 Step = _mm256_setr_ps(4*dGain.X, 4*dGain.Y, 4*dGain.X, 4*dGain.Y,
+                                 4*dGain.X, 4*dGain.Y, 4*dGain.X, 4*dGain.Y);
+    __m256 VLo = _mm256_setr_ps(Lo.X, Lo.Y, Lo.X, Lo.Y, Lo.X, Lo.Y, Lo.X, Lo.Y);
+    __m256 VHi = _mm256_setr_ps(Hi.X, Hi.Y, Hi.X, Hi.Y, Hi.X, Hi.Y, Hi.X, Hi.Y);
+    for (; Frame + 4 <= FrameCount; Frame += 4)
+    {
+      __m256 V = _mm256_min_ps(_mm256_max_ps(G, VLo), VHi);
+      __m256 S = _mm256_loadu_ps(Src + 2*Frame);
+      __m256 B = _mm256_loadu_ps(Bus + 2*Frame);
+      _mm256_storeu_ps(Bus + 2*Frame, _mm256_add_ps(B, _mm256_mul_ps(S, V)));
+      G = _mm256_add_ps(G, Step);
+    }
   }
-
-  playing_sound* Voice = Player->FirstPlayingSound;
-  while (Voice)
+#elif defined(__SSE2__)
   {
+    // NOTE: 2 interleaved stereo frames per vector
+    __m128 G = _mm_setr_ps(Gain.X, Gain.Y, Gain.X + dGain.X, Gain.Y + dGain.Y);
+    __m128 Step = _mm_setr_ps(2*dGain.X, 2*dGain.Y, 2*dGain.X, 2*dGain.Y);
+    __m128 VLo = _mm_setr_ps(Lo.X, Lo.Y, Lo.X, Lo.Y);
+    __m128 VHi = _mm_setr_ps(Hi.X, Hi.Y, Hi.X, Hi.Y);
+    for (; Frame + 2 <= FrameCount; Frame += 2)
     {
-      Voice->SavedVolume = Voice->CurrentVolume;
+      __m128 V = _mm_min_ps(_mm_max_ps(G, VLo), VHi);
+      __m128 S = _mm_loadu_ps(Src + 2*Frame);
+      __m128 B = _mm_loadu_ps(Bus + 2*Frame);
+      _mm_storeu_ps(Bus + 2*Frame, _mm_add_ps(B, _mm_mul_ps(S, V)));
+      G = _mm_add_ps(G, Step);
     }
+  }
+#endif
 
-    PlayingSoundChangeVolume(Voice, V2(0.0f, 0.0f), FadeOutDurationSeconds);
-    Voice = Voice->Next;
+  for (; Frame < FrameCount; ++Frame)
+  {
+    f32 GainL = Clamp(Gain.X + Frame*dGain.X, Lo.X, Hi.X);
+    f32 GainR = Clamp(Gain.Y + Frame*dGain.Y, Lo.Y, Hi.Y);
+    Bus[2*Frame + 0] += Src[2*Frame + 0] * GainL;
+    Bus[2*Frame + 1] += Src[2*Frame + 1] * GainR;
   }
+
+  v2 Result = V2(Clamp(Gain.X + FrameCount*dGain.X, Lo.X, Hi.X),
+                 Clamp(Gain.Y + FrameCount*dGain.Y, Lo.Y, Hi.Y));
+  return(Result);
 }
 
-internal void AudioPlayerStartAll(audio_player* Player, f32 FadeInDurationSeconds)
+// Converts FrameCount interleaved stereo frames from the bus into 16-bit
+// samples, applying the master volume.
+//
+// NOTE: The master bus's limiter keeps the mix in range, saturating here only
+// catches a master volume above 1.
+internal void MixBusToOutput(i16 *Out, f32 *Bus, u32 FrameCount, v2 MasterVolume)
 {
-  if (Player->FirstPlayingSound == NULL)
+  u32 Frame = 0;
+  v2 Scale = 32767.0f * MasterVolume;
+
+#if defined(__SSE2__)
   {
-    return;
+    __m128 VScale = _mm_setr_ps(Scale.X, Scale.Y, Scale.X, Scale.Y);
+    for (; Frame + 4 <= FrameCount; Frame += 4)
+    {
+      __m128i A = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(Bus + 2*Frame + 0), VScale));
+      __m128i B = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(Bus + 2*Frame + 4), VScale));
+      _mm_storeu_si128((__m128i*)(Out + 2*Frame), _mm_packs_epi32(A, B));
+    }
   }
+#endif
 
-  playing_sound* Voice = Player->FirstPlayingSound;
-  while (Voice != NULL)
+  for (; Frame < FrameCount; ++Frame)
   {
-    PlayingSoundChangeVolume(Voice, Voice->SavedVolume, FadeInDurationSeconds);
-    Voice = Voice->Next;
+    foreach (Channel, 2)
+    {
+      f32 Value = Bus[2*Frame + Channel] * Scale.E[Channel];
+      Out[2*Frame + Channel] = (i16)Clamp(Round(Value), -32768.0f, 32767.0f);
+    }
   }
 }
 
-internal void PlayingSoundChangeVolume(playing_sound* Sound, v2 TargetVolume, f32 FadeDurationSeconds)
+///////////////////////////////////////////////////////////////////////////////
+// resampling
+
+// Fills one phase of a TapCount tap filter bank. Tap T sits at source frame
+// (T - TapCount/2 + 1) relative to the current frame, and Fraction is the
+// output's distance past the current frame.
+internal void AudioResamplerBuildPhase(f32 *Kernel, u32 TapCount, f32 Fraction, f32 Cutoff)
 {
-  if (!Sound->IsPlaying)
+  f32 HalfWidth = (f32)(TapCount / 2);
+  f32 Sum = 0.0f;
+
+  foreach (Tap, TapCount)
   {
-    return;
+    f32 X = (f32)Tap - (HalfWidth - 1.0f) - Fraction;
+    f32 Sinc = (X == 0.0f) ? 1.0f : sinf(PI * Cutoff * X) / (PI * Cutoff * X);
+    f32 W = Clamp(X / HalfWidth, -1.0f, 1.0f);
+    f32 Window = 0.42f + 0.5f*cosf(PI * W) + 0.08f*cosf(2.0f * PI * W);
+    Kernel[2*Tap] = Sinc * Window;
+    Sum += Kernel[2*Tap];
   }
 
-  if (FadeDurationSeconds <= 0.0f)
+  // NOTE: Normalize for unity gain at DC and duplicate for both channels
+  foreach (Tap, TapCount)
   {
-    // Instantly change the volume of the sound
-    Sound->CurrentVolume = TargetVolume;
-    Sound->TargetVolume = TargetVolume;
-    Sound->dCurrentVolume = V2(0.0f, 0.0f);
+    Kernel[2*Tap] /= Sum;
+    Kernel[2*Tap + 1] = Kernel[2*Tap];
   }
-  else
+}
+
+internal void AudioResamplerInit(audio_resampler *Resampler, audio_resample_quality Quality)
+{
+  Resampler->Quality = Quality;
+
+  // NOTE: Cutoffs sit a little below Nyquist to leave room for each filter's
+  // transition band. They don't track the resampling ratio, so heavily
+  // pitched up voices can alias.
+  foreach (Phase, AUDIO_RESAMPLE_PHASES + 1)
   {
-    Sound->TargetVolume = TargetVolume;
-    f32 OneOverFade = 1.0f / FadeDurationSeconds;
-    Sound->dCurrentVolume = OneOverFade * (Sound->TargetVolume - Sound->CurrentVolume);
+    f32 Fraction = (f32)Phase / (f32)AUDIO_RESAMPLE_PHASES;
+    AudioResamplerBuildPhase(Resampler->MediumKernel[Phase], 8, Fraction, 0.85f);
+    AudioResamplerBuildPhase(Resampler->HighKernel[Phase], 16, Fraction, 0.9f);
   }
 }
 
-internal void PlayingSoundChangeLooping(playing_sound* Sound, b32 Loop)
+// Applies one phase of a filter bank to TapCount interleaved stereo frames.
+internal void AudioResampleFrame(f32 *Out, f32 *Src, f32 *Kernel, u32 TapCount)
 {
-  if (!Sound->IsPlaying)
+  u32 Tap = 0;
+  f32 Left = 0.0f;
+  f32 Right = 0.0f;
+
+#if defined(__AVX2__)
   {
-    return;
+    // NOTE: 4 taps per vector
+    __m256 Acc = _mm256_setzero_ps();
+    for (; Tap + 4 <= TapCount; Tap += 4)
+    {
+      Acc = _mm256_add_ps(Acc, _mm256_mul_ps(_mm256_loadu_ps(Src + 2*Tap), _mm256_loadu_ps(Kernel + 2*Tap)));
+    }
+    __m128 Sum = _mm_add_ps(_mm256_castps256_ps128(Acc), _mm256_extractf128_ps(Acc, 1));
+    Sum = _mm_add_ps(Sum, _mm_movehl_ps(Sum, Sum));
+    Left = _mm_cvtss_f32(Sum);
+    Right = _mm_cvtss_f32(_mm_shuffle_ps(Sum, Sum, _MM_SHUFFLE(1, 1, 1, 1)));
+  }
+#elif defined(__SSE2__)
+  {
+    // NOTE: 2 taps per vector
+    __m128 Acc = _mm_setzero_ps();
+    for (; Tap + 2 <= TapCount; Tap += 2)
+    {
+      Acc = _mm_add_ps(Acc, _mm_mul_ps(_mm_loadu_ps(Src + 2*Tap), _mm_loadu_ps(Kernel + 2*Tap)));
+    }
+    __m128 Sum = _mm_add_ps(Acc, _mm_movehl_ps(Acc, Acc));
+    Left = _mm_cvtss_f32(Sum);
+    Right = _mm_cvtss_f32(_mm_shuffle_ps(Sum, Sum, _MM_SHUFFLE(1, 1, 1, 1)));
+  }
+#endif
+
+  for (; Tap < TapCount; ++Tap)
+  {
+    Left += Src[2*Tap + 0] * Kernel[2*Tap + 0];
+    Right += Src[2*Tap + 1] * Kernel[2*Tap + 1];
   }
 
-  Sound->Loop = Loop;
+  Out[0] = Left;
+  Out[1] = Right;
 }
 
-internal b32 PlayingSoundCompleted(playing_sound* PlayingSound)
+// Resamples up to FrameCount frames from a voice's ring into Out, advancing
+// the voice's source position by Step frames per output frame. Stops early if
+// the ring runs out of frames for the filter. Returns the frames written.
+internal u32 AudioResample(audio_resampler *Resampler, f32 *Out, f32 *Ring, u32 *ReadFrame, u32 WriteFrame, f32 *Fraction, f32 Step, u32 FrameCount)
 {
-  b32 Result = false;
+  u32 TapCount = 2;
+  f32 *Kernels = NULL;
+  switch (Resampler->Quality)
+  {
+  case AUDIO_RESAMPLE_QUALITY_medium: TapCount = 8; Kernels = &Resampler->MediumKernel[0][0]; break;
+  case AUDIO_RESAMPLE_QUALITY_high: TapCount = 16; Kernels = &Resampler->HighKernel[0][0]; break;
+  default: break;
+  }
 
-  if (stb_vorbis_get_sample_offset(PlayingSound->Decoder) >= (i32)PlayingSound->Sound.Samples &&
-      PlayingSound->DecodedSampleIndex >= PlayingSound->NumDecodedSamples)
+  u32 HalfTaps = TapCount / 2;
+  u32 Frame = *ReadFrame;
+  f32 Frac = *Fraction;
+  u32 Result = 0;
+
+  for (; Result < FrameCount; ++Result)
   {
-    Result = true;
+    // The filter reads up to HalfTaps frames past the current one
+    if (Frame + HalfTaps >= WriteFrame)
+    {
+      break;
+    }
+
+    u32 First = (Frame - (HalfTaps - 1)) & (AUDIO_VOICE_RING_FRAMES - 1);
+    f32 *Src = Ring + 2*First;
+    f32 *Dest = Out + 2*Result;
+
+    if (Kernels)
+    {
+      u32 Phase = (u32)(Frac * AUDIO_RESAMPLE_PHASES + 0.5f);
+      AudioResampleFrame(Dest, Src, Kernels + Phase * 2*TapCount, TapCount);
+    }
+    else
+    {
+      Dest[0] = Src[0] + Frac * (Src[2] - Src[0]);
+      Dest[1] = Src[1] + Frac * (Src[3] - Src[1]);
+    }
+
+    Frac += Step;
+    u32 Advance = (u32)Frac;
+    Frame += Advance;
+    Frac -= (f32)Advance;
   }
 
+  *ReadFrame = Frame;
+  *Fraction = Frac;
   return(Result);
 }
 
-// TODO: Find a way to call this fewer times per frame and retrieve more
-// samples at once.
-internal void GetNextDecodedSamples(playing_sound* PlayingSound, f32* Samples)
+///////////////////////////////////////////////////////////////////////////////
+// mixing (audio thread)
+
+internal void AudioPlayerProcessCommand(audio_player *Player, audio_command *Command)
 {
-  if (PlayingSound->DecodedSampleIndex < PlayingSound->NumDecodedSamples)
+  audio_voice_pool *Pool = &Player->Voices;
+
+  switch (Command->Type)
+  {
+  case AUDIO_COMMAND_play:
+  {
+    u32 Slot = Command->Handle.Slot;
+    u32 Voice = Pool->NumVoices++;
+    Assert(Voice < AUDIO_MAX_VOICES);
+
+    Pool->SlotGeneration[Slot] = Command->Handle.Generation;
+    Pool->SlotToVoice[Slot] = Voice;
+
+    Pool->VoiceToSlot[Voice] = Slot;
+    Pool->Sound[Voice] = Command->Sound;
+    Pool->Decoder[Voice] = NULL;
+    Pool->PCMFrame[Voice] = 0;
+    Pool->Loop[Voice] = Command->Loop;
+    Pool->Stopping[Voice] = false;
+    Pool->Finished[Voice] = false;
+    Pool->Pending[Voice] = Command->Pending;
+    Pool->SeekState[Voice] = AUDIO_SEEK_ready;
+    Pool->Pitch[Voice] = 1.0f;
+    Pool->Priority[Voice] = Command->Priority;
+    Pool->Bus[Voice] = Command->Bus;
+    Pool->StreamFrame[Voice] = 0;
+    AudioVoicePoolSetVolume(Pool, Voice, Command->Volume);
+    // NOTE: A voice played after a stop all comes back at its own volume, not
+    // whatever was saved by the voice that last had this index.
+    Pool->SavedVolume[0][Voice] = Command->Volume.X;
+    Pool->SavedVolume[1][Voice] = Command->Volume.Y;
+
+    // NOTE: A negative spatial gain has the voice start at its first target
+    // rather than ramping in from silence.
+    Pool->Positional[Voice] = Command->Positional;
+    Pool->PositionX[Voice] = Command->Position.X;
+    Pool->PositionY[Voice] = Command->Position.Y;
+    Pool->SpatialGain[0][Voice] = Pool->SpatialGain[1][Voice] = -1.0f;
+
+    // NOTE: Voices start out virtual and are decoded once they are given a
+    // real voice at the start of the next block.
+    Pool->Virtual[Voice] = true;
+    AudioVoiceResetRing(Pool, Voice);
+  }
+  break;
+  case AUDIO_COMMAND_start:
+  {
+    // NOTE: Pending voices are never retired before they are started, so the
+    // voice is always still here.
+    i32 Voice = AudioVoicePoolLookup(Pool, Command->Handle);
+    Assert(Voice >= 0 && Pool->Pending[Voice]);
+
+    Pool->Pending[Voice] = false;
+    Pool->Decoder[Voice] = Command->Decoder;
+    if (Command->Sound.PCM || Command->Decoder)
+    {
+      Pool->Sound[Voice] = Command->Sound;
+    }
+    else
+    {
+      // NOTE: The sound or its decoder failed to load
+      Pool->Finished[Voice] = true;
+    }
+  }
+  break;
+  case AUDIO_COMMAND_stop:
+  {
+    i32 Voice = AudioVoicePoolLookup(Pool, Command->Handle);
+    if (Voice >= 0)
+    {
+      if (Command->FadeDurationSeconds <= 0.0f)
+      {
+        Pool->Finished[Voice] = true;
+      }
+      else
+      {
+        Pool->Stopping[Voice] = true;
+        AudioVoicePoolFadeVolume(Pool, Voice, V2(0.0f, 0.0f), Command->FadeDurationSeconds);
+      }
+    }
+  }
+  break;
+  case AUDIO_COMMAND_change_volume:
   {
-    Assert((PlayingSound->NumDecodedSamples - PlayingSound->DecodedSampleIndex) >= PlayingSound->Sound.Channels);
-    Samples[0] = PlayingSound->DecodedSamples[PlayingSound->DecodedSampleIndex++];
-    if (PlayingSound->Sound.Channels >= 2) {
-      Samples[1] = PlayingSound->DecodedSamples[PlayingSound->DecodedSampleIndex++];
-    } else {
-      Samples[1] = 0;
+    i32 Voice = AudioVoicePoolLookup(Pool, Command->Handle);
+    if (Voice >= 0 && !Pool->Stopping[Voice])
+    {
+      AudioVoicePoolFadeVolume(Pool, Voice, Command->Volume, Command->FadeDurationSeconds);
     }
   }
-  else
+  break;
+  case AUDIO_COMMAND_change_looping:
   {
-    if (!PlayingSoundCompleted(PlayingSound))
-    {
-      PlayingSound->NumDecodedSamples = (
-        PlayingSound->Sound.Channels * stb_vorbis_get_samples_float_interleaved(
-          PlayingSound->Decoder,
-          PlayingSound->Sound.Channels,
-          PlayingSound->DecodedSamples,
-          ArrayCount(PlayingSound->DecodedSamples)
-        )
-      );
-      PlayingSound->DecodedSampleIndex = 0;
-      Samples[0] = PlayingSound->DecodedSamples[PlayingSound->DecodedSampleIndex++];
-      if (PlayingSound->Sound.Channels >= 2) {
-        Samples[1] = PlayingSound->DecodedSamples[PlayingSound->DecodedSampleIndex++];
-      } else {
-        Samples[1] = 0;
+    i32 Voice = AudioVoicePoolLookup(Pool, Command->Handle);
+    if (Voice >= 0)
+    {
+      Pool->Loop[Voice] = Command->Loop;
+    }
+  }
+  break;
+  case AUDIO_COMMAND_change_pitch:
+  {
+    i32 Voice = AudioVoicePoolLookup(Pool, Command->Handle);
+    if (Voice >= 0)
+    {
+      Pool->Pitch[Voice] = Command->Pitch;
+    }
+  }
+  break;
+  case AUDIO_COMMAND_stop_all:
+  {
+    foreach (Voice, Pool->NumVoices)
+    {
+      Pool->SavedVolume[0][Voice] = Pool->Volume[0][Voice];
+      Pool->SavedVolume[1][Voice] = Pool->Volume[1][Voice];
+      AudioVoicePoolFadeVolume(Pool, Voice, V2(0.0f, 0.0f), Command->FadeDurationSeconds);
+    }
+  }
+  break;
+  case AUDIO_COMMAND_start_all:
+  {
+    foreach (Voice, Pool->NumVoices)
+    {
+      if (!Pool->Stopping[Voice])
+      {
+        v2 SavedVolume = V2(Pool->SavedVolume[0][Voice], Pool->SavedVolume[1][Voice]);
+        AudioVoicePoolFadeVolume(Pool, Voice, SavedVolume, Command->FadeDurationSeconds);
       }
     }
   }
+  break;
+  case AUDIO_COMMAND_set_resample_quality:
+  {
+    Player->Resampler.Quality = Command->Quality;
+  }
+  break;
+  case AUDIO_COMMAND_set_voice_budget:
+  {
+    Player->RealVoiceBudget = Command->RealVoiceBudget;
+  }
+  break;
+  case AUDIO_COMMAND_set_position:
+  {
+    i32 Voice = AudioVoicePoolLookup(Pool, Command->Handle);
+    if (Voice >= 0)
+    {
+      Pool->PositionX[Voice] = Command->Position.X;
+      Pool->PositionY[Voice] = Command->Position.Y;
+    }
+  }
+  break;
+  case AUDIO_COMMAND_set_listener:
+  {
+    Player->Listener.Position = Command->Position;
+  }
+  break;
+  case AUDIO_COMMAND_set_bus_gain:
+  {
+    Player->Buses[Command->Bus].TargetGain = Command->Gain;
+  }
+  break;
+  case AUDIO_COMMAND_set_bus_effect:
+  {
+    audio_effect *Effect = Player->Buses[Command->Bus].Effects + Command->EffectIndex;
+    AudioEffectInit(Effect, &Command->Effect, Command->ReverbLines);
+  }
+  break;
+  default: break;
+  }
 }
 
-internal playing_sound* AudioPlayerPlaySound(audio_player* Player, sound Sound, v2 StartVolume, b32 Loop)
+internal f32 AudioVoiceStep(audio_voice_pool *Pool, u32 Voice, u32 SamplesPerSecond)
 {
-  playing_sound* Result = Player->FirstFreeSound;
+  f32 Result = Pool->Pitch[Voice] * (f32)Pool->Sound[Voice].SampleRate / (f32)SamplesPerSecond;
+  Result = Min(Result, AUDIO_MAX_RESAMPLE_STEP);
+  return(Result);
+}
 
-  if (Result == NULL)
+// Returns the voice's volume after fading for Seconds, never overshooting its
+// target.
+internal v2 AudioVoiceNextVolume(audio_voice_pool *Pool, u32 Voice, f32 Seconds)
+{
+  v2 Result;
+  foreach (Channel, 2)
   {
-    Result = ArenaPushStruct(&Player->AudioArena, playing_sound);
+    f32 Volume = Pool->Volume[Channel][Voice];
+    f32 Target = Pool->TargetVolume[Channel][Voice];
+    Volume += Seconds * Pool->dVolume[Channel][Voice];
+    Result.E[Channel] = Clamp(Volume, Min(Pool->Volume[Channel][Voice], Target), Max(Pool->Volume[Channel][Voice], Target));
   }
-  else
+  return(Result);
+}
+
+// Stores the volumes reached at the end of a block. Fades are finished once
+// they reach their target.
+internal void AudioVoiceEndBlock(audio_voice_pool *Pool, u32 Voice, v2 Volume)
+{
+  foreach (Channel, 2)
   {
-    // First free sound is no longer free, so move to the next free sound
-    Player->FirstFreeSound = Result->Next;
+    Pool->Volume[Channel][Voice] = Volume.E[Channel];
+    if (Volume.E[Channel] == Pool->TargetVolume[Channel][Voice])
+    {
+      Pool->dVolume[Channel][Voice] = 0.0f;
+    }
+    Pool->SpatialGain[Channel][Voice] = Pool->SpatialTarget[Channel][Voice];
   }
+}
 
-  Result->Sound = Sound;
+// Keeps track of where in the sound the voice is so virtual voices can pick up
+// where they should be when promoted.
+internal void AudioVoiceAdvanceStream(audio_voice_pool *Pool, u32 Voice, u32 Frames)
+{
+  u32 Length = Pool->Sound[Voice].Samples;
+  Pool->StreamFrame[Voice] += Frames;
+  if (Pool->Loop[Voice] && Length > 0)
+  {
+    Pool->StreamFrame[Voice] %= Length;
+  }
+}
 
-  int Error;
-  Result->Decoder = stb_vorbis_open_memory(Sound.Data, Sound.DataLength, &Error, NULL);
-  Assert(Result->Decoder != NULL);
+// Advances a virtual voice through its sound and its volume fades without
+// decoding or mixing anything.
+internal void AudioVoiceMixVirtual(audio_voice_pool *Pool, u32 Voice, u32 FrameCount, u32 SamplesPerSecond)
+{
+  // NOTE: Hold the stream position while the decoder is being seeked to it
+  if (Pool->SeekState[Voice] != AUDIO_SEEK_pending)
+  {
+    f32 Position = Pool->ResampleFraction[Voice] + FrameCount * AudioVoiceStep(Pool, Voice, SamplesPerSecond);
+    u32 Advance = (u32)Position;
+    Pool->ResampleFraction[Voice] = Position - (f32)Advance;
+    AudioVoiceAdvanceStream(Pool, Voice, Advance);
+    if (Advance > 0)
+    {
+      Pool->SeekState[Voice] = AUDIO_SEEK_needed;
+    }
+  }
 
-  Result->IsPlaying = true;
-  Result->CurrentVolume = StartVolume;
-  Result->TargetVolume = Result->CurrentVolume;
-  Result->dCurrentVolume = V2(0.0f, 0.0f);
-  Result->Loop = Loop;
-  Result->Next = NULL;
+  f32 BlockSeconds = (f32)FrameCount / (f32)SamplesPerSecond;
+  AudioVoiceEndBlock(Pool, Voice, AudioVoiceNextVolume(Pool, Voice, BlockSeconds));
 
-  Result->NumDecodedSamples = 0;
-  Result->DecodedSampleIndex = 0;
+  u32 Length = Pool->Sound[Voice].Samples;
+  if ((!Pool->Loop[Voice] && Length > 0 && Pool->StreamFrame[Voice] >= Length) ||
+      (Pool->Stopping[Voice] && Pool->Volume[0][Voice] == 0.0f && Pool->Volume[1][Voice] == 0.0f))
+  {
+    Pool->Finished[Voice] = true;
+  }
+}
 
-  Result->NumDecodedSamples = (
-    Result->Sound.Channels *
-    stb_vorbis_get_samples_float_interleaved(
-      Result->Decoder, Result->Sound.Channels, Result->DecodedSamples, ArrayCount(Result->DecodedSamples)));
-  Result->DecodedSampleIndex = 0;
+// Works out the spatial gain every voice should reach by the end of the next
+// block from its position relative to the listener. Sounds are attenuated
+// linearly with distance and panned with an equal-power law, so a sound right
+// on top of the listener plays at -3dB on both channels. Voices that aren't
+// positional have unity gain.
+internal void AudioPlayerSpatialize(audio_player *Player)
+{
+  audio_voice_pool *Pool = &Player->Voices;
+  audio_listener *Listener = &Player->Listener;
+  f32 OneOverRange = 1.0f / (Listener->MaxDistance - Listener->MinDistance);
+  f32 OneOverPan = 1.0f / Listener->PanDistance;
+  u32 Voice = 0;
 
-  if (Player->FirstPlayingSound != NULL)
+#if defined(__SSE2__)
   {
-    Result->Next = Player->FirstPlayingSound;
+    // NOTE: 4 voices per vector. The pool's arrays are a multiple of 4 long,
+    // so the last batch can safely run past the active voices.
+    __m128 ListenerX = _mm_set1_ps(Listener->Position.X);
+    __m128 ListenerY = _mm_set1_ps(Listener->Position.Y);
+    __m128 MaxDistance = _mm_set1_ps(Listener->MaxDistance);
+    __m128 VOneOverRange = _mm_set1_ps(OneOverRange);
+    __m128 VOneOverPan = _mm_set1_ps(OneOverPan);
+    __m128 Zero = _mm_setzero_ps();
+    __m128 Half = _mm_set1_ps(0.5f);
+    __m128 One = _mm_set1_ps(1.0f);
+    __m128 MinusOne = _mm_set1_ps(-1.0f);
+    for (; Voice < Pool->NumVoices; Voice += 4)
+    {
+      __m128 dX = _mm_sub_ps(_mm_loadu_ps(Pool->PositionX + Voice), ListenerX);
+      __m128 dY = _mm_sub_ps(_mm_loadu_ps(Pool->PositionY + Voice), ListenerY);
+      __m128 Distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dX, dX), _mm_mul_ps(dY, dY)));
+      __m128 Attenuation = _mm_mul_ps(_mm_sub_ps(MaxDistance, Distance), VOneOverRange);
+      Attenuation = _mm_min_ps(_mm_max_ps(Attenuation, Zero), One);
+      __m128 Pan = _mm_min_ps(_mm_max_ps(_mm_mul_ps(dX, VOneOverPan), MinusOne), One);
+      __m128 Left = _mm_mul_ps(Attenuation, _mm_sqrt_ps(_mm_sub_ps(Half, _mm_mul_ps(Half, Pan))));
+      __m128 Right = _mm_mul_ps(Attenuation, _mm_sqrt_ps(_mm_add_ps(Half, _mm_mul_ps(Half, Pan))));
+
+      __m128i Positional = _mm_loadu_si128((__m128i*)(Pool->Positional + Voice));
+      __m128 NotPositional = _mm_castsi128_ps(_mm_cmpeq_epi32(Positional, _mm_setzero_si128()));
+      Left = _mm_or_ps(_mm_and_ps(NotPositional, One), _mm_andnot_ps(NotPositional, Left));
+      Right = _mm_or_ps(_mm_and_ps(NotPositional, One), _mm_andnot_ps(NotPositional, Right));
+      _mm_storeu_ps(Pool->SpatialTarget[0] + Voice, Left);
+      _mm_storeu_ps(Pool->SpatialTarget[1] + Voice, Right);
+
+      // Voices that just started snap to their target
+      __m128 GainL = _mm_loadu_ps(Pool->SpatialGain[0] + Voice);
+      __m128 GainR = _mm_loadu_ps(Pool->SpatialGain[1] + Voice);
+      __m128 IsNew = _mm_cmplt_ps(GainL, Zero);
+      _mm_storeu_ps(Pool->SpatialGain[0] + Voice, _mm_or_ps(_mm_and_ps(IsNew, Left), _mm_andnot_ps(IsNew, GainL)));
+      _mm_storeu_ps(Pool->SpatialGain[1] + Voice, _mm_or_ps(_mm_and_ps(IsNew, Right), _mm_andnot_ps(IsNew, GainR)));
+    }
   }
+#endif
 
-  Player->FirstPlayingSound = Result;
-  return(Result);
+  for (; Voice < Pool->NumVoices; ++Voice)
+  {
+    f32 Left = 1.0f;
+    f32 Right = 1.0f;
+    if (Pool->Positional[Voice])
+    {
+      f32 dX = Pool->PositionX[Voice] - Listener->Position.X;
+      f32 dY = Pool->PositionY[Voice] - Listener->Position.Y;
+      f32 Distance = sqrtf(dX*dX + dY*dY);
+      f32 Attenuation = Clamp((Listener->MaxDistance - Distance) * OneOverRange, 0.0f, 1.0f);
+      f32 Pan = Clamp(dX * OneOverPan, -1.0f, 1.0f);
+      Left = Attenuation * sqrtf(0.5f - 0.5f*Pan);
+      Right = Attenuation * sqrtf(0.5f + 0.5f*Pan);
+    }
+    Pool->SpatialTarget[0][Voice] = Left;
+    Pool->SpatialTarget[1][Voice] = Right;
+
+    if (Pool->SpatialGain[0][Voice] < 0.0f)
+    {
+      Pool->SpatialGain[0][Voice] = Left;
+      Pool->SpatialGain[1][Voice] = Right;
+    }
+  }
 }
 
-internal void DestroyPlayingSound(playing_sound* PlayingSound)
+// Asks for a streamed voice's decoder to be seeked to its stream position.
+// The game thread hands the seek to a worker on its next update.
+internal void AudioPlayerRequestSeek(audio_player *Player, u32 Voice)
 {
-  stb_vorbis_close(PlayingSound->Decoder);
-  PlayingSound->Decoder = NULL;
+  audio_voice_pool *Pool = &Player->Voices;
+  audio_seek_job *Job = Player->Seeks + Pool->VoiceToSlot[Voice];
+  Job->Decoder = Pool->Decoder[Voice];
+  Job->Frame = Pool->StreamFrame[Voice];
+  Job->Done = false;
+  AtomicStoreReleaseU32((u32 volatile*)&Job->Requested, true);
+
+  Pool->SeekState[Voice] = AUDIO_SEEK_pending;
 }
 
-internal void RestartPlayingSound(playing_sound* PlayingSound)
+// Gives the highest priority audible voices a real voice, up to the budget,
+// and makes the rest virtual. Promoted voices are restarted from their stream
+// position. Streamed voices first have their decoder seeked there on a
+// worker, and stay virtual until it is.
+internal void AudioPlayerAssignVoices(audio_player *Player)
 {
-  stb_vorbis_seek_start(PlayingSound->Decoder);
+  audio_voice_pool *Pool = &Player->Voices;
+  u32 Order[AUDIO_MAX_VOICES];
+  f32 Audibility[AUDIO_MAX_VOICES];
+
+  foreach (Voice, Pool->NumVoices)
+  {
+    if (Pool->SeekState[Voice] == AUDIO_SEEK_pending &&
+        AtomicLoadAcquireU32((u32 volatile*)&Player->Seeks[Pool->VoiceToSlot[Voice]].Done))
+    {
+      Pool->SeekState[Voice] = AUDIO_SEEK_ready;
+    }
+
+    Audibility[Voice] = Max(Max(Pool->Volume[0][Voice], Pool->Volume[1][Voice]),
+                            Max(Pool->TargetVolume[0][Voice], Pool->TargetVolume[1][Voice]));
+    Audibility[Voice] *= Max(Pool->SpatialTarget[0][Voice], Pool->SpatialTarget[1][Voice]);
+    if (Pool->Pending[Voice] || !Pool->Sound[Voice].Loaded)
+    {
+      // NOTE: Nothing to decode yet, so keep it virtual
+      Audibility[Voice] = 0.0f;
+    }
+
+    // NOTE: Insertion sort by priority then audibility, there are only ever a
+    // handful of voices.
+    i32 Index = (i32)Voice - 1;
+    for (; Index >= 0; --Index)
+    {
+      u32 Other = Order[Index];
+      b32 Before = (Pool->Priority[Voice] > Pool->Priority[Other] ||
+                    (Pool->Priority[Voice] == Pool->Priority[Other] && Audibility[Voice] > Audibility[Other]));
+      if (!Before)
+      {
+        break;
+      }
+      Order[Index + 1] = Other;
+    }
+    Order[Index + 1] = Voice;
+  }
+
+  u32 RealVoices = 0;
+  foreach (I, Pool->NumVoices)
+  {
+    u32 Voice = Order[I];
+    b32 Audible = Audibility[Voice] >= AUDIO_AUDIBILITY_THRESHOLD;
+    if (Audible && RealVoices < Player->RealVoiceBudget)
+    {
+      ++RealVoices;
+      if (Pool->Virtual[Voice])
+      {
+        if (Pool->Sound[Voice].PCM)
+        {
+          Pool->Virtual[Voice] = false;
+          AudioVoiceResetRing(Pool, Voice);
+          Pool->PCMFrame[Voice] = Pool->StreamFrame[Voice];
+        }
+        else if (Pool->SeekState[Voice] == AUDIO_SEEK_ready)
+        {
+          Pool->Virtual[Voice] = false;
+          AudioVoiceResetRing(Pool, Voice);
+        }
+        else if (Pool->SeekState[Voice] == AUDIO_SEEK_needed)
+        {
+          AudioPlayerRequestSeek(Player, Voice);
+        }
+      }
+    }
+    else if (!Pool->Virtual[Voice])
+    {
+      // NOTE: The decoder is left wherever the ring was filled up to
+      Pool->Virtual[Voice] = true;
+      Pool->SeekState[Voice] = AUDIO_SEEK_needed;
+      if (Audible)
+      {
+        ++Player->Stats.StolenVoices;
+      }
+    }
+  }
+
+  Player->Stats.RealVoices = RealVoices;
+  Player->Stats.VirtualVoices = Pool->NumVoices - RealVoices;
 }
 
-// TODO: This mixer could use another performance pass. The idea would be to
-// stop using a linked list for channels and instead use a statically sized
-// array (we probably should have been using one in the first place). This will
-// probably be more cache-efficient than the linked list and provide some level
-// of performance (unknown how much of a boost).
-internal void MixAudio(audio_player* Player, i16* OutSamples, u32 FramesToPlay, u32 SamplesPerSecond)
+// Mixes the next FrameCount frames of the voice into the bus. Voices playing
+// at the device rate are read straight from their ring in at most two
+// contiguous spans, everything else is resampled first. Marks the voice
+// finished once its stream has ended and the ring has been drained, or once a
+// stopping voice has faded out.
+internal void AudioVoiceMixBlock(audio_player *Player, u32 Voice, u32 FrameCount, u32 SamplesPerSecond)
 {
-  // NOTE: We need to clear the audio stream to ensure that if no voices are
-  // playing only silence is emitted.
-  memset(OutSamples, 0, FramesToPlay*sizeof(i16)*2);
+  audio_voice_pool *Pool = &Player->Voices;
+  u32 Slot = Pool->VoiceToSlot[Voice];
+  f32 *Bus = Player->Buses[Pool->Bus[Voice]].Samples;
+
+  f32 Step = AudioVoiceStep(Pool, Voice, SamplesPerSecond);
+  u32 StartReadFrame = Pool->RingReadFrame[Slot];
+  u32 FramesNeeded = (u32)(FrameCount * Step) + AUDIO_RESAMPLE_MAX_TAPS;
 
-  if (Player->FirstPlayingSound == NULL)
+  if (Pool->RingWriteFrame[Slot] - Pool->RingReadFrame[Slot] < FramesNeeded)
   {
-    return;
+    AudioVoiceDecode(Pool, Voice);
+  }
+
+  // NOTE: The gain applied is the volume times the spatial gain. Both are
+  // ramped linearly across the block from where they were at the end of the
+  // last one to where they should be at the end of this one.
+  v2 NextVolume = AudioVoiceNextVolume(Pool, Voice, (f32)FrameCount / (f32)SamplesPerSecond);
+  v2 Gain;
+  v2 Target;
+  foreach (Channel, 2)
+  {
+    Gain.E[Channel] = Pool->Volume[Channel][Voice] * Pool->SpatialGain[Channel][Voice];
+    Target.E[Channel] = NextVolume.E[Channel] * Pool->SpatialTarget[Channel][Voice];
+  }
+  v2 dGain = (1.0f / (f32)FrameCount) * (Target - Gain);
+
+  u32 Mixed = 0;
+  if (Step == 1.0f && Pool->ResampleFraction[Voice] == 0.0f)
+  {
+    u32 AvailableFrames = Pool->RingWriteFrame[Slot] - Pool->RingReadFrame[Slot];
+    u32 FramesToMix = Min(FrameCount, AvailableFrames);
+    while (Mixed < FramesToMix)
+    {
+      u32 ReadIndex = Pool->RingReadFrame[Slot] & (AUDIO_VOICE_RING_FRAMES - 1);
+      u32 SpanFrames = Min(FramesToMix - Mixed, AUDIO_VOICE_RING_FRAMES - ReadIndex);
+      Gain = MixVoiceBlock(Bus + 2*Mixed, Pool->Ring[Slot] + 2*ReadIndex, SpanFrames, Gain, dGain, Target);
+      Pool->RingReadFrame[Slot] += SpanFrames;
+      Mixed += SpanFrames;
+    }
+  }
+  else
+  {
+    Mixed = AudioResample(&Player->Resampler, Player->ResampleBuffer, Pool->Ring[Slot],
+                          &Pool->RingReadFrame[Slot], Pool->RingWriteFrame[Slot],
+                          &Pool->ResampleFraction[Voice], Step, FrameCount);
+    Gain = MixVoiceBlock(Bus, Player->ResampleBuffer, Mixed, Gain, dGain, Target);
   }
 
-  f32 SecondsPerSample = 1.0f / (f32)SamplesPerSecond;
+  AudioVoiceEndBlock(Pool, Voice, NextVolume);
+  AudioVoiceAdvanceStream(Pool, Voice, Pool->RingReadFrame[Slot] - StartReadFrame);
 
-  playing_sound* Voice = Player->FirstPlayingSound;
-  playing_sound* Prev = NULL;
+  // NOTE: The resampler stops half a filter short of the end of the stream,
+  // which is a fraction of a millisecond of what is nearly always silence.
+  if ((Pool->EndOfStream[Slot] && Mixed < FrameCount) ||
+      (Pool->Stopping[Voice] && NextVolume.X == 0.0f && NextVolume.Y == 0.0f))
+  {
+    Pool->Finished[Voice] = true;
+  }
+  else if (Pool->RingWriteFrame[Slot] - Pool->RingReadFrame[Slot] < FramesNeeded)
+  {
+    // Top up the look-ahead for the next block
+    AudioVoiceDecode(Pool, Voice);
+  }
 
-  f32 Samples[2] = { 0, 0 };
-  f32 TempSamples[2] = { 0, 0 };
+  // Let the game thread know how far into its file the stream has got
+  if (Pool->Decoder[Voice])
+  {
+    AtomicStoreReleaseU32(&Player->StreamOffset[Slot], stb_vorbis_get_file_offset(Pool->Decoder[Voice]));
+  }
+}
 
-  while (Voice != NULL)
+// Runs each bus's insert chain and mixes it into its parent, children first,
+// leaving the finished block in the master bus.
+internal void AudioPlayerProcessBuses(audio_player *Player, u32 FrameCount, u32 SamplesPerSecond)
+{
+  for (i32 BusIndex = AUDIO_BUS_COUNT - 1; BusIndex >= 0; --BusIndex)
   {
-    i16 *Output = OutSamples;
+    u64 StartCycles = __rdtsc();
+    audio_bus *Bus = Player->Buses + BusIndex;
 
-    // Early out for sounds that have not yet loaded
-    if (!Voice->Sound.Loaded)
+    foreach (EffectIndex, AUDIO_BUS_MAX_EFFECTS)
     {
-      goto finish_voice;
+      AudioEffectProcess(Bus->Effects + EffectIndex, Bus->Samples, FrameCount, SamplesPerSecond);
     }
 
-    for (u32 J = 0; J < FramesToPlay; ++J)
+    if (BusIndex != AUDIO_BUS_master)
     {
-      GetNextDecodedSamples(Voice, TempSamples);
+      audio_bus *Parent = Player->Buses + Bus->Parent;
+      v2 Gain = V2(Bus->Gain, Bus->Gain);
+      v2 Target = V2(Bus->TargetGain, Bus->TargetGain);
+      MixVoiceBlock(Parent->Samples, Bus->Samples, FrameCount, Gain, (1.0f / (f32)FrameCount) * (Target - Gain), Target);
+      Bus->Gain = Bus->TargetGain;
+    }
 
-      for (u32 Channel = 0; Channel < 2; ++Channel)
-      {
-        Samples[Channel] = Voice->CurrentVolume.E[Channel] * TempSamples[Channel];
+    Player->Stats.BusCycles[BusIndex] += __rdtsc() - StartCycles;
+  }
+}
 
-        if (Voice->dCurrentVolume.E[Channel] > 0 && Voice->CurrentVolume.E[Channel] >= Voice->TargetVolume.E[Channel])
-        {
-          Voice->CurrentVolume.E[Channel] = Voice->TargetVolume.E[Channel];
-          Voice->dCurrentVolume.E[Channel] = 0.0f;
-        }
+internal void MixAudio(audio_player* Player, i16* OutSamples, u32 FramesToPlay, u32 SamplesPerSecond)
+{
+  audio_voice_pool *Pool = &Player->Voices;
+  u64 StartCycles = __rdtsc();
+  u32 VoicesMixed = 0;
+  u32 VoiceFramesMixed = 0;
+  u64 VoiceCycles = 0;
 
-        if (Voice->dCurrentVolume.E[Channel] < 0 && Voice->CurrentVolume.E[Channel] <= Voice->TargetVolume.E[Channel])
-        {
-          Voice->CurrentVolume.E[Channel] = Voice->TargetVolume.E[Channel];
-          Voice->dCurrentVolume.E[Channel] = 0.0f;
-        }
-      }
+  foreach (Bus, AUDIO_BUS_COUNT)
+  {
+    Player->Stats.BusCycles[Bus] = 0;
+  }
+
+  for (u32 BlockStart = 0; BlockStart < FramesToPlay; BlockStart += AUDIO_MIX_BLOCK_FRAMES)
+  {
+    u32 BlockFrames = Min(AUDIO_MIX_BLOCK_FRAMES, FramesToPlay - BlockStart);
+
+    // NOTE: We need to clear the buses to ensure that if no voices are
+    // playing only silence is emitted.
+    foreach (Bus, AUDIO_BUS_COUNT)
+    {
+      ZeroMemory((u8*)Player->Buses[Bus].Samples, BlockFrames * 2 * sizeof(f32));
+    }
 
-      Voice->CurrentVolume += SecondsPerSample * Voice->dCurrentVolume;
+    AudioPlayerSpatialize(Player);
+    AudioPlayerAssignVoices(Player);
 
-      // TODO: Unroll this?
-      for (u32 I = 0; I < 2; ++I)
+    u32 BlockVoicesMixed = 0;
+    foreach (Voice, Pool->NumVoices)
+    {
+      // Early out for sounds that have not yet loaded
+      if (!Pool->Sound[Voice].Loaded)
       {
-        FASTDEF(temp);
-        int v = Player->MasterVolume.E[I] * FAST_SCALED_FLOAT_TO_INT(temp, Samples[I], 15);
-        if ((unsigned int) (v + 32768) > 65535)
-          v = v < 0 ? -32768 : 32767;
-        *Output = Clamp(*Output + (i16)v, -32768, 32767);
-        Output++;
+        continue;
       }
 
-      if (PlayingSoundCompleted(Voice))
+      if (Pool->Virtual[Voice])
       {
-        if (Voice->Loop)
-        {
-          RestartPlayingSound(Voice);
-        }
-        else
-        {
-          Voice->IsPlaying = false;
-          DestroyPlayingSound(Voice);
-
-          if (Prev)
-          {
-            Prev->Next = Voice->Next;
-          }
-          else
-          {
-            Player->FirstPlayingSound = Voice->Next;
-          }
-
-          if (Player->FirstFreeSound)
-          {
-            playing_sound* FreeVoice = Voice;
-            Voice = Voice->Next;
-            FreeVoice->Next = Player->FirstFreeSound;
-            Player->FirstFreeSound = FreeVoice;
-          }
-          else
-          {
-            Player->FirstFreeSound = Voice;
-            Voice = Voice->Next;
-            Player->FirstFreeSound->Next = NULL;
-          }
-
-          // TODO: This is a bit janky... we can probably do this without using
-          // a goto
-          goto channel_finished_loopend;
-        }
+        AudioVoiceMixVirtual(Pool, Voice, BlockFrames, SamplesPerSecond);
+      }
+      else
+      {
+        u64 VoiceStartCycles = __rdtsc();
+        AudioVoiceMixBlock(Player, Voice, BlockFrames, SamplesPerSecond);
+        u64 Cycles = __rdtsc() - VoiceStartCycles;
+        Player->Stats.BusCycles[Pool->Bus[Voice]] += Cycles;
+        VoiceCycles += Cycles;
+        ++BlockVoicesMixed;
+        VoiceFramesMixed += BlockFrames;
+      }
+    }
+    VoicesMixed = Max(VoicesMixed, BlockVoicesMixed);
+
+    AudioPlayerProcessBuses(Player, BlockFrames, SamplesPerSecond);
+
+    f32 MasterGain = Player->Buses[AUDIO_BUS_master].TargetGain;
+    MixBusToOutput(OutSamples + 2*BlockStart, Player->Buses[AUDIO_BUS_master].Samples, BlockFrames, V2(MasterGain, MasterGain));
+
+    // Retire voices that finished during this block. Walk backwards as
+    // removal moves the last voice into the removed one's place.
+    for (i32 Voice = (i32)Pool->NumVoices - 1; Voice >= 0; --Voice)
+    {
+      if (Pool->Finished[Voice] && !Pool->Pending[Voice] && Pool->SeekState[Voice] != AUDIO_SEEK_pending)
+      {
+        u32 Slot = Pool->VoiceToSlot[Voice];
+        stb_vorbis *Decoder = AudioVoicePoolRemove(Pool, Voice);
+        AudioReleaseQueuePush(&Player->Releases, Slot, Decoder);
       }
     }
+  }
 
-  finish_voice:
-    Prev = Voice;
-    Voice = Voice->Next;
-  channel_finished_loopend:
-    UNUSED(Voice);
+  u64 MixCycles = __rdtsc() - StartCycles;
+  Player->Stats.ActiveVoices = Pool->NumVoices;
+  Player->Stats.VoicesMixed = VoicesMixed;
+  Player->Stats.VoiceFramesMixed = VoiceFramesMixed;
+  Player->Stats.MixCycles = MixCycles;
+  if (VoiceFramesMixed > 0)
+  {
+    Player->Stats.CyclesPerVoiceFrame = (f32)VoiceCycles / (f32)VoiceFramesMixed;
   }
 }
 
-internal void UpdateAndMixAudio(audio_player* Player, audio_buffer* AudioBuffer, f32 DeltaTimeSecs)
+// Pulls the next AudioBuffer->FrameCount frames of game audio. Called by the
+// platform from its audio thread whenever the device needs more samples.
+internal void AudioPlayerMix(audio_player* Player, audio_buffer* AudioBuffer)
 {
+  audio_command Command;
+  while (AudioCommandQueuePop(&Player->Commands, &Command))
+  {
+    AudioPlayerProcessCommand(Player, &Command);
+  }
+
   MixAudio(Player, AudioBuffer->Samples, AudioBuffer->FrameCount, AudioBuffer->SamplesPerSecond);
+
+  audio_mix_snapshot *Snapshot = &Player->Snapshot;
+  u32 Sequence = Snapshot->Sequence;
+  AtomicStoreReleaseU32(&Snapshot->Sequence, Sequence + 1);
+  CompletePreviousWritesBeforeFutureWrites;
+  Snapshot->Stats = Player->Stats;
+  AtomicStoreReleaseU32(&Snapshot->Sequence, Sequence + 2);
 }
 
 internal void AudioPlayerInit(audio_player* Player, memory_arena *PermanentArena)
 {
   Player->AudioArena = ArenaPushChild(PermanentArena, AUDIO_PLAYER_ARENA_SIZE);
 
-  Player->MasterVolume = V2(1.0f, 1.0f);
-  Player->FirstPlayingSound = NULL;
-  Player->FirstFreeSound = NULL;
+  foreach (BusIndex, AUDIO_BUS_COUNT)
+  {
+    audio_bus *Bus = Player->Buses + BusIndex;
+    Bus->Parent = AUDIO_BUS_master;
+    Bus->Gain = Bus->TargetGain = 1.0f;
+  }
+  AudioResamplerInit(&Player->Resampler, AUDIO_RESAMPLE_QUALITY_medium);
+  Player->RealVoiceBudget = AUDIO_DEFAULT_REAL_VOICES;
+
+  Player->Listener.Position = V2(0.0f, 0.0f);
+  Player->Listener.MinDistance = AUDIO_LISTENER_MIN_DISTANCE;
+  Player->Listener.MaxDistance = AUDIO_LISTENER_MAX_DISTANCE;
+  Player->Listener.PanDistance = AUDIO_LISTENER_PAN_DISTANCE;
+
+  Player->NumFreeSlots = AUDIO_MAX_VOICES;
+  foreach (I, AUDIO_MAX_VOICES)
+  {
+    // NOTE: Hand out low slots first
+    Player->FreeSlots[I] = AUDIO_MAX_VOICES - I - 1;
+  }
+
+  // NOTE: Keep the master bus just under full scale rather than letting loud
+  // mixes clip when converted to 16-bit.
+  AudioPlayerSetBusEffect(Player, AUDIO_BUS_master, AUDIO_BUS_MAX_EFFECTS - 1, AudioLimiter(0.9f, 0.1f));
 }
 
-internal void AudioPlayerDestroy(audio_player* Player)
+// NOTE: The platform must have stopped calling AudioPlayerMix before this is
+// called as it tears down state owned by the audio thread.
+internal void AudioPlayerDestroy(audio_player* Player, platform_state *Platform)
 {
-  playing_sound* Sound = Player->FirstPlayingSound;
+  // NOTE: Wait for decoders still being opened on workers
+  Platform->Interface.WorkQueueCompleteAllWork(Platform->Input.WorkQueue);
+  AudioPlayerCollectReleases(Player);
+
+  audio_voice_pool *Pool = &Player->Voices;
+  while (Pool->NumVoices > 0)
+  {
+    stb_vorbis_close(AudioVoicePoolRemove(Pool, Pool->NumVoices - 1));
+  }
+
+  // Close the decoders of sounds that were never started
+  audio_command Command;
+  while (AudioCommandQueuePop(&Player->Commands, &Command))
+  {
+    if (Command.Type == AUDIO_COMMAND_start)
+    {
+      stb_vorbis_close(Command.Decoder);
+    }
+  }
 
-  while (Sound)
+  foreach (Slot, AUDIO_MAX_VOICES)
   {
-    DestroyPlayingSound(Sound);
-    Sound = Sound->Next;
+    if (Player->Prepare[Slot].Waiting)
+    {
+      stb_vorbis_close(Player->Prepare[Slot].Decoder);
+    }
   }
 }
@@ -2,52 +2,422 @@
 #define GAME_MIXER_H
 
 #include "sounds.h"
+#include "audio_effects.h"
 
 // Maximum volume value
 #define AUDIO_MAX_VOLUME 128
 
-// Memory budget for audio player. This is used to store playing sounds and
-// sets the cap on the maximum number of playing sounds.
+// Memory budget for audio player.
 //
 // Should be strictly < PERMANENT_STORAGE_SIZE
 #define AUDIO_PLAYER_ARENA_SIZE Megabytes(64)
 
+// Maximum number of voices that can be playing at once, real or virtual.
+// Playing a sound when all voices are in use fails.
+//
+// NOTE: Must be a power of 2. May be overridden by tools that need more.
+#ifndef AUDIO_MAX_VOICES
+#define AUDIO_MAX_VOICES 128
+#endif
+
+// Default number of voices that are actually decoded and mixed. The rest are
+// virtual: they keep their place in the stream but cost next to nothing until
+// they are promoted back.
+#define AUDIO_DEFAULT_REAL_VOICES 32
+
+// Voices quieter than this (about -60dB) are made virtual regardless of the
+// real voice budget.
+#define AUDIO_AUDIBILITY_THRESHOLD 0.001f
+
+// Voice priorities. Higher priority voices keep their real voice when the
+// budget is exceeded, ties go to the louder voice.
+#define AUDIO_PRIORITY_LOW 64
+#define AUDIO_PRIORITY_DEFAULT 128
+#define AUDIO_PRIORITY_HIGH 192
+
+// Voices are mixed into an f32 bus in blocks of this many frames.
+//
+// NOTE: Must be a multiple of 4 so that blocks can be processed with AVX.
+#define AUDIO_MIX_BLOCK_FRAMES 256
+
+// Each voice decodes ahead into a ring of interleaved stereo frames which the
+// mixer consumes a block at a time.
+//
+// NOTE: Must be a power of 2 and hold at least one mix block plus look-ahead.
+#define AUDIO_VOICE_RING_FRAMES 1024
+
+// Voices are resampled from their sound's sample rate to the device rate with
+// a polyphase filter. Fractional positions are rounded to one of this many
+// phases.
+#define AUDIO_RESAMPLE_PHASES 256
+
+// Widest resampling filter. Voice rings keep this many frames of history
+// behind the read position and mirror their first frames past the end, so a
+// filter can always read its taps contiguously.
+#define AUDIO_RESAMPLE_MAX_TAPS 16
+#define AUDIO_RESAMPLE_HISTORY_FRAMES (AUDIO_RESAMPLE_MAX_TAPS / 2)
+
+// Upper bound on source frames consumed per output frame (sample rate ratio
+// times pitch) so that a block never needs more than a voice's ring holds.
+#define AUDIO_MAX_RESAMPLE_STEP 3.0f
+
+// Distance rolloff and panning of positional sounds, in world units. Sounds
+// closer to the listener than the min distance play at full volume and fade
+// out linearly until the max distance. Sounds the pan distance or further to
+// either side of the listener play from one channel only.
+#define AUDIO_LISTENER_MIN_DISTANCE 64.0f
+#define AUDIO_LISTENER_MAX_DISTANCE 1024.0f
+#define AUDIO_LISTENER_PAN_DISTANCE 512.0f
+
+// Streamed sounds keep this much of their file ahead of each voice's decoder
+// read in, and let go of pages more than the keep behind distance behind it.
+#define AUDIO_STREAM_READ_AHEAD_BYTES Kilobytes(256)
+#define AUDIO_STREAM_KEEP_BEHIND_BYTES Kilobytes(64)
+
+// Number of effect slots in each bus's insert chain
+#define AUDIO_BUS_MAX_EFFECTS 4
+
+// Capacity of the queue of commands sent from the game thread to the mixer on
+// the audio thread. Commands sent while the queue is full are dropped.
+//
+// NOTE: Must be a power of 2. May be overridden by tools that need more.
+#ifndef AUDIO_COMMAND_QUEUE_SIZE
+#define AUDIO_COMMAND_QUEUE_SIZE 256
+#endif
+
+// Handle to a playing sound. Handles become stale once the sound finishes
+// playing, at which point all operations on them do nothing.
 typedef struct playing_sound {
+  u32 Slot;
+  u32 Generation;
+} playing_sound;
+
+// Voices are mixed into one of these buses, which are then mixed into the
+// master bus.
+//
+// NOTE: A bus's parent must come before it so that buses can be processed in
+// reverse order, children first.
+typedef enum audio_bus_id {
+  AUDIO_BUS_master,
+  AUDIO_BUS_music,
+  AUDIO_BUS_sfx,
+  AUDIO_BUS_ui,
+  AUDIO_BUS_COUNT
+} audio_bus_id;
+
+typedef enum audio_resample_quality {
+  AUDIO_RESAMPLE_QUALITY_linear, // 2 tap linear interpolation
+  AUDIO_RESAMPLE_QUALITY_medium, // 8 tap windowed sinc
+  AUDIO_RESAMPLE_QUALITY_high,   // 16 tap windowed sinc
+  AUDIO_RESAMPLE_QUALITY_MAX
+} audio_resample_quality;
+
+// Where a streamed voice's decoder is relative to its stream position. A
+// voice's decoder has to be at its stream position before it can be given a
+// real voice, and the seek to get it there is done on a worker.
+typedef enum audio_seek_state {
+  AUDIO_SEEK_ready,  // The decoder is at the stream position
+  AUDIO_SEEK_needed, // The voice has moved on without decoding
+  AUDIO_SEEK_pending // A worker is seeking the decoder
+} audio_seek_state;
+
+typedef struct audio_resampler {
+  audio_resample_quality Quality;
+
+  // NOTE: Blackman windowed sinc filter banks indexed by [Phase][Tap]. Each
+  // coefficient is duplicated for the left and right channels so interleaved
+  // stereo frames can be filtered without shuffling. The extra phase is the
+  // next frame's phase 0.
+  f32 MediumKernel[AUDIO_RESAMPLE_PHASES + 1][8 * 2];
+  f32 HighKernel[AUDIO_RESAMPLE_PHASES + 1][16 * 2];
+} audio_resampler;
+
+// Fixed capacity pool of voices in structure-of-arrays form. Active voices are
+// kept densely packed at the front of each array so the mixer only touches
+// voices that are playing. Handles refer to slots, which map to the voice's
+// current position in the arrays.
+//
+// NOTE: Owned by the audio thread.
+typedef struct audio_voice_pool {
+  u32 NumVoices;
+
+  // NOTE: Generation of the handle currently playing in each slot, or 0 if
+  // the slot is not playing.
+  u32 SlotGeneration[AUDIO_MAX_VOICES];
+  u32 SlotToVoice[AUDIO_MAX_VOICES];
+
+  // Indexed by voice
+  u32 VoiceToSlot[AUDIO_MAX_VOICES];
+  sound Sound[AUDIO_MAX_VOICES];
+  // NOTE: Sounds in the PCM cache have no decoder and are copied from the
+  // cache starting at PCMFrame instead.
+  stb_vorbis *Decoder[AUDIO_MAX_VOICES];
+  u32 PCMFrame[AUDIO_MAX_VOICES];
+  b32 Loop[AUDIO_MAX_VOICES];
+  u32 Priority[AUDIO_MAX_VOICES];
+  audio_bus_id Bus[AUDIO_MAX_VOICES];
+  b32 Virtual[AUDIO_MAX_VOICES];
+  // Position in the sound of the frame at the ring's read position
+  u32 StreamFrame[AUDIO_MAX_VOICES];
+  b32 Stopping[AUDIO_MAX_VOICES];
+  b32 Finished[AUDIO_MAX_VOICES];
+  // NOTE: Pending voices are waiting on the game thread for their sound to
+  // load or their decoder to be opened. They stay virtual and silent, and are
+  // kept even once finished until the start command hands them their decoder.
+  b32 Pending[AUDIO_MAX_VOICES];
+  // NOTE: Voices whose seek is pending hold their stream position, stay
+  // virtual and silent, and aren't retired until the worker is done with
+  // their decoder.
+  audio_seek_state SeekState[AUDIO_MAX_VOICES];
+
+  // NOTE: Playback rate multiplier and the fractional part of the voice's
+  // position in its source stream.
+  f32 Pitch[AUDIO_MAX_VOICES];
+  f32 ResampleFraction[AUDIO_MAX_VOICES];
+
+  // NOTE: Volumes are indexed by [Channel][Voice]. dVolume is the rate of
+  // change in volume per second.
+  f32 Volume[2][AUDIO_MAX_VOICES];
+  f32 TargetVolume[2][AUDIO_MAX_VOICES];
+  f32 dVolume[2][AUDIO_MAX_VOICES];
+
+  // Used for silencing and restarting all game audio
+  f32 SavedVolume[2][AUDIO_MAX_VOICES];
+
+  // NOTE: World positions of positional voices. Spatial gains are the
+  // attenuation and panning applied on top of the volume, recomputed for
+  // every voice at the start of each block. The mixer ramps from the gain
+  // it used last block to the target so that moving sounds don't zipper.
+  b32 Positional[AUDIO_MAX_VOICES];
+  f32 PositionX[AUDIO_MAX_VOICES];
+  f32 PositionY[AUDIO_MAX_VOICES];
+  f32 SpatialGain[2][AUDIO_MAX_VOICES];
+  f32 SpatialTarget[2][AUDIO_MAX_VOICES];
+
+  // NOTE: Decoded sample rings and their cursors are indexed by slot rather
+  // than voice so that removing a voice doesn't have to move its ring. The
+  // read frame is the integer part of the voice's source position.
+  u32 RingReadFrame[AUDIO_MAX_VOICES];
+  u32 RingWriteFrame[AUDIO_MAX_VOICES];
+  b32 EndOfStream[AUDIO_MAX_VOICES];
+  f32 Ring[AUDIO_MAX_VOICES][(AUDIO_VOICE_RING_FRAMES + AUDIO_RESAMPLE_MAX_TAPS) * 2];
+} audio_voice_pool;
+
+typedef enum audio_command_type {
+  AUDIO_COMMAND_play,
+  AUDIO_COMMAND_start,
+  AUDIO_COMMAND_stop,
+  AUDIO_COMMAND_change_volume,
+  AUDIO_COMMAND_change_looping,
+  AUDIO_COMMAND_change_pitch,
+  AUDIO_COMMAND_stop_all,
+  AUDIO_COMMAND_start_all,
+  AUDIO_COMMAND_set_resample_quality,
+  AUDIO_COMMAND_set_voice_budget,
+  AUDIO_COMMAND_set_position,
+  AUDIO_COMMAND_set_listener,
+  AUDIO_COMMAND_set_bus_gain,
+  AUDIO_COMMAND_set_bus_effect
+} audio_command_type;
+
+typedef struct audio_command {
+  audio_command_type Type;
+  playing_sound Handle;
+
+  // NOTE: Decoders are opened on a worker so that neither the game thread nor
+  // the audio thread has to parse headers or allocate. Sounds in the PCM
+  // cache don't need one. Voices that are played before either is ready are
+  // sent as pending and given them by a later start command.
   sound Sound;
-  stb_vorbis* Decoder;
+  stb_vorbis *Decoder;
+  b32 Pending;
 
+  v2 Volume;
+  f32 FadeDurationSeconds;
   b32 Loop;
-  b32 IsPlaying;
-  v2 CurrentVolume;
-  v2 TargetVolume;
-  v2 dCurrentVolume;
+  u32 Priority;
+  f32 Pitch;
+  audio_resample_quality Quality;
+  u32 RealVoiceBudget;
+  b32 Positional;
+  v2 Position;
+  audio_bus_id Bus;
+  f32 Gain;
+  u32 EffectIndex;
+  audio_effect_params Effect;
+  f32 *ReverbLines;
+} audio_command;
 
-  // Used for silencing and restarting all game audio
-  v2 SavedVolume;
+// Single-producer/single-consumer queue of commands from the game thread to
+// the audio thread. Each cursor is only ever written by one side and lives on
+// its own cache line.
+typedef struct audio_command_queue {
+  u32 volatile WriteIndex;
+  u8 WritePad[CACHE_LINE_SIZE - sizeof(u32)];
+  u32 volatile ReadIndex;
+  u8 ReadPad[CACHE_LINE_SIZE - sizeof(u32)];
 
-  u32 NumDecodedSamples;
-  u32 DecodedSampleIndex;
-  f32 DecodedSamples[256];
+  audio_command Commands[AUDIO_COMMAND_QUEUE_SIZE];
+} audio_command_queue;
 
-  struct playing_sound* Next;
-} playing_sound;
+// A slot whose voice has finished, handed back from the audio thread to the
+// game thread along with its decoder so it can be freed there.
+typedef struct audio_voice_release {
+  u32 Slot;
+  stb_vorbis *Decoder;
+} audio_voice_release;
+
+// Single-producer/single-consumer queue of finished voices from the audio
+// thread to the game thread.
+//
+// NOTE: There are never more slots in flight than there are voices, so this
+// can never overflow.
+typedef struct audio_release_queue {
+  u32 volatile WriteIndex;
+  u8 WritePad[CACHE_LINE_SIZE - sizeof(u32)];
+  u32 volatile ReadIndex;
+  u8 ReadPad[CACHE_LINE_SIZE - sizeof(u32)];
+
+  audio_voice_release Releases[AUDIO_MAX_VOICES];
+} audio_release_queue;
+
+// A pending voice's sound and decoder being readied for it on the game thread
+// and workers.
+typedef struct audio_prepare_job {
+  platform_state *Platform;
+  // NOTE: The game's sound, which may still be loading
+  sound *Sound;
+  // Set while the voice is pending, until its start command is sent
+  b32 Waiting;
+  // Set once the decoder has been asked for from a worker
+  b32 Queued;
+
+  // NOTE: Written by the worker, Done last
+  stb_vorbis *Decoder;
+  b32 volatile Done;
+} audio_prepare_job;
+
+// A seek of a streamed voice's decoder, asked for by the audio thread when the
+// voice is promoted, queued by the game thread and run on a worker.
+typedef struct audio_seek_job {
+  // NOTE: Written by the audio thread, Requested last
+  stb_vorbis *Decoder;
+  u32 Frame;
+  b32 volatile Requested;
+
+  // Set by the game thread when the job is queued
+  platform_state *Platform;
+  platform_mapped_file *File;
+
+  // NOTE: Written by the worker once the decoder is at Frame
+  b32 volatile Done;
+} audio_seek_job;
+
+typedef struct audio_mix_stats {
+  u32 ActiveVoices;
+  u32 RealVoices;
+  u32 VirtualVoices;
+  // Total real voices made virtual to stay within the budget
+  u32 StolenVoices;
+  // Most real voices mixed in any one block of the last mix
+  u32 VoicesMixed;
+  // Frames mixed across all real voices on the last mix
+  u32 VoiceFramesMixed;
+  u64 MixCycles;
+  // Average cycles spent mixing a real voice per output frame on the last
+  // mix, leaving out the buses, spatialization and voice assignment
+  f32 CyclesPerVoiceFrame;
+  // Cycles spent on the last mix mixing each bus's voices and running its
+  // insert chain
+  u64 BusCycles[AUDIO_BUS_COUNT];
+} audio_mix_stats;
+
+// Snapshot of the mixer's state published by the audio thread after each mix.
+// The sequence is odd while the audio thread is writing, so readers retry
+// until they see the same even sequence on both sides of their copy.
+typedef struct audio_mix_snapshot {
+  u32 volatile Sequence;
+  audio_mix_stats Stats;
+} audio_mix_snapshot;
+
+typedef struct audio_listener {
+  v2 Position;
+  f32 MinDistance;
+  f32 MaxDistance;
+  f32 PanDistance;
+} audio_listener;
+
+// Voices and child buses are summed into the bus's samples, which are run
+// through its insert chain and then mixed into its parent at the bus's gain.
+// The master bus's gain is applied when converting to 16-bit output.
+typedef struct audio_bus {
+  audio_bus_id Parent;
+  f32 Gain;
+  // NOTE: Gain changes are ramped over a block
+  f32 TargetGain;
+  audio_effect Effects[AUDIO_BUS_MAX_EFFECTS];
+  f32 Samples[AUDIO_MIX_BLOCK_FRAMES * 2];
+} audio_bus;
 
 typedef struct audio_player {
   memory_arena AudioArena;
 
-  v2 MasterVolume;
-  playing_sound *FirstPlayingSound;
-  playing_sound *FirstFreeSound;
+  // NOTE: Owned by the game thread. Generations are bumped both when a slot
+  // is handed out and when it comes back from the audio thread, so live
+  // handles always have an odd generation and a zeroed handle is never valid.
+  u32 NumFreeSlots;
+  u32 FreeSlots[AUDIO_MAX_VOICES];
+  u32 SlotGeneration[AUDIO_MAX_VOICES];
+  // Reverb delay lines handed to each effect slot, allocated on first use
+  f32 *ReverbLines[AUDIO_BUS_COUNT][AUDIO_BUS_MAX_EFFECTS];
+  // The file each slot is streaming from, if any, and how far into it pages
+  // have been dropped
+  platform_mapped_file SlotFile[AUDIO_MAX_VOICES];
+  u32 SlotEvictedBytes[AUDIO_MAX_VOICES];
+  audio_prepare_job Prepare[AUDIO_MAX_VOICES];
+
+  // NOTE: Shared between the game and audio threads
+  audio_command_queue Commands;
+  audio_release_queue Releases;
+  audio_seek_job Seeks[AUDIO_MAX_VOICES];
+  audio_mix_snapshot Snapshot;
+  // Byte offset of each streaming slot's decoder in its file
+  u32 volatile StreamOffset[AUDIO_MAX_VOICES];
+
+  // NOTE: Owned by the audio thread
+  audio_voice_pool Voices;
+  audio_mix_stats Stats;
+  audio_resampler Resampler;
+  u32 RealVoiceBudget;
+  audio_listener Listener;
+  audio_bus Buses[AUDIO_BUS_COUNT];
+
+  // A single voice's resampled output for the current block
+  f32 ResampleBuffer[AUDIO_MIX_BLOCK_FRAMES * 2];
 } audio_player;
 
+// Game thread
 internal void AudioPlayerInit(audio_player *Player, memory_arena *PermanentArena);
-internal void AudioPlayerDestroy(audio_player *Player);
+internal void AudioPlayerDestroy(audio_player *Player, platform_state *Platform);
+internal void AudioPlayerUpdate(audio_player *Player, platform_state *Platform);
+internal audio_mix_stats AudioPlayerGetStats(audio_player *Player);
 internal void AudioPlayerStopAll(audio_player *Player, f32 FadeOutDurationSeconds);
 internal void AudioPlayerStartAll(audio_player *Player, f32 FadeInDurationSeconds);
-internal void PlayingSoundChangeVolume(playing_sound *Sound, v2 TargetVolume, f32 FadeDurationSeconds);
-internal void PlayingSoundChangeLooping(playing_sound *Sound, b32 Loop);
-internal playing_sound* AudioPlayerPlaySound(audio_player *Player, sound Sound, v2 StartVolume, b32 Loop);
+internal b32 PlayingSoundIsValid(audio_player *Player, playing_sound Sound);
+internal void PlayingSoundStop(audio_player *Player, playing_sound Sound, f32 FadeOutDurationSeconds);
+internal void PlayingSoundChangeVolume(audio_player *Player, playing_sound Sound, v2 TargetVolume, f32 FadeDurationSeconds);
+internal void PlayingSoundChangeLooping(audio_player *Player, playing_sound Sound, b32 Loop);
+internal void PlayingSoundChangePitch(audio_player *Player, playing_sound Sound, f32 Pitch);
+internal void PlayingSoundChangePosition(audio_player *Player, playing_sound Sound, v2 Position);
+internal void AudioPlayerSetResampleQuality(audio_player *Player, audio_resample_quality Quality);
+internal void AudioPlayerSetVoiceBudget(audio_player *Player, u32 RealVoiceBudget);
+internal void AudioPlayerSetListener(audio_player *Player, v2 Position);
+internal void AudioPlayerSetBusGain(audio_player *Player, audio_bus_id Bus, f32 Gain);
+internal void AudioPlayerSetBusEffect(audio_player *Player, audio_bus_id Bus, u32 EffectIndex, audio_effect_params Effect);
+internal playing_sound AudioPlayerPlaySound(audio_player *Player, platform_state *Platform, sound *Sound, v2 StartVolume, b32 Loop, u32 Priority, audio_bus_id Bus);
+internal playing_sound AudioPlayerPlaySoundAt(audio_player *Player, platform_state *Platform, sound *Sound, v2 Position, f32 Volume, b32 Loop, u32 Priority, audio_bus_id Bus);
 
-internal void UpdateAndMixAudio(audio_player *Player, audio_buffer *AudioBuffer, f32 DeltaTimeSecs);
+// Audio thread
+internal void AudioPlayerMix(audio_player *Player, audio_buffer *AudioBuffer);
 
 #endif // GAME_MIXER_H
@@ -926,7 +926,61 @@ internal void RendererPushTextChar(renderer *Renderer, u32 Flags, GLuint Texture
   Renderer->TextInstanceDataPos += RENDERER_BYTES_PER_TEXT;
 }
 
+// Pushes a previously laid out run of glyphs. Equivalent to calling
+// RendererPushTextChar for each glyph but only checks batching once.
+internal void RendererPushTextLayout(renderer *Renderer, u32 Flags, font *Font, text_layout *Layout, v2 Pos, v4 Color)
+{
+  if (Layout->NumGlyphs == 0)
+  {
+    return;
+  }
+  
+  u32 SizeBytes = Layout->NumGlyphs * RENDERER_BYTES_PER_TEXT;
+  Assert(Renderer->TextInstanceDataPos + SizeBytes <= sizeof(Renderer->TextInstanceData));
+  render_request_type RequestType = RENDER_REQUEST_text;
+  
+  if (Renderer->ActiveRequest.Type != RequestType || 
+      Renderer->ActiveRequest.Flags != Flags ||
+      Renderer->ActiveRequest.Text.TextureID != Font->Texture)
+  {
+    RendererFinishActiveRequest(Renderer);
+    Renderer->ActiveRequest.Type = RequestType;
+    Renderer->ActiveRequest.Flags = Flags;
+    Renderer->ActiveRequest.DataOffset = Renderer->TextInstanceDataPos;
+    Renderer->ActiveRequest.DataSize = SizeBytes;
+    Renderer->ActiveRequest.Text.TextureID = Font->Texture;
+    Renderer->ActiveRequest.Text.PackedTextureDim = Font->TextureDim;
+  }
+  else
+  {
+    Renderer->ActiveRequest.DataSize += SizeBytes;
+  }
+
+  f32 *Data = (f32*)(Renderer->TextInstanceData + Renderer->TextInstanceDataPos);
+  text_layout_glyph *Glyph = Layout->Glyphs;
+  foreach (I, Layout->NumGlyphs)
+  {
+    Data[0] = Glyph->Dest.X + Pos.X;
+    Data[1] = Glyph->Dest.Y + Pos.Y;
+    Data[2] = Glyph->Dest.Width;
+    Data[3] = Glyph->Dest.Height;
+    MemoryCopy(Data + 4, &Glyph->Source, sizeof(v4));
+    MemoryCopy(Data + 8, &Color, sizeof(v4));
+    Data += 12;
+    ++Glyph;
+  }
+  Renderer->TextInstanceDataPos += SizeBytes;
+}
+
 internal void RendererPushText(renderer *Renderer, u32 Flags, font *Font, const char *Text, v2 Pos, v4 Color) {
+  text_layout *Layout = FontTextLayout(Font, Text);
+  if (Layout)
+  {
+    RendererPushTextLayout(Renderer, Flags, Font, Layout, Pos, Color);
+    return;
+  }
+  
+  // NOTE: Layout cache is full, lay out the text directly.
   v2 NextPos = Pos;
   char *NextCh = (char*)Text;
   u32 PreviousGlyph = 0;
@@ -212,6 +212,7 @@ internal void RendererPushFilledCircle(renderer *Renderer, u32 Flags, v2 Center,
 internal void RendererPushTexturedQuad(renderer* Renderer, u32 Flags, GLuint TextureID, v2 TextureDim, v4 SourceRect, v4 DestRect, v4 Color);
 internal void RendererPushTexture(renderer *Renderer, u32 Flags, texture Texture, v4 SourceRect, v4 DestRect, v4 Color);
 internal void RendererPushText(renderer *Renderer, u32 Flags, font *Font, const char* Text, v2 Pos, v4 Color);
+internal void RendererPushTextLayout(renderer *Renderer, u32 Flags, font *Font, text_layout *Layout, v2 Pos, v4 Color);
 internal void RendererPushSprintf(renderer * Renderer, u32 Flags, font *Font, v2 Pos, v4 Color, const char *Fmt, ...);
 
 // Clipping
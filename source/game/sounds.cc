@@ -1,55 +1,150 @@
 #include "sounds.h"
 
-internal b32 SoundManagerInit(sound_manager *SoundManager, const char *SoundDirectory)
+internal b32 SoundManagerInit(sound_manager *SoundManager, const char *SoundDirectory, memory_arena *PermanentArena, memory_pool *WorkPool)
 {
   SoundManager->SoundDirectory = SoundDirectory;
+  SoundManager->WorkPool = WorkPool;
+  SoundManager->MaxCachedSeconds = SOUND_MANAGER_DEFAULT_MAX_CACHED_SECONDS;
+  SoundManager->PCMCache = ArenaPushChild(PermanentArena, SOUND_MANAGER_PCM_CACHE_SIZE);
+  thread_mutex_init(&SoundManager->CacheLock);
+  return(true);
+}
+
+// Decodes the whole sound into interleaved stereo frames in the PCM cache so
+// playing it never touches the decoder. Returns false if the cache is full.
+internal b32 SoundManagerCacheSound(sound_manager *SoundManager, sound *Sound, stb_vorbis *Vorbis)
+{
+  memory_arena *Cache = &SoundManager->PCMCache;
+  umm SizeBytes = Sound->Samples * 2 * sizeof(f32);
+  f32 *PCM = NULL;
+
+  // NOTE: Only the allocation needs the lock, decoding into it doesn't
+  thread_mutex_lock(&SoundManager->CacheLock);
+  if (Cache->Used + SizeBytes <= Cache->Size)
+  {
+    PCM = (f32*)ArenaAlloc(Cache, SizeBytes);
+  }
+  thread_mutex_unlock(&SoundManager->CacheLock);
+
+  if (!PCM)
+  {
+    return(false);
+  }
+
+  u32 Frames = 0;
+  if (Sound->Channels >= 2)
+  {
+    Frames = stb_vorbis_get_samples_float_interleaved(Vorbis, 2, PCM, Sound->Samples * 2);
+  }
+  else
+  {
+    // NOTE: Spread mono out to both channels backwards, as in the mixer
+    Frames = stb_vorbis_get_samples_float_interleaved(Vorbis, 1, PCM, Sound->Samples);
+    for (i32 Frame = (i32)Frames - 1; Frame >= 0; --Frame)
+    {
+      PCM[2*Frame + 1] = PCM[2*Frame + 0] = PCM[Frame];
+    }
+  }
+
+  Sound->PCM = PCM;
+  Sound->PCMFrames = Frames;
   return(true);
 }
 
 internal void SoundManagerDestroy(sound_manager *SoundManager)
 {
+  thread_mutex_term(&SoundManager->CacheLock);
 }
 
-internal b32 SoundManagerLoadSound(sound_manager *SoundManager, sound *Sound, platform_state *Platform, const char *SoundFile)
+// Maps, validates and, for short sounds, decodes the sound file. Fills in
+// everything but the sound's Loaded and Loading flags.
+//
+// NOTE: Safe to call from worker threads.
+internal b32 SoundManagerReadSound(sound_manager *SoundManager, sound *Sound, platform_state *Platform, const char *SoundFile)
 {
-  local_persist char SoundFilePath[256];
+  char SoundFilePath[256];
   b32 Result = false;
 
   snprintf(SoundFilePath, 256, "%s/%s", SoundManager->SoundDirectory, SoundFile);
 
-  platform_entire_file File;
-  if (Platform->Interface.LoadEntireFile(SoundFilePath, &File))
+  platform_mapped_file File;
+  if (Platform->Interface.MapFile(SoundFilePath, &File))
   {
+    // NOTE: The decoder only lives for the length of this call, so on a
+    // worker it can work out of the worker's scratch memory rather than the
+    // heap.
+    memory_arena *Scratch = Platform->Interface.WorkQueueGetScratchArena(Platform->Input.WorkQueue);
+    temporary_arena TempScratch = {};
+    stb_vorbis_alloc DecoderMemory = {};
+    if (Scratch && Scratch->Used + SOUND_MANAGER_DECODER_SCRATCH_SIZE <= Scratch->Size)
+    {
+      TempScratch = BeginTemporaryArena(Scratch);
+      DecoderMemory.alloc_buffer = (char*)ArenaAlloc(Scratch, SOUND_MANAGER_DECODER_SCRATCH_SIZE);
+      DecoderMemory.alloc_buffer_length_in_bytes = SOUND_MANAGER_DECODER_SCRATCH_SIZE;
+    }
+
     // Sanity check audio by attempting to decode the data
     int  Error;
-    stb_vorbis *Vorbis = stb_vorbis_open_memory(File.Data, File.SizeBytes, &Error, NULL);
+    stb_vorbis *Vorbis = stb_vorbis_open_memory(File.Data, File.SizeBytes, &Error, DecoderMemory.alloc_buffer ? &DecoderMemory : NULL);
+    if (!Vorbis && Error == VORBIS_outofmem)
+    {
+      Vorbis = stb_vorbis_open_memory(File.Data, File.SizeBytes, &Error, NULL);
+    }
+
     if (Vorbis)
     {
       // Get sound info
       stb_vorbis_info SoundInfo = stb_vorbis_get_info(Vorbis);
 
-      // Copy the file data into platform memory
-      Sound->Loaded = true;
       Sound->SoundFile = File;
       Sound->Channels = SoundInfo.channels;
       Sound->SampleRate = SoundInfo.sample_rate;
       Sound->Samples = stb_vorbis_stream_length_in_samples(Vorbis);
       Sound->DataLength = File.SizeBytes;
       Sound->Data = File.Data;
+      Sound->PCM = NULL;
+      Sound->PCMFrames = 0;
+
+      f32 LengthSeconds = (f32)Sound->Samples / (f32)Sound->SampleRate;
+      if (LengthSeconds <= SoundManager->MaxCachedSeconds &&
+          !SoundManagerCacheSound(SoundManager, Sound, Vorbis))
+      {
+        fprintf(stderr, "warning: sound PCM cache full, streaming '%s'\n", SoundFile);
+      }
+
+      stb_vorbis_close(Vorbis);
+
+      // Cached sounds never touch their file again. Streamed sounds give back
+      // the pages read while opening them until they are played.
+      if (Sound->PCM)
+      {
+        Platform->Interface.UnmapFile(&Sound->SoundFile);
+        Sound->Data = NULL;
+        Sound->DataLength = 0;
+      }
+      else
+      {
+        Platform->Interface.AdviseFileRange(&Sound->SoundFile, 0, Sound->SoundFile.SizeBytes, PLATFORM_FILE_ADVICE_dont_need);
+      }
 
       printf("Audio: Loaded sound\n");
       printf("\t%s\n", SoundFile);
       printf("\tChannels: %d\n", Sound->Channels);
       printf("\tSampleRate: %d\n", Sound->SampleRate);
       printf("\tSamples: %d\n", Sound->Samples);
+      printf("\tCached: %s\n", Sound->PCM ? "yes" : "no");
 
       Result = true;
-
-      stb_vorbis_close(Vorbis);
     }
     else
     {
       fprintf(stderr, "error: unable to decode audio file '%s': stb_vorbis error code %d\n", SoundFilePath, Error);
+      Platform->Interface.UnmapFile(&File);
+    }
+
+    if (DecoderMemory.alloc_buffer)
+    {
+      EndTemporaryArena(TempScratch);
     }
   }
   else
@@ -60,12 +155,89 @@ internal b32 SoundManagerLoadSound(sound_manager *SoundManager, sound *Sound, pl
   return(Result);
 }
 
+internal b32 SoundManagerLoadSound(sound_manager *SoundManager, sound *Sound, platform_state *Platform, const char *SoundFile)
+{
+  Sound->Loading = false;
+  Sound->Loaded = SoundManagerReadSound(SoundManager, Sound, Platform, SoundFile);
+  return(Sound->Loaded);
+}
+
+typedef struct load_sound_work {
+  sound_manager *SoundManager;
+  sound *Sound;
+  platform_state *Platform;
+  char FileName[256];
+} load_sound_work;
+
+void LoadSoundCallback(work_queue *Queue, void *Data)
+{
+  load_sound_work *Work = (load_sound_work*)Data;
+  sound *Sound = Work->Sound;
+
+  b32 Loaded = SoundManagerReadSound(Work->SoundManager, Sound, Work->Platform, Work->FileName);
+
+  // NOTE: Publish the sound's contents before it is seen as loaded
+  AtomicStoreReleaseU32((u32 volatile*)&Sound->Loaded, Loaded);
+  AtomicStoreReleaseU32((u32 volatile*)&Sound->Loading, false);
+
+  MemoryPoolFree(Work->SoundManager->WorkPool, Work);
+}
+
+// Returns straight away and loads the sound on a worker. The sound can be
+// played before it has loaded, in which case it starts once it has.
+//
+// NOTE: The sound must stay where it is until it has loaded.
+internal void SoundManagerLoadSoundAsync(sound_manager *SoundManager, sound *Sound, platform_state *Platform, const char *SoundFile)
+{
+  Sound->Loaded = false;
+  Sound->Loading = true;
+
+  Assert(sizeof(load_sound_work) <= SoundManager->WorkPool->BlockSize);
+  load_sound_work *Work = (load_sound_work*)MemoryPoolAlloc(SoundManager->WorkPool);
+  if (Work)
+  {
+    Work->SoundManager = SoundManager;
+    Work->Sound = Sound;
+    Work->Platform = Platform;
+    strncpy(Work->FileName, SoundFile, ArrayCount(Work->FileName) - 1);
+    Platform->Interface.WorkQueueAddEntry(Platform->Input.WorkQueue, LoadSoundCallback, (void*)Work);
+  }
+  else
+  {
+    // NOTE: Every work block is in flight, so load it here instead. This
+    // stalls the frame, but the load is never dropped.
+    fprintf(stderr, "Sounds: warning: work pool exhausted, loading '%s' synchronously\n", SoundFile);
+    b32 Loaded = SoundManagerReadSound(SoundManager, Sound, Platform, SoundFile);
+    AtomicStoreReleaseU32((u32 volatile*)&Sound->Loaded, Loaded);
+    AtomicStoreReleaseU32((u32 volatile*)&Sound->Loading, false);
+  }
+}
+
+internal b32 SoundIsLoaded(sound *Sound)
+{
+  return(AtomicLoadAcquireU32((u32 volatile*)&Sound->Loaded));
+}
+
+internal b32 SoundIsLoading(sound *Sound)
+{
+  return(AtomicLoadAcquireU32((u32 volatile*)&Sound->Loading));
+}
+
 internal void SoundManagerDestroySound(sound_manager *SoundManager, sound *Sound, platform_state *Platform)
 {
-  // Close the file
-  Platform->Interface.FreeEntireFile(&Sound->SoundFile);
+  // NOTE: Let a background load finish before tearing the sound down
+  if (SoundIsLoading(Sound))
+  {
+    Platform->Interface.WorkQueueCompleteAllWork(Platform->Input.WorkQueue);
+  }
+
+  // Unmap the file of streamed sounds
+  Platform->Interface.UnmapFile(&Sound->SoundFile);
 
+  // NOTE: Cached PCM stays in the cache arena until the manager goes away
   Sound->Loaded = false;
   Sound->Data = NULL;
   Sound->DataLength = 0;
+  Sound->PCM = NULL;
+  Sound->PCMFrames = 0;
 }
@@ -2,27 +2,62 @@
 #define GAME_SOUNDS_H
 
 // NOTE: All game audio is compressed Ogg-Vorbis format data that we decode on
-// the fly when playing it back.
+// the fly when playing it back. Files are memory mapped so that long tracks
+// are streamed from disk rather than read into memory up front.
 #include "ext/stb_vorbis.c"
 
+// Memory budget for decoded sound effects.
+//
+// Should be strictly < PERMANENT_STORAGE_SIZE
+#define SOUND_MANAGER_PCM_CACHE_SIZE Megabytes(32)
+
+// Sounds up to this long are decoded once at load and played from memory by
+// default. Longer sounds are streamed.
+#define SOUND_MANAGER_DEFAULT_MAX_CACHED_SECONDS 2.0f
+
+// Scratch memory handed to the decoder used to check and cache a sound while
+// loading it. Falls back to the heap if there isn't this much.
+#define SOUND_MANAGER_DECODER_SCRATCH_SIZE Kilobytes(512)
+
+// NOTE: Sounds loaded in the background are marked Loading until a worker has
+// filled them in, then Loaded. A sound that is neither failed to load.
 typedef struct sound {
   b32 Loaded;
-  platform_entire_file SoundFile;
+  b32 Loading;
+  // NOTE: Only kept mapped for sounds that are streamed
+  platform_mapped_file SoundFile;
 
   u32 Channels;
   u32 SampleRate;
   u32 Samples;
   u32 DataLength;
   u8* Data;
+
+  // NOTE: Interleaved stereo frames for sounds decoded at load, otherwise
+  // NULL and the sound is decoded as it plays.
+  f32 *PCM;
+  u32 PCMFrames;
 } sound;
 
 typedef struct sound_manager {
   const char *SoundDirectory;
+
+  // Sounds no longer than this are decoded into the PCM cache at load
+  f32 MaxCachedSeconds;
+  // NOTE: Sounds may be loaded on several workers at once
+  thread_mutex_t CacheLock;
+  memory_arena PCMCache;
+
+  // Background load work is allocated from here
+  memory_pool *WorkPool;
 } sound_manager;
 
-internal b32 SoundManagerInit(sound_manager *SoundManager, const char *SoundDirectory);
+internal b32 SoundManagerInit(sound_manager *SoundManager, const char *SoundDirectory, memory_arena *PermanentArena, memory_pool *WorkPool);
 internal void SoundManagerDestroy(sound_manager *SoundManager);
 internal b32 SoundManagerLoadSound(sound_manager *SoundManager, sound *Sound, platform_state *Platform, const char *SoundFile);
+internal void SoundManagerLoadSoundAsync(sound_manager *SoundManager, sound *Sound, platform_state *Platform, const char *SoundFile);
+internal b32 SoundIsLoaded(sound *Sound);
+internal b32 SoundIsLoading(sound *Sound);
 internal void SoundManagerDestroySound(sound_manager *SoundManager, sound *Sound, platform_state *Platform);
 
 #endif // GAME_SOUNDS_H
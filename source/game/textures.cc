@@ -2,19 +2,18 @@
 
 typedef struct reload_texture_work {
   texture_catalog *TextureCatalog;
+  platform_state *Platform;
   char FileName[256];
   u32 EntryIndex;
 } reload_texture_work;
 
-void ReloadTextureCallback(work_queue *Queue, void *Data)
+internal void TextureCatalogReloadEntry(texture_catalog *Catalog, u32 EntryIndex, char *FileName)
 {
-  reload_texture_work *Work = (reload_texture_work*)Data;
-  
   i32 Width, Height, Channels;
-  u8 *ImageData = stbi_load(Work->FileName, &Width, &Height, &Channels, STBI_rgb_alpha);
+  u8 *ImageData = stbi_load(FileName, &Width, &Height, &Channels, STBI_rgb_alpha);
   if (ImageData != NULL)
   {
-    texture_catalog_entry *Entry = Work->TextureCatalog->Entry + Work->EntryIndex;
+    texture_catalog_entry *Entry = Catalog->Entry + EntryIndex;
     
     Entry->Texture.Dim = V2(Width, Height);
     glBindTexture(GL_TEXTURE_2D, Entry->Texture.ID);
@@ -23,48 +22,64 @@ void ReloadTextureCallback(work_queue *Queue, void *Data)
     Entry->Texture.Loaded = true;
     Entry->Texture.Loading = false;
     
-    fprintf(stderr, "hot reload: texture '%s'\n", Work->FileName);
+    fprintf(stderr, "hot reload: texture '%s'\n", FileName);
     stbi_image_free(ImageData);
   }
   else 
   {
-    fprintf(stderr, "error: failed to reload file: '%s'\n", Work->FileName);
+    fprintf(stderr, "error: failed to reload file: '%s'\n", FileName);
   }
+}
+
+void ReloadTextureCallback(work_queue *Queue, void *Data)
+{
+  reload_texture_work *Work = (reload_texture_work*)Data;
+  GlobalTextureScratch = Work->Platform->Interface.WorkQueueGetScratchArena(Queue);
+  
+  TextureCatalogReloadEntry(Work->TextureCatalog, Work->EntryIndex, Work->FileName);
   
   glFinish();
-  free(Work);
+  GlobalTextureScratch = NULL;
+  MemoryPoolFree(Work->TextureCatalog->WorkPool, Work);
 }
 
 typedef struct load_texture_work {
   texture_catalog *TextureCatalog;
+  platform_state *Platform;
   char *ReferenceName;
 } load_texture_work;
 
-void LoadTextureCallback(work_queue *Queue, void *Data)
+internal void TextureCatalogLoadReference(texture_catalog *Catalog, char *ReferenceName)
 {
-  load_texture_work *Work = (load_texture_work*)Data;
-
   // TODO: @Feature: Replace this with a look into an asset packfile or
   // similar.
-  if (strncmp(Work->ReferenceName, "monk_idle", TEXTURE_CATALOG_REFERENCE_NAME_MAX_SIZE) == 0)
+  if (strncmp(ReferenceName, "monk_idle", TEXTURE_CATALOG_REFERENCE_NAME_MAX_SIZE) == 0)
   {
-    TextureCatalogAdd(Work->TextureCatalog, "../assets/textures/MonkIdle.png", "monk_idle");
+    TextureCatalogAdd(Catalog, "../assets/textures/MonkIdle.png", "monk_idle");
   }
   
-  else if (strncmp(Work->ReferenceName, "guy_idle", TEXTURE_CATALOG_REFERENCE_NAME_MAX_SIZE) == 0)
+  else if (strncmp(ReferenceName, "guy_idle", TEXTURE_CATALOG_REFERENCE_NAME_MAX_SIZE) == 0)
   {
-    TextureCatalogAdd(Work->TextureCatalog, "../assets/textures/GuyIdle.png", "guy_idle");
+    TextureCatalogAdd(Catalog, "../assets/textures/GuyIdle.png", "guy_idle");
   }
 
-  else if (strncmp(Work->ReferenceName, "ui_icons", TEXTURE_CATALOG_REFERENCE_NAME_MAX_SIZE) == 0)
+  else if (strncmp(ReferenceName, "ui_icons", TEXTURE_CATALOG_REFERENCE_NAME_MAX_SIZE) == 0)
   {
-    TextureCatalogAdd(Work->TextureCatalog, "../assets/textures/WindowIcons.png", "ui_icons");
+    TextureCatalogAdd(Catalog, "../assets/textures/WindowIcons.png", "ui_icons");
   }
 
-  else if (strncmp(Work->ReferenceName, "tileset", TEXTURE_CATALOG_REFERENCE_NAME_MAX_SIZE) == 0)
+  else if (strncmp(ReferenceName, "tileset", TEXTURE_CATALOG_REFERENCE_NAME_MAX_SIZE) == 0)
   {
-    TextureCatalogAdd(Work->TextureCatalog, "../assets/textures/Tileset.png", "tileset");
+    TextureCatalogAdd(Catalog, "../assets/textures/Tileset.png", "tileset");
   }
+}
+
+void LoadTextureCallback(work_queue *Queue, void *Data)
+{
+  load_texture_work *Work = (load_texture_work*)Data;
+  GlobalTextureScratch = Work->Platform->Interface.WorkQueueGetScratchArena(Queue);
+
+  TextureCatalogLoadReference(Work->TextureCatalog, Work->ReferenceName);
   
   // NOTE: To avoid texture corruption and other problems related to a
   // separate thread uploading assets we call glFinish(). This ensures that
@@ -72,12 +87,14 @@ void LoadTextureCallback(work_queue *Queue, void *Data)
   // execution.
   glFinish();
   
-  free(Work);
+  GlobalTextureScratch = NULL;
+  MemoryPoolFree(Work->TextureCatalog->WorkPool, Work);
 }
 
-internal b32 TextureCatalogInit(texture_catalog *Catalog)
+internal b32 TextureCatalogInit(texture_catalog *Catalog, memory_pool *WorkPool)
 {
   Catalog->NumEntries = 0;
+  Catalog->WorkPool = WorkPool;
   thread_mutex_init(&Catalog->EntryMutex);
   return WatchedFileSetCreate(&Catalog->Watcher);
 }
@@ -208,10 +225,23 @@ internal texture TextureCatalogGet(texture_catalog *Catalog, platform_state *Pla
       thread_mutex_unlock(&Catalog->EntryMutex);
     }
 
-    load_texture_work *Work = (load_texture_work*)calloc(1, sizeof(load_texture_work));
-    Work->TextureCatalog = Catalog;
-    Work->ReferenceName = ReferenceName;
-    Platform->Interface.WorkQueueAddEntry(Platform->Input.WorkQueue, LoadTextureCallback, (void*)Work);
+    Assert(sizeof(load_texture_work) <= Catalog->WorkPool->BlockSize);
+    load_texture_work *Work = (load_texture_work*)MemoryPoolAlloc(Catalog->WorkPool);
+    if (Work)
+    {
+      Work->TextureCatalog = Catalog;
+      Work->Platform = Platform;
+      Work->ReferenceName = ReferenceName;
+      Platform->Interface.WorkQueueAddEntry(Platform->Input.WorkQueue, LoadTextureCallback, (void*)Work);
+    }
+    else
+    {
+      // NOTE: Every work block is in flight, so load it here instead. This
+      // stalls the frame, but the load is never dropped.
+      fprintf(stderr, "Textures: warning: work pool exhausted, loading '%s' synchronously\n", ReferenceName);
+      TextureCatalogLoadReference(Catalog, ReferenceName);
+      Result = TextureCatalogGet(Catalog, Platform, ReferenceName);
+    }
   }
   
   return(Result);
@@ -234,12 +264,26 @@ internal b32 TextureCatalogUpdate(texture_catalog *Catalog, platform_state *Plat
         Entry->Texture.Loading = true;
         
         // Queue a task to reload it.
-        reload_texture_work *Work = (reload_texture_work*)calloc(1, sizeof(reload_texture_work));
-        Work->TextureCatalog = Catalog;
-        Work->EntryIndex = I;
-        strncpy(Work->FileName, Iter.FileName, 256);
+        Assert(sizeof(reload_texture_work) <= Catalog->WorkPool->BlockSize);
+        reload_texture_work *Work = (reload_texture_work*)MemoryPoolAlloc(Catalog->WorkPool);
+        if (Work)
+        {
+          Work->TextureCatalog = Catalog;
+          Work->Platform = Platform;
+          Work->EntryIndex = I;
+          strncpy(Work->FileName, Iter.FileName, 256);
         
-        Platform->Interface.WorkQueueAddEntry(Platform->Input.WorkQueue, ReloadTextureCallback, (void*)Work);
+          // NOTE: Reloads can be slow for big images, so keep them out of the
+          // way of work the frame needs.
+          void *Data = (void*)Work;
+          Platform->Interface.WorkQueueAddEntries(Platform->Input.WorkQueue, WORK_QUEUE_PRIORITY_background, ReloadTextureCallback, &Data, 1, NULL);
+        }
+        else
+        {
+          // NOTE: No work block is free, so reload it here instead
+          TextureCatalogReloadEntry(Catalog, I, Iter.FileName);
+          Entry->Texture.Loading = false;
+        }
       }
     }
     
@@ -43,12 +43,99 @@ typedef struct texture_catalog {
   u32 volatile NumEntries;
   thread_mutex_t EntryMutex;
   texture_catalog_entry Entry[TEXTURE_CATALOG_MAX_TEXTURES];
+
+  // Load and reload work is allocated from here
+  memory_pool *WorkPool;
 } texture_catalog;
 
-internal b32 TextureCatalogInit(texture_catalog *Catalog);
+internal b32 TextureCatalogInit(texture_catalog *Catalog, memory_pool *WorkPool);
 internal void TextureCatalogDestroy(texture_catalog *Catalog);
 internal b32 TextureCatalogAdd(texture_catalog *Catalog, char *TextureFile, char *ReferenceName);
 internal texture TextureCatalogGet(texture_catalog *Catalog, platform_state *Platform, char *ReferenceName);
 internal b32 TextureCatalogUpdate(texture_catalog *Catalog, platform_state *Platform);
 
+///////////////////////////////////////////////////////////////////////////////
+// stb_image allocation
+
+// Arena stb_image allocates from on the calling thread, if any
+global __thread memory_arena *GlobalTextureScratch = NULL;
+
+// NOTE: Everything is released wholesale when the arena is, so frees do
+// nothing unless the block is the most recent allocation, and the most recent
+// allocation grows in place. Anything that doesn't fit goes to the heap.
+internal b32 TextureScratchOwns(memory_arena *Arena, void *Pointer)
+{
+  return(Arena && (u8*)Pointer >= Arena->Base && (u8*)Pointer < Arena->Base + Arena->Size);
+}
+
+internal void* TextureScratchAlloc(size_t Size)
+{
+  memory_arena *Arena = GlobalTextureScratch;
+  if (Arena)
+  {
+    umm Padding = (16 - ((umm)(Arena->Base + Arena->Used) & 15)) & 15;
+    if (Arena->Used + Padding + Size <= Arena->Size)
+    {
+      return(ArenaAllocNoZero(Arena, Size, 16));
+    }
+  }
+  return(malloc(Size));
+}
+
+internal void* TextureScratchRealloc(void *Pointer, size_t OldSize, size_t NewSize)
+{
+  memory_arena *Arena = GlobalTextureScratch;
+  if (Pointer == NULL)
+  {
+    return(TextureScratchAlloc(NewSize));
+  }
+  if (!TextureScratchOwns(Arena, Pointer))
+  {
+    return(realloc(Pointer, NewSize));
+  }
+
+  u8 *End = Arena->Base + Arena->Used;
+  if ((u8*)Pointer + OldSize == End && (u8*)Pointer + NewSize <= Arena->Base + Arena->Size)
+  {
+    // NOTE: Going through the arena keeps it committing the memory grown into
+    Arena->Used = (u8*)Pointer - Arena->Base;
+    return(ArenaAllocNoZero(Arena, NewSize, 1));
+  }
+
+  void *Result = TextureScratchAlloc(NewSize);
+  if (Result)
+  {
+    MemoryCopy(Result, Pointer, Min(OldSize, NewSize));
+  }
+  return(Result);
+}
+
+// NOTE: Only the GIF loader reallocates without passing the old size. The
+// block can't be grown in place without it, but it can't extend past the end
+// of the arena's allocations either, so that bounds the copy.
+internal void* TextureScratchReallocUnsized(void *Pointer, size_t NewSize)
+{
+  memory_arena *Arena = GlobalTextureScratch;
+  if (!TextureScratchOwns(Arena, Pointer))
+  {
+    return(realloc(Pointer, NewSize));
+  }
+
+  umm Available = (Arena->Base + Arena->Used) - (u8*)Pointer;
+  void *Result = TextureScratchAlloc(NewSize);
+  if (Result)
+  {
+    MemoryCopy(Result, Pointer, Min(Available, (umm)NewSize));
+  }
+  return(Result);
+}
+
+internal void TextureScratchFree(void *Pointer)
+{
+  if (Pointer && !TextureScratchOwns(GlobalTextureScratch, Pointer))
+  {
+    free(Pointer);
+  }
+}
+
 #endif // GAME_TEXTURES_H
@@ -27,6 +27,129 @@ internal void CommandMap(console *Console, app_context Ctx, char *Args)
   }
 }
 
+// Logs a histogram as one line of per-bucket counts.
+internal void ConsoleLogHistogram(console *Console, char *Name, u32 *Histogram)
+{
+  char Line[256];
+  i32 Length = snprintf(Line, ArrayCount(Line), "Audio: %s", Name);
+  foreach(I, PLATFORM_AUDIO_HISTOGRAM_BUCKETS)
+  {
+    Length += snprintf(Line + Length, ArrayCount(Line) - Length, " %d", Histogram[I]);
+  }
+  ConsoleLog(Console, Line);
+}
+
+internal void CommandAudio(console *Console, app_context Ctx, char *Args)
+{
+  if (Args != NULL)
+  {
+    if (strcmp(Args, "debug") == 0) {
+      Ctx.Game->ShowAudioDebug = !Ctx.Game->ShowAudioDebug;
+      ConsoleLogf(Console, "Audio Debug: %s", Ctx.Game->ShowAudioDebug ? "on" : "off");
+    }
+    return;
+  }
+
+  audio_mix_stats Stats = AudioPlayerGetStats(&Ctx.Game->AudioPlayer);
+  ConsoleLogf(Console, "Audio: %d/%d voices, %d real, %d virtual, %d stolen",
+              Stats.ActiveVoices, AUDIO_MAX_VOICES, Stats.RealVoices, Stats.VirtualVoices, Stats.StolenVoices);
+  ConsoleLogf(Console, "Audio: %d voices mixed, %0.02f cycles/voice/frame",
+              Stats.VoicesMixed, Stats.CyclesPerVoiceFrame);
+  ConsoleLogf(Console, "Audio: bus kcycles master %0.01f, music %0.01f, sfx %0.01f, ui %0.01f",
+              Stats.BusCycles[AUDIO_BUS_master] / 1000.0f, Stats.BusCycles[AUDIO_BUS_music] / 1000.0f,
+              Stats.BusCycles[AUDIO_BUS_sfx] / 1000.0f, Stats.BusCycles[AUDIO_BUS_ui] / 1000.0f);
+
+  platform_audio_stats *PlatformStats = &Ctx.Platform->Input.Audio;
+  ConsoleLogf(Console, "Audio: %d frames buffered", PlatformStats->BufferedFrames);
+  ConsoleLogf(Console, "Audio: %0.02f ms output latency (%s, %0.02f ms target), %d frames/period, %d xruns, %s",
+              PlatformStats->OutputLatencyMS, PlatformStats->LatencyMode, PlatformStats->TargetLatencyMS, PlatformStats->PeriodFrames,
+              PlatformStats->DeviceXRuns, PlatformStats->RealTime ? "real-time" : "normal priority");
+  ConsoleLogf(Console, "Audio: %0.03f ms last mix, %0.03f ms max mix, %d periods silenced",
+              PlatformStats->MixTimeLastMS, PlatformStats->MixTimeMaxMS, PlatformStats->SilencedPeriods);
+  ConsoleLogHistogram(Console, "fill (tenths of buffer):", PlatformStats->FillHistogram);
+  ConsoleLogHistogram(Console, "mix time (tenths of period):", PlatformStats->MixTimeHistogram);
+}
+
+internal void CommandJobs(console *Console, app_context Ctx, char *Args)
+{
+  local_persist const char *LaneNames[WORK_QUEUE_PRIORITY_COUNT] = {
+    [WORK_QUEUE_PRIORITY_high] = "high",
+    [WORK_QUEUE_PRIORITY_normal] = "normal",
+    [WORK_QUEUE_PRIORITY_background] = "background"
+  };
+
+  platform_work_queue_stats Stats = {};
+  Ctx.Platform->Interface.WorkQueueGetStats(Ctx.Platform->Input.WorkQueue, &Stats);
+  ConsoleLogf(Console, "Jobs: %d workers", Stats.WorkerCount);
+  foreach(I, WORK_QUEUE_PRIORITY_COUNT)
+  {
+    platform_work_lane_stats *Lane = Stats.Lanes + I;
+    ConsoleLogf(Console, "Jobs: %-10s %4d queued, %6d run, %0.03f ms avg wait, %0.03f ms max wait",
+                LaneNames[I], Lane->Depth, Lane->Taken, Lane->WaitAverageMS, Lane->WaitMaxMS);
+  }
+}
+
+internal void CommandFrame(console *Console, app_context Ctx, char *Args)
+{
+  if (Args != NULL)
+  {
+    if (strcmp(Args, "lowlatency") == 0) {
+      Ctx.Platform->Shared.LowLatency = !Ctx.Platform->Shared.LowLatency;
+      ConsoleLogf(Console, "Frame: Low Latency: %s", Ctx.Platform->Shared.LowLatency ? "on" : "off");
+    } else if (strcmp(Args, "vsync") == 0) {
+      Ctx.Platform->Shared.VSync = !Ctx.Platform->Shared.VSync;
+      ConsoleLogf(Console, "Frame: VSync: %s", Ctx.Platform->Shared.VSync ? "on" : "off");
+    } else if (strcmp(Args, "fps") == 0) {
+      char *Value = strtok(NULL, " ");
+      if (Value != NULL) {
+        Ctx.Platform->Shared.TargetFPS = atoi(Value);
+      }
+      ConsoleLogf(Console, "Frame: Target FPS: %d", Ctx.Platform->Shared.TargetFPS);
+    }
+    return;
+  }
+
+  platform_frame_stats *Stats = &Ctx.Platform->Input.Frame;
+  ConsoleLogf(Console, "Frame: VSync %s, low latency %s, %d target fps",
+              Ctx.Platform->Shared.VSync ? "on" : "off", Ctx.Platform->Shared.LowLatency ? "on" : "off",
+              Ctx.Platform->Shared.TargetFPS);
+  ConsoleLogf(Console, "Frame: %0.03f ms period, %0.03f ms render estimate, %0.03f ms spin, %0.03f ms last wait",
+              Stats->FramePeriodMS, Stats->RenderEstimateMS, Stats->SpinMS, Stats->WaitMS);
+  ConsoleLogf(Console, "Frame: %d missed deadlines", Stats->MissedDeadlines);
+}
+
+// Logs how much of an arena is in use and how much it has committed.
+internal void ConsoleLogArena(console *Console, char *Name, memory_arena *Arena)
+{
+  ConsoleLogf(Console, "Memory: %-10s %8.02f MB used, %8.02f MB committed, %8.02f MB reserved, %d heap blocks",
+              Name, Arena->Used / (f32)Megabytes(1), Arena->Committed / (f32)Megabytes(1),
+              Arena->Size / (f32)Megabytes(1), Arena->BlockCount);
+}
+
+internal void CommandMemory(console *Console, app_context Ctx, char *Args)
+{
+  ConsoleLogArena(Console, "permanent", &Ctx.Game->PermanentArena);
+  ConsoleLogArena(Console, "audio", &Ctx.Game->AudioPlayer.AudioArena);
+  ConsoleLogArena(Console, "pcm cache", &Ctx.Game->SoundManager.PCMCache);
+  ConsoleLogArena(Console, "transient", &Ctx.Game->TransientArena);
+  ConsoleLogf(Console, "Memory: work pool %d/%d blocks", Ctx.Game->WorkPool.Used, Ctx.Game->WorkPool.BlockCount);
+}
+
+internal void CommandFonts(console *Console, app_context Ctx, char *Args)
+{
+  font_manager *FontManager = &Ctx.Game->FontManager;
+  foreach(I, FontManager->NumFonts)
+  {
+    font *Font = FontManager->Fonts[I];
+    text_layout_cache *Cache = &Font->LayoutCache;
+    memory_arena *Arena = Cache->Arena + Cache->Generation;
+    ConsoleLogf(Console, "Fonts: %-24s %3dpx, %4d layouts, %0.02f/%0.02f MB, %d hits, %d misses last frame",
+                Font->FontFile, Font->FontSizePixels, Cache->NumLayouts,
+                Arena->Used / (f32)Megabytes(1), Arena->Size / (f32)Megabytes(1),
+                Cache->LastFrameHits, Cache->LastFrameMisses);
+  }
+}
+
 internal console_style DefaultConsoleStyle = {
   .ThumbPadding = 2.0f,
   .Colors = {
@@ -37,7 +160,12 @@ internal console_style DefaultConsoleStyle = {
 
 internal console_command ConsoleCommands[] = {
   { .Command = "camera", .Cmd = CommandCamera },
-  { .Command = "map", .Cmd = CommandMap }
+  { .Command = "map", .Cmd = CommandMap },
+  { .Command = "audio", .Cmd = CommandAudio },
+  { .Command = "jobs", .Cmd = CommandJobs },
+  { .Command = "frame", .Cmd = CommandFrame },
+  { .Command = "memory", .Cmd = CommandMemory },
+  { .Command = "fonts", .Cmd = CommandFonts }
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -128,13 +256,16 @@ internal void ConsoleLog(console *Console, const char *Text)
   if (Console->LogLineCount >= ArrayCount(Console->Log)) {
     for (u32 I = 1; I < Console->LogLineCount; ++I)
     {
-      strncpy(Console->Log[I - 1], Console->Log[I], 64);
+      strncpy(Console->Log[I - 1], Console->Log[I], DEBUG_CONSOLE_MAX_LINE_LENGTH);
     }
     
     Console->LogLineCount -= 1;
   }
   
-  strncpy(Console->Log[Console->LogLineCount++], Text, 64);
+  // NOTE: Long lines are truncated, strncpy does not terminate them itself
+  char *Line = Console->Log[Console->LogLineCount++];
+  strncpy(Line, Text, DEBUG_CONSOLE_MAX_LINE_LENGTH - 1);
+  Line[DEBUG_CONSOLE_MAX_LINE_LENGTH - 1] = 0;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -592,7 +723,7 @@ internal void ConsoleUpdate(console *Console, app_context Ctx, u64 DeltaTimeMicr
         if (Console->SelectionStart != Console->SelectionEnd)
         {
           scoped_arena ScopedArena(Console->TransientArena);
-          char *Data = ScopedArenaPushArray(&ScopedArena, Console->SelectionEnd - Console->SelectionStart, char);
+          char *Data = ScopedArenaPushArray(&ScopedArena, Console->SelectionEnd - Console->SelectionStart + 1, char);
           strncpy(Data, Console->Input + Console->SelectionStart, Console->SelectionEnd - Console->SelectionStart);
           Ctx.Platform->Interface.SetClipboardText(Data);
         }
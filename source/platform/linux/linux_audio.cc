@@ -4,121 +4,121 @@
 #define AUDIO_DEFAULT_CHANNELS 2
 #define AUDIO_DEFAULT_DEVICE_NAME "default"
 
-// Represents our circular audio buffer queue. Stores data from the game on its
-// way to the audio card for the audio thread to later read.
-typedef struct circular_audio_buffer {
-  i16 *Samples;
-  u32 SampleCount;
-  u32 ReadCursor;
-  u32 WriteCursor;
-} circular_audio_buffer;
-
-internal void CircularAudioBufferCreate(circular_audio_buffer *CircularBuffer, u32 SampleCount);
-internal void CircularAudioBufferDestroy(circular_audio_buffer *CircularBuffer);
-internal u32 CircularAudioBufferFramesToWrite(circular_audio_buffer *CircularBuffer);
-internal void CircularAudioBufferWrite(circular_audio_buffer *CircularBuffer, i16 *Samples, u32 SampleCount);
-internal void CircularAudioBufferRead(circular_audio_buffer *CircularBuffer, i16 *Samples, u32 SampleCount);
-
-internal void CircularAudioBufferCreate(circular_audio_buffer *CircularBuffer, u32 SampleCount)
-{
-  printf("\tCircular buffer size: %d samples\n", SampleCount);
-  CircularBuffer->Samples = (i16 *)calloc(1, SampleCount * sizeof(i16));
-  CircularBuffer->SampleCount = SampleCount;
-  CircularBuffer->ReadCursor = 0;
-  CircularBuffer->WriteCursor = 0;
-}
-
-internal void CircularAudioBufferDestroy(circular_audio_buffer *CircularBuffer)
-{
-  free(CircularBuffer->Samples);
-}
-
-internal u32 CircularAudioBufferFramesToWrite(circular_audio_buffer *CircularBuffer)
-{
-  u32 ReadCursor = CircularBuffer->ReadCursor;
-  u32 SamplesToWrite = 0;
-  if (ReadCursor < CircularBuffer->WriteCursor)
-  {
-    // NOTE: Go right up to the read cursor but do not overwrite it in order to
-    // prevent overrun and audio pops.
-    SamplesToWrite = (CircularBuffer->SampleCount - CircularBuffer->WriteCursor) + (ReadCursor - 1);
-  }
-  else
-  {
-    SamplesToWrite = (ReadCursor - CircularBuffer->WriteCursor);
-  }
-
-  // NOTE: We divide by 4 and then pick the next power of 2 here in order to
-  // prevent overflowing things when a large audio write is required by
-  // requesting more samples than the platform-layer buffer can hold.
-  return(NextPowerOf2(SamplesToWrite >> 2));
-}
-
-internal void CircularAudioBufferWrite(circular_audio_buffer *CircularBuffer, i16 *SamplesIn, u32 SampleCount)
-{
-  // @Performance: Replace this with something more efficient. Possible using
-  // memcpy.
-  foreach(I, SampleCount)
-  {
-    CircularBuffer->Samples[CircularBuffer->WriteCursor++] = *SamplesIn++;
-    if (CircularBuffer->WriteCursor == CircularBuffer->ReadCursor)
-    {
-      // Overrun
-      // Assert(CircularBuffer->WriteCursor != CircularBuffer->ReadCursor);
-    }
-
-    if (CircularBuffer->WriteCursor >= CircularBuffer->SampleCount)
-    {
-      CircularBuffer->WriteCursor = 0;
-    }
-  }
-}
-
-internal void CircularAudioBufferRead(circular_audio_buffer *CircularBuffer, i16 *SamplesOut, u32 SampleCount)
-{
-  foreach(I, SampleCount)
-  {
-    *SamplesOut++ = CircularBuffer->Samples[CircularBuffer->ReadCursor++];
-    if (CircularBuffer->ReadCursor == CircularBuffer->WriteCursor)
-    {
-      // Underrun. Note than an underrun is expected right at audio thread
-      // start but should not happen again in practice as we try to write enough
-      // to handle any level of greed for samples from the audio thread.
-    }
-
-    if (CircularBuffer->ReadCursor >= CircularBuffer->SampleCount)
-    {
-      CircularBuffer->ReadCursor = 0;
-    }
-  }
-}
+// The audio thread asks for this SCHED_FIFO priority, or the highest that
+// RLIMIT_RTPRIO allows if that is lower.
+#define AUDIO_THREAD_RT_PRIORITY 50
+
+// Environment variable that picks the latency mode by name, overriding
+// LinuxAudioChooseLatency's choice
+#define AUDIO_LATENCY_ENV "ENGINE_AUDIO_LATENCY"
+
+// How long the audio thread blocks waiting on the device before it checks
+// whether it should exit.
+#define AUDIO_WAIT_TIMEOUT_MS 100
+
+// Selects the device's period and buffer sizes. Lower latency needs smaller
+// periods, which wake the audio thread more often and leave less room for a
+// late mix before the device underruns.
+typedef enum linux_audio_latency {
+  LINUX_AUDIO_LATENCY_low,      // ~10ms, needs real-time scheduling
+  LINUX_AUDIO_LATENCY_balanced, // ~20ms
+  LINUX_AUDIO_LATENCY_safe,     // ~50ms, for loaded systems and sound servers
+  LINUX_AUDIO_LATENCY_COUNT
+} linux_audio_latency;
+
+typedef struct linux_audio_latency_mode {
+  char *Name;
+  u32 TargetMS;
+  u32 Periods;
+} linux_audio_latency_mode;
+
+internal linux_audio_latency_mode LinuxAudioLatencyModes[LINUX_AUDIO_LATENCY_COUNT] = {
+  [LINUX_AUDIO_LATENCY_low]      = { .Name = "low",      .TargetMS = 10, .Periods = 2 },
+  [LINUX_AUDIO_LATENCY_balanced] = { .Name = "balanced", .TargetMS = 20, .Periods = 3 },
+  [LINUX_AUDIO_LATENCY_safe]     = { .Name = "safe",     .TargetMS = 50, .Periods = 4 },
+};
 
 typedef struct linux_audio {
+  linux_audio_latency Latency;
   i32                Channels;
   u32                SamplesPerSecond;
   u32                BytesPerSample;
   f32                PeriodTimeMS;
+  f32                TargetLatencyMS;
   snd_pcm_uframes_t  BufferSize;
   snd_pcm_uframes_t  PeriodSize;
-  i16*               SamplesIn;
   i16*               SamplesOut;
   snd_pcm_t         *Handle;
   b32                IsPlaying;
   b32                ExitThread;
   thread_ptr_t       Thread;
-  circular_audio_buffer CircularBuffer;
+
+  // NOTE: Written only by the audio thread
+  u32 volatile       DeviceDelayFrames;
+  u32 volatile       DeviceXRuns;
+  b32 volatile       RealTime;
+  u32 volatile       FillHistogram[PLATFORM_AUDIO_HISTOGRAM_BUCKETS];
+  u32 volatile       MixTimeHistogram[PLATFORM_AUDIO_HISTOGRAM_BUCKETS];
+  u32 volatile       MixMicrosLast;
+  u32 volatile       MixMicrosMax;
+  u32 volatile       SilencedPeriods;
+
+  // NOTE: Game audio is pulled from here by the audio thread
+  game_library      *Game;
+  platform_state    *Platform;
 } linux_audio;
 
-internal b32 LinuxAudioCreate(linux_audio *Audio, i32 LatencyMS, u32 SamplesPerSecond);
+internal linux_audio_latency LinuxAudioChooseLatency(void);
+internal b32 LinuxAudioCreate(linux_audio *Audio, linux_audio_latency Latency, u32 SamplesPerSecond);
 internal void LinuxAudioDestroy(linux_audio *Audio);
-internal void LinuxAudioStart(linux_audio *Audio);
-internal u32 LinuxAudioFramesToWrite(linux_audio *Audio);
-internal void LinuxAudioFill(linux_audio *Audio, i16 *Samples, u32 FrameCount);
+internal void LinuxAudioStart(linux_audio *Audio, game_library *Game, platform_state *Platform);
+internal void LinuxAudioMixPeriod(linux_audio *Audio, i16 *Samples);
+internal void LinuxAudioGetStats(linux_audio *Audio, platform_audio_stats *Stats);
+internal void LinuxAudioHistogramAdd(u32 volatile *Histogram, u64 Value, u64 Range);
+internal b32 LinuxAudioRecover(linux_audio *Audio, i32 Error);
+internal i32 LinuxAudioRealTimePriority(void);
+internal void LinuxAudioSetRealTime(linux_audio *Audio);
 internal i32 LinuxAudioThreadLoop(void *UserData);
 
-internal b32 LinuxAudioCreate(linux_audio *Audio, i32 LatencyMS, u32 SamplesPerSecond)
+// Picks the latency mode from AUDIO_LATENCY_ENV, or balanced if it isn't set.
+// Low latency is only used if the audio thread will get real-time
+// scheduling, as without it the short periods underrun under any load.
+internal linux_audio_latency LinuxAudioChooseLatency(void)
+{
+  linux_audio_latency Result = LINUX_AUDIO_LATENCY_balanced;
+
+  char *Name = getenv(AUDIO_LATENCY_ENV);
+  if (Name)
+  {
+    b32 Found = false;
+    foreach(I, LINUX_AUDIO_LATENCY_COUNT)
+    {
+      if (strcmp(Name, LinuxAudioLatencyModes[I].Name) == 0)
+      {
+        Result = (linux_audio_latency)I;
+        Found = true;
+      }
+    }
+
+    if (!Found)
+    {
+      fprintf(stderr, "Audio: Unknown latency mode '%s', using %s\n", Name, LinuxAudioLatencyModes[Result].Name);
+    }
+  }
+
+  if (Result == LINUX_AUDIO_LATENCY_low && LinuxAudioRealTimePriority() == 0)
+  {
+    fprintf(stderr, "Audio: Low latency needs real-time scheduling, which is not permitted. Using balanced.\n");
+    Result = LINUX_AUDIO_LATENCY_balanced;
+  }
+
+  return(Result);
+}
+
+internal b32 LinuxAudioCreate(linux_audio *Audio, linux_audio_latency Latency, u32 SamplesPerSecond)
 {
   // TODO: Add 4 and 6 channel surround sound support
+  Audio->Latency = Latency;
   Audio->Channels = AUDIO_DEFAULT_CHANNELS;
   Audio->SamplesPerSecond = SamplesPerSecond;
   Audio->BytesPerSample = sizeof(i16) * AUDIO_DEFAULT_CHANNELS;
@@ -167,15 +167,11 @@ internal b32 LinuxAudioCreate(linux_audio *Audio, i32 LatencyMS, u32 SamplesPerS
   Result = snd_pcm_hw_params_set_rate_near(AudioHandle, HWParams, &Audio->SamplesPerSecond, 0);
   CHECK_ALSA_RESULT(Result);
 
-  // Calculate the audio buffer size based on the desired audio latency in
-  // milliseconds.
-  u32 Periods = 2;
-  snd_pcm_uframes_t BufferFrames = NextPowerOf2(LatencyMS * Audio->SamplesPerSecond / 1000);
-  Audio->BufferSize = BufferFrames * Periods;
-  Audio->PeriodSize = BufferFrames;
-
-  Result = snd_pcm_hw_params_set_buffer_size_near(AudioHandle, HWParams, &Audio->BufferSize);
-  CHECK_ALSA_RESULT(Result);
+  // Split the target latency into periods. The device rounds both to what it
+  // supports, so the sizes are read back once the parameters are applied.
+  linux_audio_latency_mode *Mode = LinuxAudioLatencyModes + Latency;
+  u32 Periods = Mode->Periods;
+  Audio->PeriodSize = (Mode->TargetMS * Audio->SamplesPerSecond) / (1000 * Periods);
 
   Result = snd_pcm_hw_params_set_period_size_near(AudioHandle, HWParams, &Audio->PeriodSize, 0);
   CHECK_ALSA_RESULT(Result);
@@ -183,17 +179,24 @@ internal b32 LinuxAudioCreate(linux_audio *Audio, i32 LatencyMS, u32 SamplesPerS
   Result = snd_pcm_hw_params_set_periods_near(AudioHandle, HWParams, &Periods, 0);
   CHECK_ALSA_RESULT(Result);
 
+  Result = snd_pcm_hw_params(AudioHandle, HWParams);
+  CHECK_ALSA_RESULT(Result);
+
+  Result = snd_pcm_hw_params_get_period_size(HWParams, &Audio->PeriodSize, 0);
+  CHECK_ALSA_RESULT(Result);
+
+  Result = snd_pcm_hw_params_get_buffer_size(HWParams, &Audio->BufferSize);
+  CHECK_ALSA_RESULT(Result);
+
+  Audio->TargetLatencyMS = (Audio->BufferSize * 1000) / (f32)Audio->SamplesPerSecond;
   printf(
-    "\tBuffer: %lu bytes, %lu frames, %u periods, %0.02f ms calculated latency\n",
+    "\tBuffer: %s latency, %lu frames, %lu frames/period, %0.02f ms calculated latency\n",
+    Mode->Name,
     Audio->BufferSize,
     Audio->PeriodSize,
-    Periods,
-    (Audio->PeriodSize * Periods * 1000) / (f32)(Audio->SamplesPerSecond * Audio->BytesPerSample)
+    Audio->TargetLatencyMS
   );
 
-  Result = snd_pcm_hw_params(AudioHandle, HWParams);
-  CHECK_ALSA_RESULT(Result);
-
   // Get period time in milliseconds
   u32 PeriodTimeMicroSecs = 0;
   Result = snd_pcm_hw_params_get_period_time(HWParams, &PeriodTimeMicroSecs, 0);
@@ -218,22 +221,13 @@ internal b32 LinuxAudioCreate(linux_audio *Audio, i32 LatencyMS, u32 SamplesPerS
   CHECK_ALSA_RESULT(Result);
 
   // Allocate sample buffers
-  Audio->SamplesIn = (i16 *)calloc(1, sizeof(i16) * Audio->PeriodSize * Audio->Channels);
   Audio->SamplesOut = (i16 *)calloc(1, sizeof(i16) * Audio->PeriodSize * Audio->Channels);
 
   Audio->Handle = AudioHandle;
 
-  // NOTE: @Portability: The MaxBufferedPeriods size is very important for
-  // preventing audio underruns. This was tuned by hand to produce good audio
-  // with low latency at 60 FPS, may not port to different machines or
-  // framerates.
-  u32 MaxBufferedPeriods = Audio->BufferSize >> 2;
-  CircularAudioBufferCreate(&Audio->CircularBuffer, MaxBufferedPeriods * Audio->PeriodSize * Audio->Channels);
-
   // Start audio thread
   printf("Audio: Thread: Starting\n");
   Audio->Thread = thread_create(LinuxAudioThreadLoop, Audio, THREAD_STACK_SIZE_DEFAULT);
-  thread_set_high_priority(Audio->Thread);
 
   return(true);
 }
@@ -255,21 +249,17 @@ internal void LinuxAudioDestroy(linux_audio *Audio)
     Audio->Handle = NULL;
   }
 
-  if (Audio->SamplesIn)
-  {
-    free(Audio->SamplesIn);
-  }
-
   if (Audio->SamplesOut)
   {
     free(Audio->SamplesOut);
   }
-
-  CircularAudioBufferDestroy(&Audio->CircularBuffer);
 }
 
-internal void LinuxAudioStart(linux_audio *Audio)
+internal void LinuxAudioStart(linux_audio *Audio, game_library *Game, platform_state *Platform)
 {
+  Audio->Game = Game;
+  Audio->Platform = Platform;
+  CompletePreviousWritesBeforeFutureWrites;
   Audio->IsPlaying = true;
 }
 
@@ -295,73 +285,219 @@ internal void WriteSineWave(i16* Samples, i32 SamplesPerSecond, f32* Time, u32 F
   }
 }
 
-internal u32 LinuxAudioFramesToWrite(linux_audio *Audio)
+// Mixes one period of game audio into Samples.
+internal void LinuxAudioMixPeriod(linux_audio *Audio, i16 *Samples)
+{
+  audio_buffer Buffer = {};
+  Buffer.Samples = Samples;
+  Buffer.FrameCount = Audio->PeriodSize;
+  Buffer.SamplesPerSecond = Audio->SamplesPerSecond;
+
+  // NOTE: The library lock keeps the game from being unloaded mid-mix. The
+  // main thread holds it across the whole reload, so rather than have a
+  // real-time thread wait on it the period goes out silent.
+  if (pthread_mutex_trylock(&Audio->Game->Lock) != 0)
+  {
+    memset(Samples, 0, Audio->PeriodSize * Audio->BytesPerSample);
+    AtomicStoreReleaseU32(&Audio->SilencedPeriods, Audio->SilencedPeriods + 1);
+    return;
+  }
+
+  u64 MixStart = LinuxGetTimeMicros();
+  Audio->Game->GetSoundSamples(Audio->Platform, &Buffer);
+  u32 MixMicros = (u32)(LinuxGetTimeMicros() - MixStart);
+  pthread_mutex_unlock(&Audio->Game->Lock);
+
+  AtomicStoreReleaseU32(&Audio->MixMicrosLast, MixMicros);
+  if (MixMicros > Audio->MixMicrosMax)
+  {
+    AtomicStoreReleaseU32(&Audio->MixMicrosMax, MixMicros);
+  }
+  LinuxAudioHistogramAdd(Audio->MixTimeHistogram, MixMicros, (u64)(Audio->PeriodTimeMS * 1000.0f));
+}
+
+// Called from the main thread to export the audio thread's counters.
+internal void LinuxAudioGetStats(linux_audio *Audio, platform_audio_stats *Stats)
+{
+  Stats->BufferedFrames = AtomicLoadAcquireU32(&Audio->DeviceDelayFrames);
+  Stats->DeviceXRuns = AtomicLoadAcquireU32(&Audio->DeviceXRuns);
+  Stats->PeriodFrames = Audio->PeriodSize;
+  Stats->RealTime = AtomicLoadAcquireU32((u32 volatile *)&Audio->RealTime);
+  Stats->TargetLatencyMS = Audio->TargetLatencyMS;
+  Stats->LatencyMode = LinuxAudioLatencyModes[Audio->Latency].Name;
+
+  // NOTE: Audio mixed now reaches the speakers after everything already queued
+  // in the device.
+  Stats->OutputLatencyMS = (Stats->BufferedFrames * 1000) / (f32)Audio->SamplesPerSecond;
+
+  // NOTE: Buckets are read one at a time, so a histogram may be a period out
+  // of date in places. That is fine for telemetry.
+  foreach(I, PLATFORM_AUDIO_HISTOGRAM_BUCKETS)
+  {
+    Stats->FillHistogram[I] = AtomicLoadAcquireU32(Audio->FillHistogram + I);
+    Stats->MixTimeHistogram[I] = AtomicLoadAcquireU32(Audio->MixTimeHistogram + I);
+  }
+  Stats->MixTimeLastMS = AtomicLoadAcquireU32(&Audio->MixMicrosLast) / 1000.0f;
+  Stats->MixTimeMaxMS = AtomicLoadAcquireU32(&Audio->MixMicrosMax) / 1000.0f;
+  Stats->SilencedPeriods = AtomicLoadAcquireU32(&Audio->SilencedPeriods);
+}
+
+// Audio thread only. Counts Value in the bucket covering its fraction of
+// Range.
+internal void LinuxAudioHistogramAdd(u32 volatile *Histogram, u64 Value, u64 Range)
+{
+  u32 Bucket = PLATFORM_AUDIO_HISTOGRAM_BUCKETS - 1;
+  if (Range > 0 && Value < Range)
+  {
+    Bucket = (u32)((Value * PLATFORM_AUDIO_HISTOGRAM_BUCKETS) / Range);
+  }
+  AtomicStoreReleaseU32(Histogram + Bucket, Histogram[Bucket] + 1);
+}
+
+// Recovers the device from an underrun or suspend. Returns false if it could
+// not be recovered.
+internal b32 LinuxAudioRecover(linux_audio *Audio, i32 Error)
 {
-  return(CircularAudioBufferFramesToWrite(&Audio->CircularBuffer));
+  // NOTE: I'm not sure of the benefits and trade-offs of each. Different
+  // examples do things differently, but recover seems to work better in the
+  // case of an underrun.
+  AtomicStoreReleaseU32(&Audio->DeviceXRuns, Audio->DeviceXRuns + 1);
+  Error = snd_pcm_recover(Audio->Handle, Error, 1);
+  if (Error < 0)
+  {
+    fprintf(stderr, "Audio: ALSA error: failed and cannot recover: %s\n", snd_strerror(Error));
+    return(false);
+  }
+  return(true);
 }
 
-internal void LinuxAudioFill(linux_audio *Audio, i16 *Samples, u32 FrameCount)
+// The SCHED_FIFO priority the audio thread may ask for, or 0 if it isn't
+// allowed any. Unprivileged users only get real-time priorities up to
+// RLIMIT_RTPRIO, which defaults to 0.
+internal i32 LinuxAudioRealTimePriority(void)
 {
-  CircularAudioBufferWrite(&Audio->CircularBuffer, Samples, FrameCount * 2);
+  i32 Result = AUDIO_THREAD_RT_PRIORITY;
+  struct rlimit Limit;
+  if (getuid() != 0 && getrlimit(RLIMIT_RTPRIO, &Limit) == 0 && Limit.rlim_cur != RLIM_INFINITY)
+  {
+    Result = Min(Result, (i32)Limit.rlim_cur);
+  }
+
+  if (Result < sched_get_priority_min(SCHED_FIFO))
+  {
+    Result = 0;
+  }
+
+  return(Result);
+}
+
+// Moves the calling thread to SCHED_FIFO so it is woken as soon as the device
+// wants audio. If that isn't allowed the thread keeps normal scheduling.
+internal void LinuxAudioSetRealTime(linux_audio *Audio)
+{
+  i32 Priority = LinuxAudioRealTimePriority();
+
+  i32 Error = EPERM;
+  if (Priority > 0)
+  {
+    struct sched_param Param = {};
+    Param.sched_priority = Priority;
+    Error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &Param);
+  }
+
+  if (Error == 0)
+  {
+    printf("Audio: Thread: Real-time priority %d\n", Priority);
+    AtomicStoreReleaseU32((u32 volatile *)&Audio->RealTime, true);
+  }
+  else
+  {
+    printf("Audio: Thread: Real-time scheduling not permitted, using normal priority\n");
+  }
 }
 
 internal i32 LinuxAudioThreadLoop(void *UserData)
 {
   linux_audio *Audio = (linux_audio *)UserData;
+  LinuxAudioSetRealTime(Audio);
 
   f32 Time = 0.0f;
 
   while (!Audio->ExitThread)
   {
-    i16 *Samples = Audio->SamplesOut;
-
-    if (!Audio->IsPlaying)
+    // NOTE: Sleep until the device has room for at least a period (its
+    // avail_min). The timeout only exists so that exit requests are seen.
+    i32 Ready = snd_pcm_wait(Audio->Handle, AUDIO_WAIT_TIMEOUT_MS);
+    if (Ready < 0)
     {
-      foreach(I, Audio->PeriodSize * Audio->Channels)
+      if (!LinuxAudioRecover(Audio, Ready))
       {
-        *Samples++ = 0;
+        break;
       }
+      continue;
     }
-    else
+
+    snd_pcm_sframes_t Avail = snd_pcm_avail_update(Audio->Handle);
+    if (Avail < 0)
     {
-#if 0
-      WriteSineWave(Samples, Audio->SamplesPerSecond, &Time, Audio->PeriodSize);
-#else
-      CircularAudioBufferRead(&Audio->CircularBuffer, Audio->SamplesOut, Audio->PeriodSize * Audio->Channels);
-#endif
+      if (!LinuxAudioRecover(Audio, Avail))
+      {
+        break;
+      }
+      continue;
     }
 
-    i32 ToWrite = Audio->PeriodSize;
-    i32 Total = 0;
+    if (Ready > 0)
+    {
+      snd_pcm_sframes_t Fill = Max((snd_pcm_sframes_t)Audio->BufferSize - Avail, 0);
+      LinuxAudioHistogramAdd(Audio->FillHistogram, Fill, Audio->BufferSize);
+    }
 
-    while (ToWrite && !Audio->ExitThread)
+    // NOTE: Mix only once the device has asked for audio, so that each period
+    // is as fresh as possible when it is written.
+    while (Avail >= (snd_pcm_sframes_t)Audio->PeriodSize && !Audio->ExitThread)
     {
-      u8 *Src = (u8 *)Audio->SamplesOut;
-      i32 Wrote = snd_pcm_writei(Audio->Handle, (void *)(Src + (Total * Audio->Channels)), ToWrite);
-
-      if (Wrote > 0) {
-        Total += Wrote;
-        ToWrite -= Wrote;
-      } else if (Wrote == -EAGAIN) {
-        LinuxSleep(1);
-      } else {
-        // NOTE: I'm not sure of the benefits and trade-offs of each. Different
-        // examples do things differently, but recover seems to work better in
-        // the case of an underrun.
+      i16 *Samples = Audio->SamplesOut;
+
+      if (!Audio->IsPlaying)
+      {
+        foreach(I, Audio->PeriodSize * Audio->Channels)
+        {
+          *Samples++ = 0;
+        }
+      }
+      else
+      {
 #if 0
-        snd_pcm_prepare(Audio->Handle);
+        WriteSineWave(Samples, Audio->SamplesPerSecond, &Time, Audio->PeriodSize);
 #else
-        Wrote = snd_pcm_recover(Audio->Handle, Wrote, 0);
-        if (Wrote < 0)
+        LinuxAudioMixPeriod(Audio, Samples);
+#endif
+      }
+
+      snd_pcm_sframes_t Wrote = snd_pcm_writei(Audio->Handle, Audio->SamplesOut, Audio->PeriodSize);
+      if (Wrote <= 0)
+      {
+        if (Wrote < 0 && Wrote != -EAGAIN && !LinuxAudioRecover(Audio, Wrote))
         {
-          fprintf(stderr, "Audio: ALSA error: failed and cannot recover: %s\n", snd_strerror(Wrote));
-          Audio->IsPlaying = false;
           Audio->ExitThread = true;
         }
-#endif
+        break;
       }
+
+      // NOTE: The device reported room for the whole period, so a short write
+      // only happens if it stopped in between. The rest of the period is
+      // dropped rather than delaying the next one.
+      Avail -= Wrote;
+    }
+
+    snd_pcm_sframes_t Delay = 0;
+    if (snd_pcm_delay(Audio->Handle, &Delay) == 0 && Delay >= 0)
+    {
+      AtomicStoreReleaseU32(&Audio->DeviceDelayFrames, (u32)Delay);
     }
   }
 
+  Audio->IsPlaying = false;
   return(0);
 }
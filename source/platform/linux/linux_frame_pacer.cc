@@ -0,0 +1,180 @@
+// NOTE: Paces the main loop to a deadline per frame. Waiting is done in two
+// parts: a sleep that ends a little early, as the scheduler can wake us late,
+// then a spin up to the deadline itself. How early the sleep ends follows how
+// late sleeps have actually been waking up.
+//
+// With VSync off, deadlines are Shared.TargetFPS apart. With VSync on, the
+// swap already waits for the display, so the pacer only does anything in low
+// latency mode, where deadlines follow the measured swap cadence instead.
+//
+// In low latency mode the wait happens before input is sampled, and ends the
+// estimated render time ahead of the deadline. Input is then as fresh as it
+// can be when the frame goes out. The GPU is also drained after each swap so
+// finished frames don't sit in a queue waiting to be shown.
+
+// Bounds on how early sleeps end ahead of a deadline
+#define LINUX_FRAME_PACER_MIN_SPIN_MICROS 200
+#define LINUX_FRAME_PACER_MAX_SPIN_MICROS 2000
+
+// Slack left between the render estimate and the deadline in low latency mode
+#define LINUX_FRAME_PACER_SAFETY_MICROS 1000
+
+typedef struct linux_frame_pacer {
+  // When the next frame should be presented
+  u64 DeadlineMicros;
+  u64 PeriodMicros;
+
+  u64 SpinMicros;
+  // Time from sampling input to the swap completing. Rises straight to any
+  // slower frame and falls back slowly, so one fast frame doesn't set up a
+  // miss on the next.
+  u64 RenderEstimateMicros;
+  // When this frame's input was sampled and when the last swap finished
+  u64 FrameStartMicros;
+  u64 LastSwapMicros;
+
+  u64 WaitMicros;
+  u32 MissedDeadlines;
+} linux_frame_pacer;
+
+internal void LinuxFramePacerInit(linux_frame_pacer *Pacer, i32 TargetFPS)
+{
+  Pacer->PeriodMicros = (TargetFPS > 0) ? 1000000 / TargetFPS : 0;
+  Pacer->SpinMicros = LINUX_FRAME_PACER_MAX_SPIN_MICROS / 2;
+  Pacer->RenderEstimateMicros = 0;
+  Pacer->FrameStartMicros = LinuxGetTimeMicros();
+  Pacer->LastSwapMicros = Pacer->FrameStartMicros;
+  Pacer->DeadlineMicros = Pacer->FrameStartMicros + Pacer->PeriodMicros;
+  Pacer->WaitMicros = 0;
+  Pacer->MissedDeadlines = 0;
+
+  // NOTE: The kernel pads sleeps by the thread's timer slack, 50us by
+  // default, so that nearby timers can be batched up. Ask for none.
+  prctl(PR_SET_TIMERSLACK, 1, 0, 0, 0);
+}
+
+// Sleeps then spins until the given time. Returns how late the sleep woke up
+// relative to when it was asked to, or 0 if it didn't sleep.
+internal u64 LinuxFramePacerWaitUntil(linux_frame_pacer *Pacer, u64 UntilMicros)
+{
+  u64 Oversleep = 0;
+  u64 Now = LinuxGetTimeMicros();
+  if (Now + Pacer->SpinMicros < UntilMicros)
+  {
+    u64 WakeMicros = UntilMicros - Pacer->SpinMicros;
+    LinuxSleepMicros(WakeMicros - Now);
+    Now = LinuxGetTimeMicros();
+    Oversleep = (Now > WakeMicros) ? Now - WakeMicros : 0;
+  }
+
+  while (Now < UntilMicros)
+  {
+    _mm_pause();
+    Now = LinuxGetTimeMicros();
+  }
+
+  return(Oversleep);
+}
+
+// Waits until it is time to start the next frame. Call before sampling input.
+internal void LinuxFramePacerBeginFrame(linux_frame_pacer *Pacer, platform_state *Platform)
+{
+  b32 VSync = Platform->Shared.VSync;
+  b32 LowLatency = Platform->Shared.LowLatency;
+  if (!VSync)
+  {
+    Pacer->PeriodMicros = (Platform->Shared.TargetFPS > 0) ? 1000000 / Platform->Shared.TargetFPS : 0;
+  }
+
+  u64 Start = LinuxGetTimeMicros();
+  b32 Paced = (Pacer->PeriodMicros > 0) && (!VSync || LowLatency);
+  if (Paced)
+  {
+    u64 WakeMicros = Pacer->DeadlineMicros;
+    if (LowLatency)
+    {
+      u64 Lead = Pacer->RenderEstimateMicros + LINUX_FRAME_PACER_SAFETY_MICROS;
+      WakeMicros = (WakeMicros > Lead) ? WakeMicros - Lead : 0;
+    }
+
+    if (Start > WakeMicros)
+    {
+      ++Pacer->MissedDeadlines;
+    }
+    else
+    {
+      u64 Oversleep = LinuxFramePacerWaitUntil(Pacer, WakeMicros);
+
+      // NOTE: Aim to stop sleeping twice the typical oversleep early. Drift
+      // towards it slowly, but jump straight up after a late wake.
+      u64 Spin = Clamp(2 * Oversleep, (u64)LINUX_FRAME_PACER_MIN_SPIN_MICROS, (u64)LINUX_FRAME_PACER_MAX_SPIN_MICROS);
+      Pacer->SpinMicros = (Spin > Pacer->SpinMicros) ? Spin : (7 * Pacer->SpinMicros + Spin) / 8;
+    }
+  }
+
+  Pacer->FrameStartMicros = LinuxGetTimeMicros();
+  Pacer->WaitMicros = Pacer->FrameStartMicros - Start;
+}
+
+// Call once the frame has been swapped. Works out the next frame's deadline.
+internal void LinuxFramePacerEndFrame(linux_frame_pacer *Pacer, platform_state *Platform)
+{
+  b32 VSync = Platform->Shared.VSync;
+  b32 LowLatency = Platform->Shared.LowLatency;
+
+  // NOTE: Without this the swap returns as soon as it is queued, which
+  // hides the render time and lets the driver buffer frames ahead.
+  if (LowLatency)
+  {
+    glFinish();
+  }
+
+  u64 Now = LinuxGetTimeMicros();
+  u64 RenderMicros = Now - Pacer->FrameStartMicros;
+  if (RenderMicros > Pacer->RenderEstimateMicros)
+  {
+    Pacer->RenderEstimateMicros = RenderMicros;
+  }
+  else
+  {
+    Pacer->RenderEstimateMicros = (15 * Pacer->RenderEstimateMicros + RenderMicros) / 16;
+  }
+
+  if (VSync)
+  {
+    // NOTE: Once the driver's queue is full each swap returns on a refresh,
+    // so the time between them is the refresh period. Skip intervals that
+    // span more than one refresh.
+    u64 Interval = Now - Pacer->LastSwapMicros;
+    if (Pacer->PeriodMicros == 0)
+    {
+      Pacer->PeriodMicros = Interval;
+    }
+    else if (2 * Interval < 3 * Pacer->PeriodMicros)
+    {
+      Pacer->PeriodMicros = (7 * Pacer->PeriodMicros + Interval) / 8;
+    }
+    Pacer->DeadlineMicros = Now + Pacer->PeriodMicros;
+  }
+  else
+  {
+    // NOTE: Keep deadlines on a fixed grid so the frame rate holds on
+    // average, but don't try to make up for a long stall with a burst.
+    Pacer->DeadlineMicros += Pacer->PeriodMicros;
+    if (Pacer->DeadlineMicros + Pacer->PeriodMicros < Now)
+    {
+      Pacer->DeadlineMicros = Now + Pacer->PeriodMicros;
+    }
+  }
+
+  Pacer->LastSwapMicros = Now;
+}
+
+internal void LinuxFramePacerGetStats(linux_frame_pacer *Pacer, platform_frame_stats *Stats)
+{
+  Stats->FramePeriodMS = Pacer->PeriodMicros / 1000.0f;
+  Stats->RenderEstimateMS = Pacer->RenderEstimateMicros / 1000.0f;
+  Stats->SpinMS = Pacer->SpinMicros / 1000.0f;
+  Stats->WaitMS = Pacer->WaitMicros / 1000.0f;
+  Stats->MissedDeadlines = Pacer->MissedDeadlines;
+}
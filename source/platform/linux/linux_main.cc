@@ -4,7 +4,13 @@
 #include <unistd.h>
 #include <dlfcn.h>
 #include <time.h>
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/prctl.h>
+#include <sched.h>
+#include <pthread.h>
 
 // NOTE: Linux is a weird platform with lots of non-obvious, poorly documented
 // methods for getting at certain functionality. Luckily, quite a few engines
@@ -48,36 +54,47 @@ void GameUpdateStub(platform_state *_Platform, f32 _DeltaTimeSecs) {}
 void GameShutdownStub(platform_state *_Platform) {}
 void GameOnFrameStartStub(platform_state *_Platform) {}
 void GameOnFrameEndStub(platform_state *_Platform) {}
+void GameGetSoundSamplesStub(platform_state *_Platform, audio_buffer *AudioBuffer)
+{
+  memset(AudioBuffer->Samples, 0, AudioBuffer->FrameCount * 2 * sizeof(i16));
+}
 
 typedef struct work_queue work_queue;
 typedef void work_queue_callback_fn(work_queue *Queue, void *Data);
 
 internal u64  LinuxGetTimeMs(void);
 internal void LinuxSleep(i32 SleepMS);
+internal void LinuxSleepMicros(u64 SleepMicros);
 
 internal f32   LinuxGetTimeSecs(void);
 internal void* LinuxGetOpenGLProcAddress(const char *ProcName);
 internal b32   LinuxLoadEntireFile(const char *FileName, platform_entire_file *FileOutput);
 internal void  LinuxFreeEntireFile(platform_entire_file *File);
+internal b32   LinuxMapFile(const char *FileName, platform_mapped_file *FileOutput);
+internal void  LinuxUnmapFile(platform_mapped_file *File);
+internal void  LinuxAdviseFileRange(platform_mapped_file *File, u32 Offset, u32 SizeBytes, platform_file_advice Advice);
 internal void  LinuxLog(const char *Format, ...);
 internal b32   LinuxSetClipboardText(const char *Text);
 internal char* LinuxGetClipboardText(scoped_arena* ScopedArena);
 internal void  LinuxWorkQueueAddEntry(work_queue *Queue, work_queue_callback_fn *Callback, void *UserData);
 internal void  LinuxWorkQueueCompleteAllWork(work_queue *Queue);
 
-// Linux layer specific files
-#include "linux_audio.cc"
-
 ///////////////////////////////////////////////////////////////////////////////
 
 typedef struct game_library {
   void *Handle;
   watched_file LibraryWatcher;
+
+  // NOTE: Held by the audio thread while it calls into the library and by the
+  // main thread while it reloads the library. A plain pthread mutex, as the
+  // audio thread only ever tries to take it.
+  pthread_mutex_t Lock;
   
   update_fn *Update;
   shutdown_fn *Shutdown;
   on_frame_start_fn *OnFrameStart;
   on_frame_end_fn *OnFrameEnd;
+  get_sound_samples_fn *GetSoundSamples;
 } game_library;
 
 void GameLibraryOpen(game_library *Game)
@@ -94,6 +111,8 @@ void GameLibraryOpen(game_library *Game)
       exit(1);
     }
     
+    pthread_mutex_init(&Game->Lock, NULL);
+
     // Force update on first pass through this function to ensure we try to
     // load the library before calling functions from it.
     ForceUpdate = true;
@@ -123,6 +142,8 @@ void GameLibraryOpen(game_library *Game)
       WasLockFile = false;
     }
     
+    pthread_mutex_lock(&Game->Lock);
+
     if (Game->Handle != NULL)
     {
       IsReload = true;
@@ -139,6 +160,7 @@ void GameLibraryOpen(game_library *Game)
       Game->Shutdown = (shutdown_fn*)dlsym(Game->Handle, "Shutdown");
       Game->OnFrameStart = (on_frame_start_fn*)dlsym(Game->Handle, "OnFrameStart");
       Game->OnFrameEnd = (on_frame_end_fn*)dlsym(Game->Handle, "OnFrameEnd");
+      Game->GetSoundSamples = (get_sound_samples_fn*)dlsym(Game->Handle, "GetSoundSamples");
     }
     else
     {
@@ -151,7 +173,10 @@ void GameLibraryOpen(game_library *Game)
       Game->Shutdown = GameShutdownStub;
       Game->OnFrameStart = GameOnFrameStartStub;
       Game->OnFrameEnd = GameOnFrameEndStub;
+      Game->GetSoundSamples = GameGetSoundSamplesStub;
     }
+
+    pthread_mutex_unlock(&Game->Lock);
   }
 }
 
@@ -161,8 +186,15 @@ void GameLibraryClose(game_library *Game)
   {
     dlclose(Game->Handle);
   }
+
+  pthread_mutex_destroy(&Game->Lock);
 }
 
+internal u64 LinuxGetTimeMicros(void);
+
+// Linux layer specific files
+#include "linux_audio.cc"
+
 ///////////////////////////////////////////////////////////////////////////////
 
 // NOTE: Use CLOCK_MONOTONIC_RAW if available as it is not subject to
@@ -220,10 +252,15 @@ internal f32 LinuxGetTimeSecs(void)
 }
 
 internal void LinuxSleep(i32 SleepMS)
+{
+  LinuxSleepMicros((u64)SleepMS * 1000);
+}
+
+internal void LinuxSleepMicros(u64 SleepMicros)
 {
   struct timespec TimeToSleep, TimeRemaining;
-  TimeRemaining.tv_sec = SleepMS / 1000;
-  TimeRemaining.tv_nsec = (SleepMS % 1000) * 1000000;
+  TimeRemaining.tv_sec = SleepMicros / 1000000;
+  TimeRemaining.tv_nsec = (SleepMicros % 1000000) * 1000;
   
   // NOTE: nanosleep can be interrupted if your application receives a signal
   // it has to handle during its sleep. In order to ensure we finish out our
@@ -271,6 +308,161 @@ internal void LinuxFreeEntireFile(platform_entire_file *File)
   File->SizeBytes = 0;
 }
 
+internal b32 LinuxMapFile(const char *FileName, platform_mapped_file *FileOutput)
+{
+  b32 Result = false;
+  int File = open(FileName, O_RDONLY);
+
+  if (File >= 0) {
+    struct stat FileStat;
+    if (fstat(File, &FileStat) == 0 && FileStat.st_size > 0) {
+      void *Data = mmap(NULL, FileStat.st_size, PROT_READ, MAP_PRIVATE, File, 0);
+      if (Data != MAP_FAILED) {
+        // NOTE: Mapped files are mostly read front to back, so have the
+        // kernel read ahead aggressively.
+        madvise(Data, FileStat.st_size, MADV_SEQUENTIAL);
+        FileOutput->Data = (u8*)Data;
+        FileOutput->SizeBytes = FileStat.st_size;
+        Result = true;
+      }
+    }
+
+    // NOTE: The mapping keeps the file open
+    close(File);
+  }
+
+  return(Result);
+}
+
+internal void LinuxUnmapFile(platform_mapped_file *File)
+{
+  if (File->Data) {
+    munmap(File->Data, File->SizeBytes);
+  }
+  File->Data = NULL;
+  File->SizeBytes = 0;
+}
+
+internal void LinuxAdviseFileRange(platform_mapped_file *File, u32 Offset, u32 SizeBytes, platform_file_advice Advice)
+{
+  umm PageSize = sysconf(_SC_PAGESIZE);
+  umm Start = Offset;
+  umm End = Min((umm)Offset + SizeBytes, (umm)File->SizeBytes);
+
+  // NOTE: Read in every page the range touches, but only drop the pages that
+  // lie entirely within it.
+  int MAdvice = MADV_WILLNEED;
+  if (Advice == PLATFORM_FILE_ADVICE_will_need) {
+    Start = Start & ~(PageSize - 1);
+  } else {
+    MAdvice = MADV_DONTNEED;
+    Start = (Start + PageSize - 1) & ~(PageSize - 1);
+    End = End & ~(PageSize - 1);
+  }
+
+  if (Start < End) {
+    madvise(File->Data + Start, End - Start, MAdvice);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// reserved memory
+
+// NOTE: Set to 1 to have transient storage, which is touched every frame, use
+// transparent huge pages. Cuts down on TLB misses, but memory is then
+// committed 2MB at a time.
+#ifndef LINUX_TRANSIENT_HUGE_PAGES
+#define LINUX_TRANSIENT_HUGE_PAGES 0
+#endif
+
+#define LINUX_HUGE_PAGE_SIZE Megabytes(2)
+
+// The one reservation backed by huge pages, if any
+global u8  *GlobalHugePageBase = NULL;
+global umm GlobalHugePageSize = 0;
+
+// LinuxReserveMemory reserves address space without committing any memory to
+// it. Pages must be committed with LinuxCommitMemory before they are touched,
+// and read as zero when first touched.
+internal u8* LinuxReserveMemory(umm SizeBytes, b32 HugePages)
+{
+  u8 *Result = NULL;
+
+  // NOTE: Huge pages can only back 2MB aligned ranges, so reserve enough to
+  // line the start up and give the slack back.
+  umm ReserveSize = HugePages ? SizeBytes + LINUX_HUGE_PAGE_SIZE : SizeBytes;
+  void *Memory = mmap(NULL, ReserveSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (Memory == MAP_FAILED)
+  {
+    fprintf(stderr, "Memory: Failed to reserve %lu bytes: %s\n", SizeBytes, strerror(errno));
+  }
+  else if (HugePages)
+  {
+    u8 *Start = (u8*)Memory;
+    u8 *Aligned = (u8*)(((umm)Start + LINUX_HUGE_PAGE_SIZE - 1) & ~(umm)(LINUX_HUGE_PAGE_SIZE - 1));
+    if (Aligned > Start)
+    {
+      munmap(Start, Aligned - Start);
+    }
+    munmap(Aligned + SizeBytes, (Start + ReserveSize) - (Aligned + SizeBytes));
+
+    if (madvise(Aligned, SizeBytes, MADV_HUGEPAGE) == 0)
+    {
+      GlobalHugePageBase = Aligned;
+      GlobalHugePageSize = SizeBytes;
+    }
+    else
+    {
+      fprintf(stderr, "Memory: Transparent huge pages unavailable: %s\n", strerror(errno));
+    }
+    Result = Aligned;
+  }
+  else
+  {
+    Result = (u8*)Memory;
+  }
+
+  return(Result);
+}
+
+// LinuxCommitMemory commits every page the given range touches.
+internal b32 LinuxCommitMemory(void *Memory, umm SizeBytes)
+{
+  umm Granularity = sysconf(_SC_PAGESIZE);
+  if ((u8*)Memory >= GlobalHugePageBase && (u8*)Memory < GlobalHugePageBase + GlobalHugePageSize)
+  {
+    // NOTE: A huge page is only used if its whole 2MB is committed when it's
+    // first touched.
+    Granularity = LINUX_HUGE_PAGE_SIZE;
+  }
+
+  umm Start = (umm)Memory & ~(Granularity - 1);
+  umm End = ((umm)Memory + SizeBytes + Granularity - 1) & ~(Granularity - 1);
+
+  b32 Result = (mprotect((void*)Start, End - Start, PROT_READ | PROT_WRITE) == 0);
+  if (!Result)
+  {
+    fprintf(stderr, "Memory: Failed to commit %lu bytes: %s\n", End - Start, strerror(errno));
+  }
+
+  return(Result);
+}
+
+internal void LinuxReleaseMemory(u8 *Memory, umm SizeBytes)
+{
+  if (Memory)
+  {
+    munmap(Memory, SizeBytes);
+  }
+  if (Memory == GlobalHugePageBase)
+  {
+    GlobalHugePageBase = NULL;
+    GlobalHugePageSize = 0;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 internal void LinuxLog(const char *Format, ...)
 {
   va_list Args;
@@ -888,96 +1080,15 @@ internal char* LinuxGetClipboardText(scoped_arena* ScopedArena)
 
 ///////////////////////////////////////////////////////////////////////////////
 
-#define WORKER_THREAD_COUNT 1
-
-typedef struct work_queue_entry {
-  work_queue_callback_fn *Callback;
-  void *UserData;
-} work_queue_entry;
-
-typedef struct work_queue {
-  sem_t *Semaphore;
-  
-  u32 volatile CompletionGoal;
-  u32 volatile CompletionCount;
-  u32 volatile NextEntryToWrite;
-  u32 volatile NextEntryToRead;
-  
-  work_queue_entry Entries[256];
-} work_queue;
+#include "linux_work_queue.cc"
+#include "linux_frame_pacer.cc"
 
 typedef struct worker_thread_info {
-  i32 ThreadIndex;
+  u32 ThreadIndex;
   work_queue *Queue;
   GLXContext OpenGLContext;
-  thread_atomic_int_t *ExitFlag;
 } worked_thread_info;
 
-internal void LinuxWorkQueueAddEntry(work_queue *Queue, work_queue_callback_fn *Callback, void *UserData)
-{
-  // Assert that we aren't about to overwrite an existing entry. We should fail
-  // and triage if this happens.
-  u32 NewNextEntryToWrite = (Queue->NextEntryToWrite + 1) % ArrayCount(Queue->Entries);
-  Assert(NewNextEntryToWrite != Queue->NextEntryToRead);
-  work_queue_entry *Entry = Queue->Entries + Queue->NextEntryToWrite;
-  Entry->Callback = Callback;
-  Entry->UserData = UserData;
-  ++Queue->CompletionGoal;
-  
-  // Write barrier
-  asm volatile("" ::: "memory");
-  
-  Queue->NextEntryToWrite = NewNextEntryToWrite;
-  sem_post(Queue->Semaphore);
-}
-
-internal b32 DoNextWorkQueueEntry(work_queue *Queue)
-{
-  b32 ShouldWaitForWork = false;
-  
-  u32 OriginalNextEntryToRead = Queue->NextEntryToRead;
-  u32 NewNextEntryToRead = (OriginalNextEntryToRead + 1) % ArrayCount(Queue->Entries);
-  if (OriginalNextEntryToRead != Queue->NextEntryToWrite)
-  {
-    // NOTE: Verify that we are getting the entry index we expect, if so then
-    // increment the next entry index. This prevents two consumers from a race
-    // condition where one can go off the end of the entries. This is due to
-    // our single-producer, multiple-consumer threading setup.
-    u32 Index = AtomicCompareAndExchangeU32(&Queue->NextEntryToRead,
-                                            NewNextEntryToRead,
-                                            OriginalNextEntryToRead);
-    if (Index == OriginalNextEntryToRead)
-    {
-      work_queue_entry Entry = Queue->Entries[Index];
-      // TODO: Add thread-specific struct that contains scratch arena for the
-      // thread that it can use for all its temporary work.
-      Entry.Callback(Queue, Entry.UserData);
-      AtomicAddU32(&Queue->CompletionCount, 1);
-    }
-  }
-  else
-  {
-    // NOTE: Only wait for work here as otherwise we either:
-    //   1. Did some work
-    //   2. Tried to do some work, but got beaten to it. So we should try again 
-    //      since we don't know the state of the queue.
-    ShouldWaitForWork = true;
-  }
-  
-  return(ShouldWaitForWork);
-}
-
-internal void LinuxWorkQueueCompleteAllWork(work_queue *Queue)
-{
-  while (Queue->CompletionGoal != Queue->CompletionCount)
-  {
-    DoNextWorkQueueEntry(Queue);
-  }
-  
-  Queue->CompletionGoal = 0;
-  Queue->CompletionCount = 0;
-}
-
 i32 WorkerThreadLoop(void *UserData)
 {
   i32 Result = 0;
@@ -991,13 +1102,7 @@ i32 WorkerThreadLoop(void *UserData)
     fprintf(stderr, "Thread: glXMakeContextCurrent failed.\n");
   }
   
-  while (thread_atomic_int_load(ThreadInfo->ExitFlag) == 0)
-  {
-    if (DoNextWorkQueueEntry(ThreadInfo->Queue))
-    {
-      sem_trywait(ThreadInfo->Queue->Semaphore);
-    }
-  }
+  LinuxWorkQueueRunWorker(ThreadInfo->Queue, ThreadInfo->ThreadIndex);
   
   return(Result);
 }
@@ -1032,10 +1137,17 @@ internal void PlatformInit(platform_state* Platform)
 {
   // Input state to game
   {
+    // NOTE: Storage is only reserved here. The game's arenas commit it as
+    // they grow, so resident memory follows what is actually used.
     Platform->Input.PermanentStorageSize = PERMANENT_STORAGE_SIZE;
-    Platform->Input.PermanentStorage = (u8*)calloc(1, Platform->Input.PermanentStorageSize);
+    Platform->Input.PermanentStorage = LinuxReserveMemory(Platform->Input.PermanentStorageSize, false);
     Platform->Input.TransientStorageSize = TRANSIENT_STORAGE_SIZE;
-    Platform->Input.TransientStorage = (u8*)calloc(1, Platform->Input.TransientStorageSize);
+    Platform->Input.TransientStorage = LinuxReserveMemory(Platform->Input.TransientStorageSize, LINUX_TRANSIENT_HUGE_PAGES);
+    Assert(Platform->Input.PermanentStorage && Platform->Input.TransientStorage);
+
+    // NOTE: The game state sits at the start of permanent storage and is
+    // read before the game has set up its arenas.
+    LinuxCommitMemory(Platform->Input.PermanentStorage, sizeof(game_state));
     
     Platform->Input.Text[0] = '\0';
     GlobalTextPos = 0;
@@ -1047,6 +1159,7 @@ internal void PlatformInit(platform_state* Platform)
     Platform->Shared.TargetFPS = 60.0f;
     Platform->Shared.VSync = true;
     Platform->Shared.FullScreen = false;
+    Platform->Shared.LowLatency = false;
   }
   
   // Interfaces
@@ -1055,18 +1168,27 @@ internal void PlatformInit(platform_state* Platform)
     Platform->Interface.GetOpenGLProcAddress = LinuxGetOpenGLProcAddress;
     Platform->Interface.LoadEntireFile = LinuxLoadEntireFile;
     Platform->Interface.FreeEntireFile = LinuxFreeEntireFile;
+    Platform->Interface.MapFile = LinuxMapFile;
+    Platform->Interface.UnmapFile = LinuxUnmapFile;
+    Platform->Interface.AdviseFileRange = LinuxAdviseFileRange;
+    Platform->Interface.CommitMemory = LinuxCommitMemory;
     Platform->Interface.Log = LinuxLog;
     Platform->Interface.SetClipboardText = LinuxSetClipboardText;
     Platform->Interface.GetClipboardText = LinuxGetClipboardText;
     Platform->Interface.WorkQueueAddEntry = LinuxWorkQueueAddEntry;
+    Platform->Interface.WorkQueueAddEntries = LinuxWorkQueueAddEntries;
+    Platform->Interface.WorkQueueAddContinuation = LinuxWorkQueueAddContinuation;
+    Platform->Interface.WorkQueueWaitForCounter = LinuxWorkQueueWaitForCounter;
+    Platform->Interface.WorkQueueGetScratchArena = LinuxWorkQueueGetScratchArena;
+    Platform->Interface.WorkQueueGetStats = LinuxWorkQueueGetStats;
     Platform->Interface.WorkQueueCompleteAllWork = LinuxWorkQueueCompleteAllWork;
   }
 }
 
 internal void PlatformDestroy(platform_state* Platform)
 {
-  free(Platform->Input.PermanentStorage);
-  free(Platform->Input.TransientStorage);
+  LinuxReleaseMemory(Platform->Input.PermanentStorage, PERMANENT_STORAGE_SIZE);
+  LinuxReleaseMemory(Platform->Input.TransientStorage, TRANSIENT_STORAGE_SIZE);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1308,41 +1430,33 @@ int main(int argc, char* argv[]) {
         
         // Audio initialization
         linux_audio Audio = {};
-        b32 Result = LinuxAudioCreate(&Audio, 2 /* ms latency */, 48000 /* samples / sec */);
+        b32 Result = LinuxAudioCreate(&Audio, LinuxAudioChooseLatency(), 48000 /* samples / sec */);
         if (Result)
         {
           ///////////////////////////////////////////////////////////////////////////////
           // Audio system initialization
 
-          // NOTE: We want to be able to write up to the entire circular audio
-          // buffer in size each frame, so allocate our game output sample
-          // buffer to be equal in size to the circular buffer.
-          LinuxAudioStart(&Audio);
-          GlobalPlatform.Shared.AudioBuffer.Samples = (i16 *)calloc(1, sizeof(i16) * Audio.CircularBuffer.SampleCount);
-          GlobalPlatform.Shared.AudioBuffer.SamplesPerSecond = Audio.SamplesPerSecond;
-          GlobalPlatform.Shared.AudioBuffer.FrameCount = 0;
+          // NOTE: From here on the audio thread pulls game audio itself by
+          // calling into the game library once per period.
+          LinuxAudioStart(&Audio, &GameLibrary, &GlobalPlatform);
           
           ////////////////////////////////////////////////////////////////////////////
           // Spawn worker threads
           
-          // Create a sempahore (passing 0 for the second argument means it cannot be
-          // shared between processes).
-          sem_t WorkerSemaphore;
-          sem_init(&WorkerSemaphore, 0, WORKER_THREAD_COUNT);
-          
-          // Spawn worker threads
-          thread_atomic_int_t WorkerThreadExitFlag;
-          thread_atomic_int_store(&WorkerThreadExitFlag, 0);
-
+          // NOTE: Worker scratch memory comes off the top of transient
+          // storage, before the game first sees it.
+          u32 WorkerCount = LinuxWorkQueueDefaultWorkerCount();
+          umm ScratchSize = LinuxWorkQueueScratchSize(WorkerCount);
+          Assert(ScratchSize < GlobalPlatform.Input.TransientStorageSize / 2);
+          GlobalPlatform.Input.TransientStorageSize -= ScratchSize;
           work_queue Queue = {};
-          Queue.Semaphore = &WorkerSemaphore;
+          LinuxWorkQueueInit(&Queue, WorkerCount, GlobalPlatform.Input.TransientStorage + GlobalPlatform.Input.TransientStorageSize);
 
-          thread_ptr_t WorkerThread[WORKER_THREAD_COUNT];
-          worker_thread_info WorkerThreadInfo[WORKER_THREAD_COUNT];
-          foreach(I, WORKER_THREAD_COUNT) {
+          thread_ptr_t WorkerThread[WORK_QUEUE_MAX_WORKERS];
+          worker_thread_info WorkerThreadInfo[WORK_QUEUE_MAX_WORKERS];
+          foreach(I, WorkerCount) {
             worker_thread_info *Info = WorkerThreadInfo + I;
             Info->ThreadIndex = I;
-            Info->ExitFlag = &WorkerThreadExitFlag;
             Info->Queue = &Queue;
             Info->OpenGLContext = glXCreateContextAttribsARB(GlobalDisplay, BestFBC, GLCtx, True, NULL /*ContextAttribs*/);
             printf("Worker: Thread %d: Starting\n", I);
@@ -1351,9 +1465,16 @@ int main(int argc, char* argv[]) {
 
           // Set platform work queue
           GlobalPlatform.Input.WorkQueue = &Queue;
+          GlobalPlatform.Input.WorkerCount = WorkerCount;
           
+          linux_frame_pacer FramePacer = {};
+          LinuxFramePacerInit(&FramePacer, GlobalPlatform.Shared.TargetFPS);
+
           u64 DeltaTimeStart = LinuxGetTimeMicros();
           while (GlobalPlatform.Shared.IsRunning) {
+            // NOTE: Wait out the frame before sampling input so that the
+            // input is as fresh as possible when the frame is presented.
+            LinuxFramePacerBeginFrame(&FramePacer, &GlobalPlatform);
             GameLibrary.OnFrameStart(&GlobalPlatform);
             
             // Process input
@@ -1363,9 +1484,6 @@ int main(int argc, char* argv[]) {
             b32 OldVSync = GlobalPlatform.Shared.VSync;
             b32 OldFullScreen = GlobalPlatform.Shared.FullScreen;
 
-            // Get number of audio frames to write this video frame
-            GlobalPlatform.Shared.AudioBuffer.FrameCount = LinuxAudioFramesToWrite(&Audio);
-
             {
               Window Root, Child;
               i32 RootX, RootY, XPos, YPos;
@@ -1379,17 +1497,18 @@ int main(int argc, char* argv[]) {
               GlobalPlatform.Input.Mouse.Pos = V2I(XPos, GlobalPlatform.Input.RenderDim.Height - YPos);
             }
             
+            LinuxAudioGetStats(&Audio, &GlobalPlatform.Input.Audio);
+            LinuxFramePacerGetStats(&FramePacer, &GlobalPlatform.Input.Frame);
+
             GameLibraryOpen(&GameLibrary);
             u64 EndTime = LinuxGetTimeMicros();
             u64 DeltaTimeMicros = EndTime - DeltaTimeStart;
             GameLibrary.Update(&GlobalPlatform, DeltaTimeMicros);
             DeltaTimeStart = EndTime;
 
-            // Queue up game audio for audio thread
-            LinuxAudioFill(&Audio, GlobalPlatform.Shared.AudioBuffer.Samples, GlobalPlatform.Shared.AudioBuffer.FrameCount);
-
             // Render
             glXSwapBuffers(GlobalDisplay, GlobalWindow);
+            LinuxFramePacerEndFrame(&FramePacer, &GlobalPlatform);
 
             // Reset single-frame platform state
             PlatformEndFrameReset(&GlobalPlatform);
@@ -1436,22 +1555,25 @@ int main(int argc, char* argv[]) {
           }
           
           // Destroy worker threads
-          thread_atomic_int_store(&WorkerThreadExitFlag, 1);
-          foreach(I, WORKER_THREAD_COUNT) {
+          //
+          // NOTE: The queue itself lives on until the game has shut down, any
+          // work it adds from here on is run on the main thread.
+          LinuxWorkQueueShutdown(&Queue);
+          foreach(I, WorkerCount) {
             int ReturnValue = thread_join(WorkerThread[I]);
             printf("Worker: Thread %d: Exit Code %d\n", I, ReturnValue);
             thread_destroy(WorkerThread[I]);
           }
-          
-          // Destroy our worker sempahore
-          sem_destroy(&WorkerSemaphore);
-
-          // Shutdown game
-          GameLibrary.Shutdown(&GlobalPlatform);
 
           // Destroy audio
+          //
+          // NOTE: This must happen before the game shuts down so the audio
+          // thread stops calling into the game.
           LinuxAudioDestroy(&Audio);
-          free(GlobalPlatform.Shared.AudioBuffer.Samples);
+
+          // Shutdown game
+          GameLibrary.Shutdown(&GlobalPlatform);
+          LinuxWorkQueueDestroy(&Queue);
         }
         else
         {
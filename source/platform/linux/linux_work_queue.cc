@@ -0,0 +1,755 @@
+// NOTE: A work-stealing job system. Every thread that adds work owns a
+// Chase-Lev deque: it pushes and pops work at the bottom of its own deque,
+// and threads that run out of work steal from the top of everyone else's.
+// Deque 0 belongs to the main thread and the rest to the workers. Threads
+// without a deque (the audio thread, say) add work to a shared overflow queue
+// behind a lock instead.
+//
+// Work goes into one of several priority lanes, each with its own set of
+// deques. Threads looking for work drain the lanes in priority order, so work
+// the frame needs runs ahead of any asset loads already waiting.
+//
+// Work can be added against a work_counter, which is decremented as each
+// entry finishes. Waiting on a counter runs other work until it reaches zero,
+// and continuations chained onto a counter are added to the queue once it
+// does, so a frame's work can be laid out as a graph of dependent batches.
+//
+// References:
+// "Dynamic Circular Work-Stealing Deque", Chase and Lev, SPAA 2005
+// "Correct and Efficient Work-Stealing for Weak Memory Models", Le et al., PPoPP 2013
+
+// Upper bound on worker threads. Each worker gets its own OpenGL context.
+#define WORK_QUEUE_MAX_WORKERS 16
+#define WORK_QUEUE_MAX_DEQUES (WORK_QUEUE_MAX_WORKERS + 1)
+
+// Entries each deque starts out with room for. Deques double in size when
+// they fill up, so adding work never fails.
+//
+// NOTE: Must be a power of 2.
+#define WORK_DEQUE_INITIAL_SIZE 256
+
+// Times an idle worker looks for work before it goes to sleep
+#define WORK_QUEUE_IDLE_SPINS 64
+
+// Scratch memory each thread with a deque gets for the work it runs. It is
+// carved from the top of the game's transient storage.
+#define WORK_QUEUE_SCRATCH_SIZE Megabytes(8)
+
+// Set in a counter's value while its continuations are being changed
+#define WORK_COUNTER_LOCK 0x80000000
+
+typedef struct work_queue_entry {
+  work_queue_callback_fn *Callback;
+  void *UserData;
+  work_counter *Counter;
+  work_queue_priority Priority;
+  // When the entry went into its lane, for the wait time stats
+  u64 AddedMicros;
+} work_queue_entry;
+
+// Work waiting on a counter to reach zero
+typedef struct work_continuation {
+  work_queue_entry Entry;
+  struct work_continuation *Next;
+} work_continuation;
+
+// NOTE: Thieves may still be reading from an array after the owner has grown
+// its deque into a new one, so replaced arrays are kept until the queue is
+// destroyed.
+typedef struct work_deque_array {
+  u32 Size;
+  struct work_deque_array *Retired;
+  work_queue_entry Entries[1];
+} work_deque_array;
+
+// Indices run freely and are masked on access. Entries in [Top, Bottom) are
+// waiting to be run.
+typedef struct work_deque {
+  // NOTE: Advanced by thieves, and by the owner when it takes the last entry
+  u32 volatile Top;
+  u8 TopPad[CACHE_LINE_SIZE - sizeof(u32)];
+
+  // NOTE: Written only by the owner
+  work_deque_array * volatile Array;
+  u32 volatile Bottom;
+  u8 BottomPad[CACHE_LINE_SIZE - sizeof(void*) - sizeof(u32)];
+} work_deque;
+
+// Work added by threads without a deque, in order
+typedef struct work_overflow {
+  thread_mutex_t Lock;
+  u32 volatile Count;
+  u32 Head;
+  u32 Size;
+  work_queue_entry *Entries;
+} work_overflow;
+
+typedef struct work_lane {
+  work_deque Deques[WORK_QUEUE_MAX_DEQUES];
+  work_overflow Overflow;
+
+  // Entries waiting to be taken
+  u32 volatile Depth;
+  // Entries taken so far, and the time they spent waiting in the lane
+  u32 volatile Taken;
+  u64 volatile WaitMicrosTotal;
+  u32 volatile WaitMicrosMax;
+  u8 StatsPad[CACHE_LINE_SIZE];
+} work_lane;
+
+// NOTE: Only ever touched by the thread that owns the matching deques. Each
+// entry it runs gets a temporary arena on top of its scratch, released when
+// the entry returns, so entries that wait on other work nest properly.
+typedef struct work_thread {
+  memory_arena Scratch;
+  u8 ScratchPad[CACHE_LINE_SIZE - sizeof(memory_arena) % CACHE_LINE_SIZE];
+} work_thread;
+
+typedef struct work_queue {
+  u32 WorkerCount;
+  work_lane Lanes[WORK_QUEUE_PRIORITY_COUNT];
+  work_thread Threads[WORK_QUEUE_MAX_DEQUES];
+
+  // NOTE: Idle workers sleep on the semaphore, which is only posted when
+  // someone is asleep.
+  sem_t Wakeup;
+  u32 volatile SleepingWorkers;
+  u32 volatile ExitFlag;
+
+  // NOTE: Both only ever go up, so anyone can wait on a snapshot of the goal
+  // while more work is being added.
+  u32 volatile CompletionGoal;
+  u32 volatile CompletionCount;
+} work_queue;
+
+// Index of the calling thread's deque, or -1 if it doesn't have one
+global __thread i32 GlobalWorkDeque = -1;
+
+internal u32  LinuxWorkQueueDefaultWorkerCount(void);
+internal umm  LinuxWorkQueueScratchSize(u32 WorkerCount);
+internal void LinuxWorkQueueInit(work_queue *Queue, u32 WorkerCount, u8 *ScratchMemory);
+internal void LinuxWorkQueueDestroy(work_queue *Queue);
+internal void LinuxWorkQueueShutdown(work_queue *Queue);
+internal void LinuxWorkQueueAddEntries(work_queue *Queue, work_queue_priority Priority, work_queue_callback_fn *Callback, void **UserData, u32 Count, work_counter *Counter);
+internal void LinuxWorkQueueAddContinuation(work_queue *Queue, work_counter *Dependency, work_queue_priority Priority, work_queue_callback_fn *Callback, void *UserData, work_counter *Counter);
+internal void LinuxWorkQueueGetStats(work_queue *Queue, platform_work_queue_stats *Stats);
+internal void LinuxWorkQueueWaitForCounter(work_queue *Queue, work_counter *Counter);
+internal memory_arena* LinuxWorkQueueGetScratchArena(work_queue *Queue);
+internal b32  LinuxWorkQueueDoNextEntry(work_queue *Queue);
+internal void LinuxWorkQueueRunWorker(work_queue *Queue, u32 WorkerIndex);
+
+///////////////////////////////////////////////////////////////////////////////
+// work_deque
+
+internal work_deque_array* LinuxWorkDequeArrayCreate(u32 Size)
+{
+  work_deque_array *Result = (work_deque_array*)calloc(1, sizeof(work_deque_array) + (Size - 1) * sizeof(work_queue_entry));
+  Result->Size = Size;
+  return(Result);
+}
+
+// Owner only. Copies the waiting entries into an array twice the size.
+internal work_deque_array* LinuxWorkDequeGrow(work_deque *Deque, work_deque_array *Array, u32 Top, u32 Bottom)
+{
+  work_deque_array *Result = LinuxWorkDequeArrayCreate(2 * Array->Size);
+  for (u32 Index = Top; Index != Bottom; ++Index)
+  {
+    Result->Entries[Index & (Result->Size - 1)] = Array->Entries[Index & (Array->Size - 1)];
+  }
+  Result->Retired = Array;
+
+  CompletePreviousWritesBeforeFutureWrites;
+  Deque->Array = Result;
+  return(Result);
+}
+
+// Owner only
+internal void LinuxWorkDequePush(work_deque *Deque, work_queue_entry Entry)
+{
+  u32 Bottom = Deque->Bottom;
+  u32 Top = AtomicLoadAcquireU32(&Deque->Top);
+  work_deque_array *Array = Deque->Array;
+  if (Bottom - Top >= Array->Size)
+  {
+    Array = LinuxWorkDequeGrow(Deque, Array, Top, Bottom);
+  }
+
+  Array->Entries[Bottom & (Array->Size - 1)] = Entry;
+  AtomicStoreReleaseU32(&Deque->Bottom, Bottom + 1);
+}
+
+// Owner only. Takes the most recently pushed entry, racing thieves for it if
+// it is the last one.
+internal b32 LinuxWorkDequePop(work_deque *Deque, work_queue_entry *Entry)
+{
+  b32 Result = false;
+  u32 Bottom = Deque->Bottom - 1;
+  work_deque_array *Array = Deque->Array;
+
+  // NOTE: Thieves must see Bottom move before Top is read, so this needs the
+  // full barrier of an exchange rather than a release store.
+  AtomicExchangeU32(&Deque->Bottom, Bottom);
+  u32 Top = Deque->Top;
+
+  i32 Count = (i32)(Bottom - Top);
+  if (Count >= 0)
+  {
+    *Entry = Array->Entries[Bottom & (Array->Size - 1)];
+    Result = true;
+    if (Count == 0)
+    {
+      Result = (AtomicCompareAndExchangeU32(&Deque->Top, Top + 1, Top) == Top);
+      AtomicStoreReleaseU32(&Deque->Bottom, Top + 1);
+    }
+  }
+  else
+  {
+    // Empty, put Bottom back
+    AtomicStoreReleaseU32(&Deque->Bottom, Top);
+  }
+
+  return(Result);
+}
+
+// Any thread. Takes the oldest entry.
+internal b32 LinuxWorkDequeSteal(work_deque *Deque, work_queue_entry *Entry)
+{
+  b32 Result = false;
+  u32 Top = AtomicLoadAcquireU32(&Deque->Top);
+  u32 Bottom = AtomicLoadAcquireU32(&Deque->Bottom);
+
+  if ((i32)(Bottom - Top) > 0)
+  {
+    work_deque_array *Array = Deque->Array;
+    CompletePreviousReadsBeforeFutureReads;
+    work_queue_entry Stolen = Array->Entries[Top & (Array->Size - 1)];
+
+    // NOTE: If the owner or another thief got here first the entry read above
+    // may be stale, but then the exchange fails and it is thrown away.
+    if (AtomicCompareAndExchangeU32(&Deque->Top, Top + 1, Top) == Top)
+    {
+      *Entry = Stolen;
+      Result = true;
+    }
+  }
+
+  return(Result);
+}
+
+internal b32 LinuxWorkDequeHasWork(work_deque *Deque)
+{
+  u32 Top = AtomicLoadAcquireU32(&Deque->Top);
+  u32 Bottom = AtomicLoadAcquireU32(&Deque->Bottom);
+  return((i32)(Bottom - Top) > 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// work_queue
+
+// One worker per core, less one for the main thread
+internal u32 LinuxWorkQueueDefaultWorkerCount(void)
+{
+  i64 Cores = sysconf(_SC_NPROCESSORS_ONLN);
+  u32 Result = (Cores > 1) ? (u32)(Cores - 1) : 1;
+  Result = Min(Result, WORK_QUEUE_MAX_WORKERS);
+  return(Result);
+}
+
+// Bytes of scratch memory needed for the main thread and WorkerCount workers
+internal umm LinuxWorkQueueScratchSize(u32 WorkerCount)
+{
+  return((WorkerCount + 1) * WORK_QUEUE_SCRATCH_SIZE);
+}
+
+// NOTE: Must be called from the main thread, which is given deque 0.
+// ScratchMemory must hold LinuxWorkQueueScratchSize(WorkerCount) bytes of
+// reserved memory, which each thread commits as its scratch arena grows.
+internal void LinuxWorkQueueInit(work_queue *Queue, u32 WorkerCount, u8 *ScratchMemory)
+{
+  Assert(WorkerCount > 0 && WorkerCount <= WORK_QUEUE_MAX_WORKERS);
+  Queue->WorkerCount = WorkerCount;
+
+  foreach(LaneIndex, WORK_QUEUE_PRIORITY_COUNT)
+  {
+    work_lane *Lane = Queue->Lanes + LaneIndex;
+    foreach(I, WorkerCount + 1)
+    {
+      work_deque *Deque = Lane->Deques + I;
+      Deque->Top = 0;
+      Deque->Bottom = 0;
+      Deque->Array = LinuxWorkDequeArrayCreate(WORK_DEQUE_INITIAL_SIZE);
+    }
+
+    work_overflow *Overflow = &Lane->Overflow;
+    thread_mutex_init(&Overflow->Lock);
+    Overflow->Count = 0;
+    Overflow->Head = 0;
+    Overflow->Size = 0;
+    Overflow->Entries = NULL;
+
+    Lane->Depth = 0;
+    Lane->Taken = 0;
+    Lane->WaitMicrosTotal = 0;
+    Lane->WaitMicrosMax = 0;
+  }
+
+  foreach(I, WorkerCount + 1)
+  {
+    Queue->Threads[I].Scratch = ArenaInitReserved(ScratchMemory + I * WORK_QUEUE_SCRATCH_SIZE, WORK_QUEUE_SCRATCH_SIZE, LinuxCommitMemory);
+    Queue->Threads[I].Scratch.ZeroPolicy = TRANSIENT_ZERO_POLICY;
+  }
+
+  sem_init(&Queue->Wakeup, 0, 0);
+  Queue->SleepingWorkers = 0;
+  Queue->ExitFlag = 0;
+  Queue->CompletionGoal = 0;
+  Queue->CompletionCount = 0;
+
+  GlobalWorkDeque = 0;
+}
+
+// NOTE: The workers must have exited before this is called.
+internal void LinuxWorkQueueDestroy(work_queue *Queue)
+{
+  foreach(LaneIndex, WORK_QUEUE_PRIORITY_COUNT)
+  {
+    work_lane *Lane = Queue->Lanes + LaneIndex;
+    foreach(I, Queue->WorkerCount + 1)
+    {
+      work_deque_array *Array = Lane->Deques[I].Array;
+      while (Array)
+      {
+        work_deque_array *Retired = Array->Retired;
+        free(Array);
+        Array = Retired;
+      }
+    }
+
+    free(Lane->Overflow.Entries);
+    thread_mutex_term(&Lane->Overflow.Lock);
+  }
+
+  sem_destroy(&Queue->Wakeup);
+}
+
+// Tells the workers to exit once they finish what they are running
+internal void LinuxWorkQueueShutdown(work_queue *Queue)
+{
+  AtomicStoreReleaseU32(&Queue->ExitFlag, 1);
+  foreach(I, Queue->WorkerCount)
+  {
+    sem_post(&Queue->Wakeup);
+  }
+}
+
+internal void LinuxWorkOverflowPush(work_overflow *Overflow, work_queue_entry Entry)
+{
+  thread_mutex_lock(&Overflow->Lock);
+  if (Overflow->Count == Overflow->Size)
+  {
+    u32 NewSize = Max(2 * Overflow->Size, (u32)WORK_DEQUE_INITIAL_SIZE);
+    work_queue_entry *NewEntries = (work_queue_entry*)malloc(NewSize * sizeof(work_queue_entry));
+    foreach(I, Overflow->Count)
+    {
+      NewEntries[I] = Overflow->Entries[(Overflow->Head + I) & (Overflow->Size - 1)];
+    }
+    free(Overflow->Entries);
+    Overflow->Entries = NewEntries;
+    Overflow->Size = NewSize;
+    Overflow->Head = 0;
+  }
+
+  Overflow->Entries[(Overflow->Head + Overflow->Count) & (Overflow->Size - 1)] = Entry;
+  AtomicStoreReleaseU32(&Overflow->Count, Overflow->Count + 1);
+  thread_mutex_unlock(&Overflow->Lock);
+}
+
+internal b32 LinuxWorkOverflowTake(work_overflow *Overflow, work_queue_entry *Entry)
+{
+  b32 Result = false;
+
+  // NOTE: Don't touch the lock unless there is something to take
+  if (AtomicLoadAcquireU32(&Overflow->Count) > 0)
+  {
+    thread_mutex_lock(&Overflow->Lock);
+    if (Overflow->Count > 0)
+    {
+      *Entry = Overflow->Entries[Overflow->Head];
+      Overflow->Head = (Overflow->Head + 1) & (Overflow->Size - 1);
+      AtomicStoreReleaseU32(&Overflow->Count, Overflow->Count - 1);
+      Result = true;
+    }
+    thread_mutex_unlock(&Overflow->Lock);
+  }
+
+  return(Result);
+}
+
+// Wakes up to Count sleeping workers after work has been added
+internal void LinuxWorkQueueWake(work_queue *Queue, u32 Count)
+{
+  // NOTE: Pairs with the sleeping count being bumped before a worker's last
+  // look for work. Either it sees the new work or we see it sleeping.
+  CompletePreviousWritesBeforeFutureReads;
+  u32 Sleeping = AtomicLoadAcquireU32(&Queue->SleepingWorkers);
+  foreach(I, Min(Count, Sleeping))
+  {
+    sem_post(&Queue->Wakeup);
+  }
+}
+
+// NOTE: The entry must already be counted in the completion goal
+internal void LinuxWorkQueuePush(work_queue *Queue, work_queue_entry Entry)
+{
+  Assert(Entry.Priority < WORK_QUEUE_PRIORITY_COUNT);
+  work_lane *Lane = Queue->Lanes + Entry.Priority;
+  Entry.AddedMicros = LinuxGetTimeMicros();
+  AtomicAddU32(&Lane->Depth, 1);
+
+  i32 DequeIndex = GlobalWorkDeque;
+  if (DequeIndex >= 0)
+  {
+    LinuxWorkDequePush(Lane->Deques + DequeIndex, Entry);
+  }
+  else
+  {
+    LinuxWorkOverflowPush(&Lane->Overflow, Entry);
+  }
+}
+
+// Counter may be NULL for fire-and-forget work
+internal void LinuxWorkQueueAddEntries(work_queue *Queue, work_queue_priority Priority, work_queue_callback_fn *Callback, void **UserData, u32 Count, work_counter *Counter)
+{
+  AtomicAddU32(&Queue->CompletionGoal, Count);
+  if (Counter)
+  {
+    AtomicAddU32(&Counter->Value, Count);
+  }
+
+  foreach(I, Count)
+  {
+    work_queue_entry Entry = { Callback, UserData[I], Counter, Priority };
+    LinuxWorkQueuePush(Queue, Entry);
+  }
+
+  LinuxWorkQueueWake(Queue, Count);
+}
+
+internal void LinuxWorkQueueAddEntry(work_queue *Queue, work_queue_callback_fn *Callback, void *UserData)
+{
+  LinuxWorkQueueAddEntries(Queue, WORK_QUEUE_PRIORITY_normal, Callback, &UserData, 1, NULL);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// work_counter
+
+// Spins until the calling thread holds the counter's lock bit
+internal void LinuxWorkCounterLock(work_counter *Counter)
+{
+  for (;;)
+  {
+    u32 Value = AtomicLoadAcquireU32(&Counter->Value);
+    if (!(Value & WORK_COUNTER_LOCK) &&
+        AtomicCompareAndExchangeU32(&Counter->Value, Value | WORK_COUNTER_LOCK, Value) == Value)
+    {
+      break;
+    }
+    _mm_pause();
+  }
+}
+
+internal void LinuxWorkCounterUnlock(work_counter *Counter)
+{
+  // NOTE: An add rather than a store, as entries may still be added against
+  // the counter while it is locked.
+  AtomicAddU32(&Counter->Value, (u32)-WORK_COUNTER_LOCK);
+}
+
+// Marks one entry added against the counter as done. If it was the last one,
+// the counter's continuations are added to the queue.
+internal void LinuxWorkCounterDecrement(work_queue *Queue, work_counter *Counter)
+{
+  work_continuation *Continuations = NULL;
+  for (;;)
+  {
+    u32 Value = AtomicLoadAcquireU32(&Counter->Value);
+    if ((Value & ~WORK_COUNTER_LOCK) > 1)
+    {
+      if (AtomicCompareAndExchangeU32(&Counter->Value, Value - 1, Value) == Value)
+      {
+        break;
+      }
+    }
+    else if (Value == 1)
+    {
+      // NOTE: Take the lock while still holding the counter above zero, and
+      // only let it reach zero as the very last touch. Waiters may return and
+      // release the counter the moment it does.
+      if (AtomicCompareAndExchangeU32(&Counter->Value, 1 | WORK_COUNTER_LOCK, Value) == Value)
+      {
+        Continuations = Counter->Continuations;
+        Counter->Continuations = NULL;
+        AtomicStoreReleaseU32(&Counter->Value, 0);
+        break;
+      }
+    }
+    else
+    {
+      Assert(Value != 0);
+      _mm_pause();
+    }
+  }
+
+  u32 Count = 0;
+  while (Continuations)
+  {
+    work_continuation *Next = Continuations->Next;
+    LinuxWorkQueuePush(Queue, Continuations->Entry);
+    free(Continuations);
+    Continuations = Next;
+    ++Count;
+  }
+
+  if (Count > 0)
+  {
+    LinuxWorkQueueWake(Queue, Count);
+  }
+}
+
+// Adds work to the queue once everything added against Dependency has
+// finished. The work itself counts against Counter straight away, so waiting
+// on Counter also waits on Dependency.
+internal void LinuxWorkQueueAddContinuation(work_queue *Queue, work_counter *Dependency, work_queue_priority Priority, work_queue_callback_fn *Callback, void *UserData, work_counter *Counter)
+{
+  AtomicAddU32(&Queue->CompletionGoal, 1);
+  if (Counter)
+  {
+    AtomicAddU32(&Counter->Value, 1);
+  }
+
+  work_queue_entry Entry = { Callback, UserData, Counter, Priority };
+
+  LinuxWorkCounterLock(Dependency);
+  b32 Ready = ((Dependency->Value & ~WORK_COUNTER_LOCK) == 0);
+  if (!Ready)
+  {
+    work_continuation *Continuation = (work_continuation*)malloc(sizeof(work_continuation));
+    Continuation->Entry = Entry;
+    Continuation->Next = Dependency->Continuations;
+    Dependency->Continuations = Continuation;
+  }
+  LinuxWorkCounterUnlock(Dependency);
+
+  if (Ready)
+  {
+    LinuxWorkQueuePush(Queue, Entry);
+    LinuxWorkQueueWake(Queue, 1);
+  }
+}
+
+// Takes work from the calling thread's own deque first, newest first, then
+// steals the oldest work from the other deques.
+internal b32 LinuxWorkLaneTakeEntry(work_lane *Lane, u32 DequeCount, work_queue_entry *Entry)
+{
+  i32 Self = GlobalWorkDeque;
+
+  if (Self >= 0 && LinuxWorkDequePop(Lane->Deques + Self, Entry))
+  {
+    return(true);
+  }
+
+  // NOTE: Start with the next deque along so thieves spread out
+  u32 Start = (Self >= 0) ? (u32)Self + 1 : 0;
+  foreach(I, DequeCount)
+  {
+    u32 Victim = (Start + I) % DequeCount;
+    if ((i32)Victim != Self && LinuxWorkDequeSteal(Lane->Deques + Victim, Entry))
+    {
+      return(true);
+    }
+  }
+
+  return(LinuxWorkOverflowTake(&Lane->Overflow, Entry));
+}
+
+// Notes how long an entry waited in its lane
+internal void LinuxWorkLaneRecordTake(work_lane *Lane, work_queue_entry *Entry)
+{
+  u64 WaitMicros = LinuxGetTimeMicros() - Entry->AddedMicros;
+  u32 Wait = (u32)Min(WaitMicros, (u64)0xFFFFFFFF);
+
+  AtomicAddU32(&Lane->Depth, (u32)-1);
+  AtomicAddU32(&Lane->Taken, 1);
+  AtomicAddU64(&Lane->WaitMicrosTotal, WaitMicros);
+
+  u32 Longest = Lane->WaitMicrosMax;
+  while (Wait > Longest)
+  {
+    u32 Previous = AtomicCompareAndExchangeU32(&Lane->WaitMicrosMax, Wait, Longest);
+    if (Previous == Longest)
+    {
+      break;
+    }
+    Longest = Previous;
+  }
+}
+
+// Takes the next entry from the highest priority lane that has one. Nothing
+// already running is interrupted, but a worker finishing a long asset load
+// picks up waiting frame work before the next load.
+internal b32 LinuxWorkQueueTakeEntry(work_queue *Queue, work_queue_entry *Entry)
+{
+  u32 DequeCount = Queue->WorkerCount + 1;
+  foreach(LaneIndex, WORK_QUEUE_PRIORITY_COUNT)
+  {
+    work_lane *Lane = Queue->Lanes + LaneIndex;
+    if (LinuxWorkLaneTakeEntry(Lane, DequeCount, Entry))
+    {
+      LinuxWorkLaneRecordTake(Lane, Entry);
+      return(true);
+    }
+  }
+  return(false);
+}
+
+internal b32 LinuxWorkQueueHasWork(work_queue *Queue)
+{
+  foreach(LaneIndex, WORK_QUEUE_PRIORITY_COUNT)
+  {
+    work_lane *Lane = Queue->Lanes + LaneIndex;
+    foreach(I, Queue->WorkerCount + 1)
+    {
+      if (LinuxWorkDequeHasWork(Lane->Deques + I))
+      {
+        return(true);
+      }
+    }
+
+    if (AtomicLoadAcquireU32(&Lane->Overflow.Count) > 0)
+    {
+      return(true);
+    }
+  }
+  return(false);
+}
+
+internal void LinuxWorkQueueGetStats(work_queue *Queue, platform_work_queue_stats *Stats)
+{
+  Stats->WorkerCount = Queue->WorkerCount;
+  foreach(LaneIndex, WORK_QUEUE_PRIORITY_COUNT)
+  {
+    work_lane *Lane = Queue->Lanes + LaneIndex;
+    platform_work_lane_stats *LaneStats = Stats->Lanes + LaneIndex;
+
+    // NOTE: Read without stopping anyone, so the counts can be off by the
+    // entries in flight.
+    LaneStats->Depth = AtomicLoadAcquireU32(&Lane->Depth);
+    LaneStats->Taken = AtomicLoadAcquireU32(&Lane->Taken);
+    u64 WaitMicrosTotal = Lane->WaitMicrosTotal;
+    LaneStats->WaitAverageMS = (LaneStats->Taken > 0) ? (f32)(WaitMicrosTotal / LaneStats->Taken) / 1000.0f : 0.0f;
+    LaneStats->WaitMaxMS = (f32)AtomicLoadAcquireU32(&Lane->WaitMicrosMax) / 1000.0f;
+  }
+}
+
+// Scratch memory for the entry the calling thread is running, released when
+// the entry returns. NULL for threads without a deque.
+internal memory_arena* LinuxWorkQueueGetScratchArena(work_queue *Queue)
+{
+  memory_arena *Result = NULL;
+  if (GlobalWorkDeque >= 0)
+  {
+    Result = &Queue->Threads[GlobalWorkDeque].Scratch;
+  }
+  return(Result);
+}
+
+// Runs one entry if there is any work to be had. Returns whether it did.
+internal b32 LinuxWorkQueueDoNextEntry(work_queue *Queue)
+{
+  work_queue_entry Entry;
+  b32 Result = LinuxWorkQueueTakeEntry(Queue, &Entry);
+  if (Result)
+  {
+    memory_arena *Scratch = LinuxWorkQueueGetScratchArena(Queue);
+    if (Scratch)
+    {
+      temporary_arena Temp = BeginTemporaryArena(Scratch);
+      Entry.Callback(Queue, Entry.UserData);
+      EndTemporaryArena(Temp);
+    }
+    else
+    {
+      Entry.Callback(Queue, Entry.UserData);
+    }
+
+    if (Entry.Counter)
+    {
+      LinuxWorkCounterDecrement(Queue, Entry.Counter);
+    }
+    AtomicAddU32(&Queue->CompletionCount, 1);
+  }
+  return(Result);
+}
+
+// Runs other work until everything added against the counter has finished.
+// Safe to call from inside a job.
+internal void LinuxWorkQueueWaitForCounter(work_queue *Queue, work_counter *Counter)
+{
+  while (AtomicLoadAcquireU32(&Counter->Value) != 0)
+  {
+    if (!LinuxWorkQueueDoNextEntry(Queue))
+    {
+      _mm_pause();
+    }
+  }
+}
+
+// Helps run work until everything added before the call has completed.
+//
+// NOTE: Work added by other threads while waiting is not waited on, and the
+// counts are never reset, so this is safe to call while others are adding
+// work or waiting themselves.
+internal void LinuxWorkQueueCompleteAllWork(work_queue *Queue)
+{
+  u32 Goal = AtomicLoadAcquireU32(&Queue->CompletionGoal);
+  while ((i32)(Goal - AtomicLoadAcquireU32(&Queue->CompletionCount)) > 0)
+  {
+    if (!LinuxWorkQueueDoNextEntry(Queue))
+    {
+      _mm_pause();
+    }
+  }
+}
+
+// Body of a worker thread. Workers spin briefly when they run out of work, as
+// more often turns up straight away, then sleep until work is added.
+internal void LinuxWorkQueueRunWorker(work_queue *Queue, u32 WorkerIndex)
+{
+  Assert(WorkerIndex < Queue->WorkerCount);
+  GlobalWorkDeque = WorkerIndex + 1;
+
+  u32 IdleSpins = 0;
+  while (!AtomicLoadAcquireU32(&Queue->ExitFlag))
+  {
+    if (LinuxWorkQueueDoNextEntry(Queue))
+    {
+      IdleSpins = 0;
+    }
+    else if (++IdleSpins < WORK_QUEUE_IDLE_SPINS)
+    {
+      _mm_pause();
+    }
+    else
+    {
+      // NOTE: Announce we are going to sleep before the last look for work,
+      // see LinuxWorkQueueWake.
+      AtomicAddU32(&Queue->SleepingWorkers, 1);
+      if (!LinuxWorkQueueHasWork(Queue) && !AtomicLoadAcquireU32(&Queue->ExitFlag))
+      {
+        sem_wait(&Queue->Wakeup);
+      }
+      AtomicAddU32(&Queue->SleepingWorkers, (u32)-1);
+      IdleSpins = 0;
+    }
+  }
+}
@@ -0,0 +1,363 @@
+// Offline benchmark for the audio mixer. Mixes increasing numbers of voices
+// into memory for a fixed number of device periods, reports the cost per
+// output frame per voice and checks the mixed output against known hashes.
+//
+// Needs no sound hardware, window or GL context, so it can run anywhere:
+//
+//   make bench/audio BUILD_CONFIG=release
+//   ./build/audio_bench [-p periods] [-s streamed.ogg]
+//
+// NOTE: Voices play synthesized sounds from the PCM cache. Passing an Ogg file
+// with -s has every fourth voice stream it instead, which changes the output,
+// so hashes are only checked without it. The known hashes are for SSE2 builds,
+// other instruction sets round differently.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define AUDIO_MAX_VOICES 512
+#define AUDIO_COMMAND_QUEUE_SIZE 1024
+
+#include "game.h"
+#include "audio_effects.cc"
+#include "sounds.cc"
+#include "mixer.cc"
+
+#define BENCH_SAMPLES_PER_SECOND 48000
+#define BENCH_PERIOD_FRAMES 1024
+#define BENCH_DEFAULT_PERIODS 200
+#define BENCH_NUM_SOUNDS 3
+
+typedef struct bench_golden {
+  u32 Voices;
+  u64 Hash;
+} bench_golden;
+
+// Hashes of the mixed output for the default number of periods
+internal bench_golden BenchGolden[] = {
+  { 1, 0xe92cf7f84b01a580ULL },
+  { 2, 0xf6653a2990ab2d29ULL },
+  { 4, 0xdd61e222c991c9aaULL },
+  { 8, 0xdb5118c8f830f6b8ULL },
+  { 16, 0x68b5272b8f097a47ULL },
+  { 32, 0x2b53d4930e7dbc5eULL },
+  { 64, 0xb346c8afa1675de5ULL },
+  { 128, 0xbd30bc2f562dc930ULL },
+  { 256, 0xe748f4dfdbac25e3ULL },
+  { 512, 0x540ea3a272edf2ffULL },
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// platform
+
+internal b32 BenchMapFile(const char *FileName, platform_mapped_file *FileOutput)
+{
+  b32 Result = false;
+  int File = open(FileName, O_RDONLY);
+
+  if (File >= 0) {
+    struct stat FileStat;
+    if (fstat(File, &FileStat) == 0 && FileStat.st_size > 0) {
+      void *Data = mmap(NULL, FileStat.st_size, PROT_READ, MAP_PRIVATE, File, 0);
+      if (Data != MAP_FAILED) {
+        FileOutput->Data = (u8*)Data;
+        FileOutput->SizeBytes = FileStat.st_size;
+        Result = true;
+      }
+    }
+    close(File);
+  }
+
+  return(Result);
+}
+
+internal void BenchUnmapFile(platform_mapped_file *File)
+{
+  if (File->Data) {
+    munmap(File->Data, File->SizeBytes);
+  }
+  File->Data = NULL;
+  File->SizeBytes = 0;
+}
+
+// NOTE: Paging hints would only add noise to the timings
+internal void BenchAdviseFileRange(platform_mapped_file *File, u32 Offset, u32 SizeBytes, platform_file_advice Advice)
+{
+}
+
+// NOTE: There are no worker threads here, so work is done as it is added and
+// streamed voices are ready to start on the next update.
+internal void BenchWorkQueueAddEntry(work_queue *Queue, platform_work_queue_callback_fn *Callback, void *Data)
+{
+  Callback(Queue, Data);
+}
+
+internal void BenchWorkQueueAddEntries(work_queue *Queue, work_queue_priority Priority, platform_work_queue_callback_fn *Callback, void **Data, u32 Count, work_counter *Counter)
+{
+  foreach(I, Count)
+  {
+    Callback(Queue, Data[I]);
+  }
+}
+
+internal void BenchWorkQueueCompleteAllWork(work_queue *Queue)
+{
+}
+
+internal memory_arena* BenchWorkQueueGetScratchArena(work_queue *Queue)
+{
+  return(NULL);
+}
+
+internal u64 BenchGetTimeNs(void)
+{
+  struct timespec Time;
+  clock_gettime(CLOCK_MONOTONIC, &Time);
+  return((u64)Time.tv_sec * 1000000000ULL + (u64)Time.tv_nsec);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sounds
+
+// Fills in a sound that lives entirely in the PCM cache. Each channel is a
+// sine sweep with a little noise so that every part of the mixer has
+// something to chew on.
+internal sound BenchSynthesizeSound(memory_arena *Arena, u32 SampleRate, f32 Seconds, f32 StartHz, f32 EndHz)
+{
+  sound Result = {};
+  Result.Loaded = true;
+  Result.Channels = 2;
+  Result.SampleRate = SampleRate;
+  Result.Samples = (u32)(Seconds * SampleRate);
+  Result.PCMFrames = Result.Samples;
+  Result.PCM = ArenaPushArray(Arena, 2 * Result.PCMFrames, f32);
+
+  u32 Noise = 0x12345678;
+  f32 Phase = 0.0f;
+  foreach (Frame, Result.PCMFrames)
+  {
+    f32 T = (f32)Frame / (f32)Result.PCMFrames;
+    Phase += TAU * (StartHz + T * (EndHz - StartHz)) / (f32)SampleRate;
+    if (Phase > TAU)
+    {
+      Phase -= TAU;
+    }
+
+    Noise = Noise * 1664525 + 1013904223;
+    f32 Hiss = 0.05f * ((f32)(Noise >> 8) / (f32)(1 << 24) - 0.5f);
+    Result.PCM[2*Frame + 0] = 0.5f * sinf(Phase) + Hiss;
+    Result.PCM[2*Frame + 1] = 0.5f * sinf(Phase + 0.25f * PI) - Hiss;
+  }
+
+  return(Result);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// benchmark
+
+typedef struct bench_result {
+  u64 Hash;
+  u64 MixNs;
+  u64 VoiceFrames;
+} bench_result;
+
+// FNV-1a over the output samples
+internal u64 BenchHash(u64 Hash, u8 *Data, umm SizeBytes)
+{
+  foreach (I, SizeBytes)
+  {
+    Hash ^= Data[I];
+    Hash *= 0x100000001b3ULL;
+  }
+  return(Hash);
+}
+
+internal bench_result BenchRun(u32 NumVoices, u32 Periods, sound *Sounds, sound *Streamed, platform_state *Platform)
+{
+  bench_result Result = {};
+  Result.Hash = 0xcbf29ce484222325ULL;
+
+  // NOTE: The player is too big for the stack, and AudioPlayerInit carves its
+  // arena out of the one given to it.
+  umm ArenaSize = AUDIO_PLAYER_ARENA_SIZE + Megabytes(1);
+  memory_arena Arena = ArenaInit((u8*)calloc(1, ArenaSize), ArenaSize);
+  audio_player *Player = (audio_player*)calloc(1, sizeof(audio_player));
+  AudioPlayerInit(Player, &Arena);
+  AudioPlayerSetVoiceBudget(Player, NumVoices);
+  AudioPlayerSetListener(Player, V2(0.0f, 0.0f));
+  AudioPlayerSetBusEffect(Player, AUDIO_BUS_sfx, 0, AudioReverb(0.8f, 0.4f, 0.2f));
+  AudioPlayerSetBusEffect(Player, AUDIO_BUS_music, 0, AudioLowPass(8000.0f));
+
+  playing_sound *Handles = (playing_sound*)calloc(NumVoices, sizeof(playing_sound));
+  f32 Volume = 1.0f / (f32)NumVoices;
+  foreach (Voice, NumVoices)
+  {
+    // NOTE: Nearly every voice loops so the voice count holds steady
+    sound *Sound = Sounds + (Voice % BENCH_NUM_SOUNDS);
+    b32 Loop = (Voice % 8) != 7;
+    audio_bus_id Bus = (Voice % 2) ? AUDIO_BUS_sfx : AUDIO_BUS_music;
+    if (Streamed && (Voice % 4) == 3)
+    {
+      Sound = Streamed;
+    }
+
+    if ((Voice % 4) == 1)
+    {
+      v2 Position = V2((f32)((i32)(Voice * 37) % 1024 - 512), (f32)((i32)(Voice * 53) % 512 - 256));
+      Handles[Voice] = AudioPlayerPlaySoundAt(Player, Platform, Sound, Position, Volume, Loop, AUDIO_PRIORITY_DEFAULT, Bus);
+    }
+    else
+    {
+      Handles[Voice] = AudioPlayerPlaySound(Player, Platform, Sound, V2(Volume), Loop, AUDIO_PRIORITY_DEFAULT, Bus);
+    }
+
+    if ((Voice % 5) == 2)
+    {
+      PlayingSoundChangePitch(Player, Handles[Voice], 1.25f);
+    }
+  }
+
+  // Start the streamed voices, which are pending until their decoders are
+  // handed over
+  AudioPlayerUpdate(Player, Platform);
+
+  umm OutSizeBytes = BENCH_PERIOD_FRAMES * 2 * sizeof(i16);
+  audio_buffer AudioBuffer = {};
+  AudioBuffer.Samples = (i16*)calloc(1, OutSizeBytes);
+  AudioBuffer.FrameCount = BENCH_PERIOD_FRAMES;
+  AudioBuffer.SamplesPerSecond = BENCH_SAMPLES_PER_SECOND;
+
+  foreach (Period, Periods)
+  {
+    // Exercise fades part way through
+    if (Period == Periods / 4)
+    {
+      foreach (Voice, NumVoices)
+      {
+        if ((Voice % 3) == 1)
+        {
+          PlayingSoundChangeVolume(Player, Handles[Voice], V2(0.5f * Volume, Volume), 0.5f);
+        }
+      }
+    }
+    else if (Period == Periods / 2)
+    {
+      foreach (Voice, NumVoices)
+      {
+        if ((Voice % 7) == 0)
+        {
+          PlayingSoundStop(Player, Handles[Voice], 0.25f);
+        }
+      }
+    }
+
+    u64 StartNs = BenchGetTimeNs();
+    AudioPlayerMix(Player, &AudioBuffer);
+    Result.MixNs += BenchGetTimeNs() - StartNs;
+
+    audio_mix_stats Stats = AudioPlayerGetStats(Player);
+    Result.VoiceFrames += Stats.VoiceFramesMixed;
+    Result.Hash = BenchHash(Result.Hash, (u8*)AudioBuffer.Samples, OutSizeBytes);
+
+    AudioPlayerUpdate(Player, Platform);
+  }
+
+  AudioPlayerDestroy(Player, Platform);
+  free(AudioBuffer.Samples);
+  free(Handles);
+  free(Player);
+  free(Arena.Base);
+  return(Result);
+}
+
+int main(int ArgCount, char **Args)
+{
+  u32 Periods = BENCH_DEFAULT_PERIODS;
+  const char *StreamFile = NULL;
+
+  for (i32 Arg = 1; Arg < ArgCount; ++Arg)
+  {
+    if (strcmp(Args[Arg], "-p") == 0 && Arg + 1 < ArgCount)
+    {
+      Periods = (u32)atoi(Args[++Arg]);
+    }
+    else if (strcmp(Args[Arg], "-s") == 0 && Arg + 1 < ArgCount)
+    {
+      StreamFile = Args[++Arg];
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [-p periods] [-s streamed.ogg]\n", Args[0]);
+      return(1);
+    }
+  }
+
+  platform_state Platform = {};
+  Platform.Interface.MapFile = BenchMapFile;
+  Platform.Interface.UnmapFile = BenchUnmapFile;
+  Platform.Interface.AdviseFileRange = BenchAdviseFileRange;
+  Platform.Interface.WorkQueueAddEntry = BenchWorkQueueAddEntry;
+  Platform.Interface.WorkQueueAddEntries = BenchWorkQueueAddEntries;
+  Platform.Interface.WorkQueueCompleteAllWork = BenchWorkQueueCompleteAllWork;
+  Platform.Interface.WorkQueueGetScratchArena = BenchWorkQueueGetScratchArena;
+
+  umm ArenaSize = SOUND_MANAGER_PCM_CACHE_SIZE + Megabytes(8);
+  memory_arena Arena = ArenaInit((u8*)calloc(1, ArenaSize), ArenaSize);
+
+  // NOTE: One sound at the device rate, which mixes straight from the ring,
+  // and two that have to be resampled.
+  sound Sounds[BENCH_NUM_SOUNDS];
+  Sounds[0] = BenchSynthesizeSound(&Arena, 48000, 0.5f, 220.0f, 880.0f);
+  Sounds[1] = BenchSynthesizeSound(&Arena, 44100, 1.5f, 110.0f, 3520.0f);
+  Sounds[2] = BenchSynthesizeSound(&Arena, 22050, 0.25f, 440.0f, 440.0f);
+
+  memory_pool WorkPool;
+  MemoryPoolInit(&WorkPool, &Arena, WORK_POOL_BLOCK_SIZE, 16);
+
+  sound_manager SoundManager;
+  SoundManagerInit(&SoundManager, ".", &Arena, &WorkPool);
+  SoundManager.MaxCachedSeconds = 0.0f;
+
+  sound StreamedSound = {};
+  sound *Streamed = NULL;
+  if (StreamFile)
+  {
+    if (!SoundManagerLoadSound(&SoundManager, &StreamedSound, &Platform, StreamFile))
+    {
+      return(1);
+    }
+    Streamed = &StreamedSound;
+  }
+
+  b32 Failed = false;
+  b32 CheckHashes = (!Streamed && Periods == BENCH_DEFAULT_PERIODS);
+  printf("%8s %14s %18s\n", "voices", "ns/frame/voice", "hash");
+
+  foreach (I, ArrayCount(BenchGolden))
+  {
+    bench_golden *Golden = BenchGolden + I;
+    bench_result Result = BenchRun(Golden->Voices, Periods, Sounds, Streamed, &Platform);
+
+    f64 NsPerVoiceFrame = (Result.VoiceFrames > 0) ? (f64)Result.MixNs / (f64)Result.VoiceFrames : 0.0;
+    printf("%8u %14.2f %18llx", Golden->Voices, NsPerVoiceFrame, (unsigned long long)Result.Hash);
+    if (CheckHashes && Result.Hash != Golden->Hash)
+    {
+      printf("  MISMATCH, expected %llx", (unsigned long long)Golden->Hash);
+      Failed = true;
+    }
+    printf("\n");
+  }
+
+  if (Streamed)
+  {
+    SoundManagerDestroySound(&SoundManager, &StreamedSound, &Platform);
+  }
+  SoundManagerDestroy(&SoundManager);
+  free(Arena.Base);
+
+  return(Failed ? 1 : 0);
+}